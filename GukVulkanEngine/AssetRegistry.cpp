@@ -0,0 +1,129 @@
+#include "AssetRegistry.h"
+#include "Logger.h"
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace guk {
+
+uint64_t AssetRegistry::hash(const void* data, size_t size, uint64_t seed)
+{
+    // FNV-1a
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+uint64_t AssetRegistry::fileHash(const std::string& path)
+{
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(path, error);
+    if (error) {
+        exitLog("failed to open file: {}", path);
+    }
+    int64_t writeTime = std::filesystem::last_write_time(path).time_since_epoch().count();
+
+    {
+        std::lock_guard lock(mutex_);
+        auto it = fileHashes_.find(path);
+        if (it != fileHashes_.end() && it->second.size == size &&
+            it->second.writeTime == writeTime) {
+            return it->second.hash;
+        }
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> bytes(static_cast<size_t>(size));
+    file.read(bytes.data(), bytes.size());
+
+    FileHash fileHash{size, writeTime, hash(bytes.data(), bytes.size())};
+
+    std::lock_guard lock(mutex_);
+    fileHashes_[path] = fileHash;
+    return fileHash.hash;
+}
+
+std::shared_ptr<Image2D> AssetRegistry::acquireTexture(std::shared_ptr<Device> device,
+                                                       uint64_t key, const std::string& name,
+                                                       bool& created)
+{
+    std::lock_guard lock(mutex_);
+
+    auto it = textures_.find(key);
+    created = it == textures_.end();
+    if (created) {
+        it = textures_.emplace(key, Entry<Image2D>{std::make_shared<Image2D>(device), name}).first;
+    }
+
+    return it->second.asset;
+}
+
+std::shared_ptr<ModelAsset> AssetRegistry::acquireModel(uint64_t key, const std::string& name,
+                                                        bool& created)
+{
+    std::lock_guard lock(mutex_);
+
+    auto it = models_.find(key);
+    created = it == models_.end();
+    if (created) {
+        it = models_.emplace(key, Entry<ModelAsset>{std::make_shared<ModelAsset>(), name}).first;
+    }
+
+    return it->second.asset;
+}
+
+uint32_t AssetRegistry::evictUnused()
+{
+    std::vector<std::string> evicted;
+
+    {
+        std::lock_guard lock(mutex_);
+
+        auto evict = [&evicted](auto& entries) {
+            std::erase_if(entries, [&evicted](const auto& entry) {
+                if (entry.second.asset.use_count() > 1) {
+                    return false;
+                }
+                evicted.push_back(entry.second.name);
+                return true;
+            });
+        };
+
+        // models hold their textures, so they go first
+        evict(models_);
+        evict(textures_);
+    }
+
+    if (evictionHook_) {
+        for (const auto& name : evicted) {
+            evictionHook_(name);
+        }
+    }
+
+    return static_cast<uint32_t>(evicted.size());
+}
+
+void AssetRegistry::setEvictionHook(std::function<void(const std::string& name)> hook)
+{
+    evictionHook_ = hook;
+}
+
+uint32_t AssetRegistry::textureCount() const
+{
+    std::lock_guard lock(mutex_);
+    return static_cast<uint32_t>(textures_.size());
+}
+
+uint32_t AssetRegistry::modelCount() const
+{
+    std::lock_guard lock(mutex_);
+    return static_cast<uint32_t>(models_.size());
+}
+
+} // namespace guk
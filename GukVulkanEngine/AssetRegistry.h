@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Mesh.h"
+#include "Image2D.h"
+#include "DataStructures.h"
+
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace guk {
+
+// cpu description of an imported model file, meshes share their gpu buffers between copies
+struct ModelAsset
+{
+    std::vector<Mesh> meshes;
+    std::vector<MaterialUniform> materials;
+    std::vector<std::string> textureFiles;
+    std::vector<TextureKind> textureKinds;
+    std::vector<std::shared_ptr<Image2D>> textures;
+    glm::vec3 boundMin{};
+    glm::vec3 boundMax{};
+
+    std::promise<void> promise;
+    std::shared_future<void> imported{promise.get_future().share()};
+};
+
+// engine wide cache of textures and model files keyed by content hash, entries stay alive while
+// referenced and are kept as a cache afterwards until evictUnused
+class AssetRegistry
+{
+  public:
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+    // content hash of a file, remembered by path until its size or write time changes
+    uint64_t fileHash(const std::string& path);
+
+    // created tells the caller it has to fill (decode, upload) the entry, everyone else shares it
+    std::shared_ptr<Image2D> acquireTexture(std::shared_ptr<Device> device, uint64_t key,
+                                            const std::string& name, bool& created);
+    std::shared_ptr<ModelAsset> acquireModel(uint64_t key, const std::string& name,
+                                             bool& created);
+
+    uint32_t evictUnused();
+    void setEvictionHook(std::function<void(const std::string& name)> hook);
+
+    uint32_t textureCount() const;
+    uint32_t modelCount() const;
+
+  private:
+    struct FileHash
+    {
+        uintmax_t size{};
+        int64_t writeTime{};
+        uint64_t hash{};
+    };
+
+    template <typename T>
+    struct Entry
+    {
+        std::shared_ptr<T> asset;
+        std::string name;
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, FileHash> fileHashes_;
+    std::unordered_map<uint64_t, Entry<Image2D>> textures_;
+    std::unordered_map<uint64_t, Entry<ModelAsset>> models_;
+    std::function<void(const std::string& name)> evictionHook_;
+};
+
+} // namespace guk
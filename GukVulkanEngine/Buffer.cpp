@@ -34,6 +34,15 @@ void Buffer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
     bufferCI.usage = usage;
     bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+    // shader visible buffers are read on the compute queue too
+    const auto& queueFamilies = device_->queueFamilies();
+    if (queueFamilies.size() > 1 &&
+        (usage & (VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))) {
+        bufferCI.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferCI.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        bufferCI.pQueueFamilyIndices = queueFamilies.data();
+    }
+
     VK_CHECK(vkCreateBuffer(device_->get(), &bufferCI, nullptr, &buffer_));
 
     VkMemoryRequirements memoryRs;
@@ -44,18 +53,30 @@ void Buffer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
     memoryAI.allocationSize = memoryRs.size;
     memoryAI.memoryTypeIndex = device_->getMemoryTypeIndex(memoryRs.memoryTypeBits, property);
 
+    VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo{};
+    memoryAllocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+    memoryAllocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+        memoryAI.pNext = &memoryAllocateFlagsInfo;
+    }
+
     VK_CHECK(vkAllocateMemory(device_->get(), &memoryAI, nullptr, &memory_));
     VK_CHECK(vkBindBufferMemory(device_->get(), buffer_, memory_, 0));
 }
 
 void Buffer::createStagingBuffer(const void* data, VkDeviceSize size)
+{
+    createStagingBuffer(size);
+
+    memcpy(mappedMemory_, data, static_cast<size_t>(size));
+}
+
+void Buffer::createStagingBuffer(VkDeviceSize size)
 {
     createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
     VK_CHECK(vkMapMemory(device_->get(), memory_, 0, size, 0, &mappedMemory_));
-
-    memcpy(mappedMemory_, data, static_cast<size_t>(size));
 }
 
 void Buffer::createUniformBuffer(VkDeviceSize size)
@@ -66,7 +87,15 @@ void Buffer::createUniformBuffer(VkDeviceSize size)
     VK_CHECK(vkMapMemory(device_->get(), memory_, 0, size, 0, &mappedMemory_));
 }
 
-void Buffer::createLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlagBits usage)
+void Buffer::createStorageBuffer(VkDeviceSize size)
+{
+    createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    VK_CHECK(vkMapMemory(device_->get(), memory_, 0, size, 0, &mappedMemory_));
+}
+
+void Buffer::createLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage)
 {
     Buffer stagingBuffer{device_};
     stagingBuffer.createStagingBuffer(data, size);
@@ -82,9 +111,28 @@ void Buffer::createLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsag
     device_->submitWait(cmd);
 }
 
+void Buffer::createLocalBuffer(VkDeviceSize size, VkBufferUsageFlags usage)
+{
+    createBuffer(size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
 const VkBuffer& Buffer::get() const
 {
     return buffer_;
 }
 
+void* Buffer::mapped() const
+{
+    return mappedMemory_;
+}
+
+VkDeviceAddress Buffer::address() const
+{
+    VkBufferDeviceAddressInfo addressInfo{};
+    addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    addressInfo.buffer = buffer_;
+
+    return vkGetBufferDeviceAddress(device_->get(), &addressInfo);
+}
+
 } // namespace guk
\ No newline at end of file
@@ -11,10 +11,18 @@ class Buffer
     ~Buffer();
 
     void createStagingBuffer(const void* data, VkDeviceSize size);
+    void createStagingBuffer(VkDeviceSize size);
     void createUniformBuffer(VkDeviceSize size);
-    void createLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlagBits usage);
+    // mapped like the uniform buffers, for data rewritten by the cpu every frame
+    void createStorageBuffer(VkDeviceSize size);
+    void createLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage);
+    // left uninitialized, for data written on the gpu
+    void createLocalBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
 
     const VkBuffer& get() const;
+    void* mapped() const;
+    // needs VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+    VkDeviceAddress address() const;
 
     template <typename T_DATA>
     void update(const T_DATA& data)
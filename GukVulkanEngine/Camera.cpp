@@ -2,6 +2,19 @@
 #include "Window.h"
 
 namespace guk {
+
+static float halton(uint32_t index, uint32_t base)
+{
+    float result{};
+    float f{1.f};
+    for (uint32_t i = index; i > 0; i /= base) {
+        f /= static_cast<float>(base);
+        result += f * static_cast<float>(i % base);
+    }
+
+    return result;
+}
+
 Camera::Camera()
 {
     perspective_ = glm::perspectiveRH_ZO(glm::radians(fov_), Window::aspectRatio, znear_, zfar_);
@@ -75,7 +88,26 @@ void Camera::writeScene(SceneUniform& sceneUniform) const
 {
     sceneUniform.view = view_;
     sceneUniform.proj = perspective_;
+    sceneUniform.proj[2][0] += jitter_.x;
+    sceneUniform.proj[2][1] += jitter_.y;
     sceneUniform.cameraPos = position_;
+
+    // the last frame's matrix of the same uniform becomes the previous one
+    sceneUniform.prevViewProj = sceneUniform.viewProj;
+    sceneUniform.viewProj = perspective_ * view_;
+}
+
+void Camera::jitter(uint32_t frame, uint32_t width, uint32_t height)
+{
+    // 8 phases, starting at 1 skips the sample in the pixel center
+    uint32_t phase = frame % 8 + 1;
+    jitter_.x = (halton(phase, 2) - 0.5f) * 2.f / static_cast<float>(width);
+    jitter_.y = (halton(phase, 3) - 0.5f) * 2.f / static_cast<float>(height);
+}
+
+void Camera::resetJitter()
+{
+    jitter_ = glm::vec2(0.f);
 }
 
 glm::vec3 Camera::pos() const
@@ -17,6 +17,10 @@ class Camera
     void rotate(float dx, float dy);
     void writeScene(SceneUniform& sceneUniform) const;
 
+    // sub-pixel projection offset for taa, frame indexes a Halton(2, 3) sequence
+    void jitter(uint32_t frame, uint32_t width, uint32_t height);
+    void resetJitter();
+
     bool firstPersonMode_{true};
     KeyState keyState_{};
 
@@ -41,6 +45,7 @@ class Camera
 
     glm::mat4 view_{1.f};
     glm::mat4 perspective_;
+    glm::vec2 jitter_{};
 };
 
 } // namespace guk
\ No newline at end of file
@@ -33,7 +33,7 @@ std::vector<VkVertexInputAttributeDescription> Vertex::getAttributeDescriptions(
 
     attributeDescriptions[3].binding = 0;
     attributeDescriptions[3].location = 3;
-    attributeDescriptions[3].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescriptions[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
     attributeDescriptions[3].offset = offsetof(Vertex, tangent);
 
     return attributeDescriptions;
@@ -11,12 +11,39 @@ struct Vertex
     glm::vec3 position;
     glm::vec3 normal;
     glm::vec2 texcoord;
-    glm::vec3 tangent;
+    // w is the bitangent sign, bitangent = w * cross(normal, tangent)
+    glm::vec4 tangent;
 
     static VkVertexInputBindingDescription getBindingDescrption();
     static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
 };
 
+// cpu geometry kept after the gpu buffers are created, positions keep the indices too
+enum class GeometryResidency
+{
+    None,
+    Positions,
+    Full,
+};
+
+// how a model file becomes meshes, part of the mesh cache key except residency
+struct ImportOptions
+{
+    bool normalize{};
+    // meshes sharing a material are merged per cell of an octree of mergeDepth levels
+    bool mergeMeshes{};
+    uint32_t mergeDepth{2};
+
+    // assimp post processing after triangulation
+    bool joinIdenticalVertices{true};
+    bool removeDegenerates{true};
+    bool improveCacheLocality{true};
+    bool splitLargeMeshes{true};
+    bool sortByPrimitiveType{true};
+
+    GeometryResidency residency{GeometryResidency::None};
+};
+
 struct SceneUniform
 {
     glm::mat4 view = glm::mat4(1.f);
@@ -25,6 +52,35 @@ struct SceneUniform
     alignas(16) glm::vec3 directionalLightDir = glm::vec3(0.f, 1.f, 0.f);
     alignas(16) glm::vec3 directionalLightColor = glm::vec3(1.f);
     alignas(16) glm::mat4 directionalLightMatrix = glm::mat4(1.f);
+    // unjittered, the taa velocity compares this frame with the previous one
+    glm::mat4 viewProj = glm::mat4(1.f);
+    glm::mat4 prevViewProj = glm::mat4(1.f);
+    // set by the renderer, pbr.frag finds the light cluster of a pixel with them
+    glm::uvec2 renderSize = glm::uvec2(1);
+    uint32_t lightCount = 0;
+};
+
+// point light when spotOuterCos is -1, laid out as the std430 light buffer
+struct Light
+{
+    glm::vec3 position = glm::vec3(0.f);
+    float range = 1.f;
+    // radiance at unit distance
+    glm::vec3 color = glm::vec3(1.f);
+    float spotInnerCos = -1.f;
+    glm::vec3 direction = glm::vec3(0.f, -1.f, 0.f);
+    float spotOuterCos = -1.f;
+};
+
+// a mesh drawn into the visibility buffer, laid out as the std430 draw buffer
+struct VisibilityDraw
+{
+    glm::mat4 model = glm::mat4(1.f);
+    VkDeviceAddress vertices{};
+    VkDeviceAddress indices{};
+    // slot of the material in the frame, shaded by the resolve dispatch of that slot
+    uint32_t material{};
+    uint32_t padding[3]{};
 };
 
 struct MaterialUniform
@@ -40,6 +96,50 @@ struct MaterialUniform
     int32_t occlusionTextureIndex = -1;
 };
 
+// how a material samples a texture, decides its color space and block compression
+enum class TextureKind
+{
+    Color,
+    Linear,
+    Normal,
+    MetallicRoughness,
+    Occlusion
+};
+
+// scene anti-aliasing, msaa modes carry their VkSampleCountFlagBits value
+enum class AntiAliasing : uint32_t
+{
+    Taa = 0,
+    Msaa1 = 1,
+    Msaa2 = 2,
+    Msaa4 = 4,
+    Msaa8 = 8
+};
+
+// anti-aliasing of the single sample scene in post
+enum class PostAntiAliasing
+{
+    None,
+    Fxaa,
+    Smaa
+};
+
+// TONEMAPPER specialization constant of post_process.comp
+enum class Tonemapper : uint32_t
+{
+    Reinhard,
+    Aces,
+    AgX
+};
+
+// SHADOW_FILTER specialization constant of pbr.frag and material_resolve.comp
+enum class ShadowFilter : uint32_t
+{
+    Hard,
+    Pcf3x3,
+    Pcf5x5
+};
+
 struct alignas(16) SkyboxUniform
 {
     float environmentIntensity = 1.f;
@@ -55,6 +155,13 @@ struct PostUniform
     float bloomStrength = 0.1f;
     float exposure = 1.f;
     float gamma = 2.2f;
+    // part of the scene attachment covered by the dynamic resolution render area
+    alignas(8) glm::vec2 sceneScale = glm::vec2(1.f);
+    // fused compute post only
+    float vignette = 0.f;
+    float grain = 0.f;
+    uint32_t dither = 1;
+    uint32_t frame = 0;
 };
 
 struct ModelPushConstants
@@ -66,6 +173,33 @@ struct BloomPushConstants
 {
     float width;
     float height;
+    // bloom_down.frag reading the scene samples its render area only
+    glm::vec2 uvScale{1.f, 1.f};
+};
+
+struct BloomComputePushConstants
+{
+    uint32_t levels;
+    uint32_t level;
+    glm::vec2 sceneScale{1.f, 1.f};
+};
+
+struct TaaPushConstants
+{
+    glm::vec2 prevSceneScale{1.f, 1.f};
+    glm::uvec2 renderSize{};
+    float blend{};
+    uint32_t reset{};
+};
+
+struct MaterialResolvePushConstants
+{
+    uint32_t material{};
+};
+
+struct PostAaPushConstants
+{
+    glm::uvec2 renderSize{};
 };
 
 struct GuiPushConstants
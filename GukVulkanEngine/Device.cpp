@@ -1,6 +1,9 @@
 #include "Device.h"
 #include "Logger.h"
+#include "AssetRegistry.h"
 
+#include <chrono>
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 
@@ -10,6 +13,18 @@ static PFN_vkCreateDebugUtilsMessengerEXT vkCreateDebugUtilsMessenger{};
 static PFN_vkDestroyDebugUtilsMessengerEXT vkDestroyDebugUtilsMessenger{};
 static VkDebugUtilsMessengerEXT debugUtilsMessenger{};
 
+// prefix of the pipeline cache file, the driver blob follows
+struct PipelineCacheFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
+
+static constexpr char PIPELINE_CACHE_MAGIC[4]{'G', 'U', 'K', 'P'};
+static constexpr uint32_t PIPELINE_CACHE_VERSION{1};
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugUtilsMessageCallback(
     VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
     VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -59,7 +74,13 @@ Device::~Device()
     }
 
     vkDestroyDescriptorPool(device_, descPool_, nullptr);
+    vkDestroyCommandPool(device_, computeCmdPool_, nullptr);
     vkDestroyCommandPool(device_, cmdPool_, nullptr);
+    for (const auto& [spv, shaderModule] : shaderModules_) {
+        vkDestroyShaderModule(device_, shaderModule, nullptr);
+    }
+
+    savePipelineCache();
     vkDestroyPipelineCache(device_, cache_, nullptr);
     vkDestroyDevice(device_, nullptr);
 
@@ -90,11 +111,97 @@ VkQueue Device::queue() const
     return queue_;
 }
 
+bool Device::asyncCompute() const
+{
+    return computeQueue_ != VK_NULL_HANDLE;
+}
+
+VkQueue Device::computeQueue() const
+{
+    return computeQueue_;
+}
+
+const std::vector<uint32_t>& Device::queueFamilies() const
+{
+    return queueFamilies_;
+}
+
 VkPipelineCache Device::cache() const
 {
     return cache_;
 }
 
+VkPipeline Device::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& pipelineCI)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    VkPipeline pipeline{};
+    VK_CHECK(vkCreateGraphicsPipelines(device_, cache_, 1, &pipelineCI, nullptr, &pipeline));
+
+    float ms =
+        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard lock(pipelineMutex_);
+    pipelineCreationMs_ += ms;
+    pipelineCount_++;
+
+    return pipeline;
+}
+
+VkPipeline Device::createComputePipeline(const VkComputePipelineCreateInfo& pipelineCI)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    VkPipeline pipeline{};
+    VK_CHECK(vkCreateComputePipelines(device_, cache_, 1, &pipelineCI, nullptr, &pipeline));
+
+    float ms =
+        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard lock(pipelineMutex_);
+    pipelineCreationMs_ += ms;
+    pipelineCount_++;
+
+    return pipeline;
+}
+
+void Device::compilePipeline(std::function<void()> create)
+{
+    if (pipelineJobs_.empty()) {
+        pipelineStart_ = std::chrono::steady_clock::now();
+    }
+
+    // few and long, a thread each keeps them from queueing behind model imports
+    pipelineJobs_.push_back(std::async(std::launch::async, create));
+}
+
+float Device::waitPipelines()
+{
+    for (auto& job : pipelineJobs_) {
+        job.get();
+    }
+    pipelineJobs_.clear();
+
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() -
+                                                    pipelineStart_)
+        .count();
+}
+
+bool Device::pipelineCacheWarm() const
+{
+    return pipelineCacheWarm_;
+}
+
+uint32_t Device::pipelineCount() const
+{
+    return pipelineCount_;
+}
+
+float Device::pipelineCreationMs() const
+{
+    return pipelineCreationMs_;
+}
+
 VkFormat Device::depthStencilFormat() const
 {
     return depthStencilFmt_;
@@ -102,11 +209,7 @@ VkFormat Device::depthStencilFormat() const
 
 VkSampleCountFlagBits Device::smapleCount() const
 {
-    VkPhysicalDeviceProperties properties;
-    vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
-
-    VkSampleCountFlags counts = properties.limits.framebufferColorSampleCounts &
-                                properties.limits.framebufferDepthSampleCounts;
+    VkSampleCountFlags counts = sampleCounts();
 
     if (counts & VK_SAMPLE_COUNT_4_BIT) {
         return VK_SAMPLE_COUNT_4_BIT;
@@ -118,6 +221,44 @@ VkSampleCountFlagBits Device::smapleCount() const
     return VK_SAMPLE_COUNT_1_BIT;
 }
 
+VkSampleCountFlags Device::sampleCounts() const
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+
+    return properties.limits.framebufferColorSampleCounts &
+           properties.limits.framebufferDepthSampleCounts;
+}
+
+bool Device::formatSupported(VkFormat format, VkFormatFeatureFlags2 features) const
+{
+    VkFormatProperties3 formatProperties3{};
+    formatProperties3.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3;
+    VkFormatProperties2 formatProperties{};
+    formatProperties.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2;
+    formatProperties.pNext = &formatProperties3;
+    vkGetPhysicalDeviceFormatProperties2(physicalDevice_, format, &formatProperties);
+
+    return (formatProperties3.optimalTilingFeatures & features) == features;
+}
+
+bool Device::storageWithoutFormat() const
+{
+    return formatSupported(VK_FORMAT_R16G16B16A16_SFLOAT,
+                           VK_FORMAT_FEATURE_2_STORAGE_READ_WITHOUT_FORMAT_BIT |
+                               VK_FORMAT_FEATURE_2_STORAGE_WRITE_WITHOUT_FORMAT_BIT);
+}
+
+bool Device::textureCompressionBC() const
+{
+    return textureCompressionBC_;
+}
+
+bool Device::geometryShader() const
+{
+    return geometryShader_;
+}
+
 void Device::checkSurfaceSupport(VkSurfaceKHR surface) const
 {
     VkBool32 presentSupport = false;
@@ -151,6 +292,16 @@ VkCommandBuffer Device::cmdBuffers(uint32_t index) const
     return cmdBuffers_[index];
 }
 
+VkCommandBuffer Device::lateCmdBuffers(uint32_t index) const
+{
+    return lateCmdBuffers_[index];
+}
+
+VkCommandBuffer Device::computeCmdBuffers(uint32_t index) const
+{
+    return computeCmdBuffers_[index];
+}
+
 VkCommandBuffer Device::beginCmd() const
 {
     VkCommandBufferAllocateInfo cmdAI{};
@@ -195,6 +346,42 @@ void Device::submitWait(VkCommandBuffer cmd) const
     vkDestroyFence(device_, fence, nullptr);
 }
 
+VkFence Device::submit(VkCommandBuffer cmd) const
+{
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    VkCommandBufferSubmitInfo cmdSI{};
+    cmdSI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    cmdSI.commandBuffer = cmd;
+
+    VkSubmitInfo2 si{};
+    si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    si.commandBufferInfoCount = 1;
+    si.pCommandBufferInfos = &cmdSI;
+
+    VkFenceCreateInfo fenceCI{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    VkFence fence;
+
+    VK_CHECK(vkCreateFence(device_, &fenceCI, nullptr, &fence));
+
+    VK_CHECK(vkQueueSubmit2(queue_, 1, &si, fence));
+
+    return fence;
+}
+
+bool Device::submitDone(VkCommandBuffer cmd, VkFence fence) const
+{
+    VkResult result = vkGetFenceStatus(device_, fence);
+    if (result == VK_NOT_READY) {
+        return false;
+    }
+    VK_CHECK(result);
+
+    vkDestroyFence(device_, fence, nullptr);
+    vkFreeCommandBuffers(device_, cmdPool_, 1, &cmd);
+    return true;
+}
+
 const VkDescriptorPool& Device::descriptorPool() const
 {
     return descPool_;
@@ -220,6 +407,11 @@ VkSampler Device::samplerLinearClamp() const
     return samplers_[3];
 }
 
+VkSampler Device::samplerLinearRepeatBaseLevel() const
+{
+    return samplers_[4];
+}
+
 VkQueryPool Device::queryPools(size_t index)
 {
     return queryPools_[index];
@@ -341,6 +533,16 @@ void Device::selectPhysicalDevice()
         }
     }
 
+    // a compute only family runs on its own hardware queue next to graphics
+    for (uint32_t i = 0; i < qFamilyCnt; i++) {
+        if ((qFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+            !(qFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+            qFamilies[i].timestampValidBits > 0) {
+            computeFamilyIdx_ = i;
+            break;
+        }
+    }
+
     // swapchain extesion
     uint32_t extCnt{};
     vkEnumerateDeviceExtensionProperties(physicalDevice_, nullptr, &extCnt, nullptr);
@@ -373,17 +575,39 @@ void Device::selectPhysicalDevice()
 void Device::createDevice()
 {
     const float queuePriority = 1.f;
-    VkDeviceQueueCreateInfo queueCI{};
-    queueCI.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCI.queueFamilyIndex = queueFaimlyIdx_;
-    queueCI.queueCount = 1;
-    queueCI.pQueuePriorities = &queuePriority;
+    std::vector<VkDeviceQueueCreateInfo> queueCIs(1);
+    queueCIs[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCIs[0].queueFamilyIndex = queueFaimlyIdx_;
+    queueCIs[0].queueCount = 1;
+    queueCIs[0].pQueuePriorities = &queuePriority;
+
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(physicalDevice_, &supported);
+
+    bool asyncCompute = computeFamilyIdx_ != uint32_t(-1) && supported12.timelineSemaphore;
+    if (asyncCompute) {
+        queueCIs.push_back(queueCIs[0]);
+        queueCIs[1].queueFamilyIndex = computeFamilyIdx_;
+    }
 
     VkPhysicalDeviceFeatures deviceFeatures{};
     vkGetPhysicalDeviceFeatures(physicalDevice_, &deviceFeatures);
+    textureCompressionBC_ = deviceFeatures.textureCompressionBC;
+    geometryShader_ = deviceFeatures.geometryShader;
+
+    VkPhysicalDeviceVulkan12Features deviceFeatures12{};
+    deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    deviceFeatures12.timelineSemaphore = asyncCompute;
+    // the visibility buffer resolve fetches mesh geometry through buffer references
+    deviceFeatures12.bufferDeviceAddress = VK_TRUE;
 
     VkPhysicalDeviceVulkan13Features deviceFeatures13{};
     deviceFeatures13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    deviceFeatures13.pNext = &deviceFeatures12;
     deviceFeatures13.dynamicRendering = VK_TRUE;
     deviceFeatures13.synchronization2 = VK_TRUE;
 
@@ -394,8 +618,8 @@ void Device::createDevice()
 
     VkDeviceCreateInfo deviceCI{};
     deviceCI.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCI.queueCreateInfoCount = 1;
-    deviceCI.pQueueCreateInfos = &queueCI;
+    deviceCI.queueCreateInfoCount = static_cast<uint32_t>(queueCIs.size());
+    deviceCI.pQueueCreateInfos = queueCIs.data();
     deviceCI.pEnabledFeatures = nullptr;
     deviceCI.enabledExtensionCount = 1;
     deviceCI.ppEnabledExtensionNames = &swapchainExtension_;
@@ -405,16 +629,115 @@ void Device::createDevice()
 
     // queue
     vkGetDeviceQueue(device_, queueFaimlyIdx_, 0, &queue_);
+    queueFamilies_ = {queueFaimlyIdx_};
+    if (asyncCompute) {
+        vkGetDeviceQueue(device_, computeFamilyIdx_, 0, &computeQueue_);
+        queueFamilies_.push_back(computeFamilyIdx_);
+    }
+    log("async compute: {}", asyncCompute ? "available" : "not available");
 }
 
 void Device::createPipelineCache()
 {
+    std::vector<char> data = readPipelineCache();
+    pipelineCacheWarm_ = !data.empty();
+
     VkPipelineCacheCreateInfo pipelineCacheCI{};
     pipelineCacheCI.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheCI.initialDataSize = data.size();
+    pipelineCacheCI.pInitialData = data.empty() ? nullptr : data.data();
 
     VK_CHECK(vkCreatePipelineCache(device_, &pipelineCacheCI, nullptr, &cache_));
 }
 
+std::vector<char> Device::readPipelineCache() const
+{
+    std::ifstream ifs(PIPELINE_CACHE_FILE, std::ios::ate | std::ios::binary);
+    if (!ifs.is_open()) {
+        log("no pipeline cache, starting cold");
+        return {};
+    }
+
+    size_t size = (size_t)ifs.tellg();
+    PipelineCacheFileHeader header{};
+    if (size < sizeof(header)) {
+        log("pipeline cache is truncated, starting cold");
+        return {};
+    }
+
+    ifs.seekg(0);
+    ifs.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (memcmp(header.magic, PIPELINE_CACHE_MAGIC, sizeof(PIPELINE_CACHE_MAGIC)) != 0 ||
+        header.version != PIPELINE_CACHE_VERSION || header.dataSize != size - sizeof(header)) {
+        log("pipeline cache has an unknown format, starting cold");
+        return {};
+    }
+
+    std::vector<char> data(static_cast<size_t>(header.dataSize));
+    ifs.read(data.data(), data.size());
+    if (!ifs || AssetRegistry::hash(data.data(), data.size()) != header.dataHash) {
+        log("pipeline cache is corrupt, starting cold");
+        return {};
+    }
+
+    // the driver rejects foreign blobs too, checking here tells why the cache went cold
+    VkPipelineCacheHeaderVersionOne driverHeader{};
+    if (data.size() < sizeof(driverHeader)) {
+        log("pipeline cache is truncated, starting cold");
+        return {};
+    }
+    memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+
+    if (driverHeader.headerSize < sizeof(driverHeader) ||
+        driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+        log("pipeline cache has an unknown header version, starting cold");
+        return {};
+    }
+    if (driverHeader.vendorID != properties.vendorID ||
+        driverHeader.deviceID != properties.deviceID ||
+        memcmp(driverHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        log("pipeline cache is from another device or driver, starting cold");
+        return {};
+    }
+
+    log("pipeline cache loaded, {} bytes", data.size());
+    return data;
+}
+
+void Device::savePipelineCache() const
+{
+    size_t size{};
+    VK_CHECK(vkGetPipelineCacheData(device_, cache_, &size, nullptr));
+    std::vector<char> data(size);
+    VK_CHECK(vkGetPipelineCacheData(device_, cache_, &size, data.data()));
+    data.resize(size);
+
+    PipelineCacheFileHeader header{};
+    memcpy(header.magic, PIPELINE_CACHE_MAGIC, sizeof(PIPELINE_CACHE_MAGIC));
+    header.version = PIPELINE_CACHE_VERSION;
+    header.dataSize = data.size();
+    header.dataHash = AssetRegistry::hash(data.data(), data.size());
+
+    // written aside and renamed, a crash while saving keeps the previous cache
+    std::string temp = std::string(PIPELINE_CACHE_FILE) + ".tmp";
+    std::ofstream ofs(temp, std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(data.data(), data.size());
+    ofs.close();
+
+    std::error_code error;
+    if (!ofs.fail()) {
+        std::filesystem::rename(temp, PIPELINE_CACHE_FILE, error);
+    }
+    if (ofs.fail() || error) {
+        log("failed to save pipeline cache");
+        std::filesystem::remove(temp, error);
+    }
+}
+
 void Device::createCommandPool()
 {
     VkCommandPoolCreateInfo commandPoolCI{};
@@ -431,21 +754,38 @@ void Device::createCommandPool()
     allocInfo.commandBufferCount = static_cast<uint32_t>(cmdBuffers_.size());
 
     VK_CHECK(vkAllocateCommandBuffers(device_, &allocInfo, cmdBuffers_.data()));
+    VK_CHECK(vkAllocateCommandBuffers(device_, &allocInfo, lateCmdBuffers_.data()));
+
+    if (!asyncCompute()) {
+        return;
+    }
+
+    commandPoolCI.queueFamilyIndex = computeFamilyIdx_;
+    VK_CHECK(vkCreateCommandPool(device_, &commandPoolCI, nullptr, &computeCmdPool_));
+
+    allocInfo.commandPool = computeCmdPool_;
+    VK_CHECK(vkAllocateCommandBuffers(device_, &allocInfo, computeCmdBuffers_.data()));
 }
 
 void Device::createDescriptorPool()
 {
-    std::vector<VkDescriptorPoolSize> descPoolSize(2);
+    // material sets are allocated once per frame in flight
+    std::vector<VkDescriptorPoolSize> descPoolSize(4);
     descPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descPoolSize[0].descriptorCount = 30;
+    descPoolSize[0].descriptorCount = 256;
     descPoolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descPoolSize[1].descriptorCount = 130;
+    descPoolSize[1].descriptorCount = 1024;
+    descPoolSize[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descPoolSize[2].descriptorCount = 64;
+    descPoolSize[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descPoolSize[3].descriptorCount = 16;
 
     VkDescriptorPoolCreateInfo descPoolCI{};
     descPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descPoolCI.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
     descPoolCI.poolSizeCount = static_cast<uint32_t>(descPoolSize.size());
     descPoolCI.pPoolSizes = descPoolSize.data();
-    descPoolCI.maxSets = 40;
+    descPoolCI.maxSets = 256;
 
     VK_CHECK(vkCreateDescriptorPool(device_, &descPoolCI, nullptr, &descPool_));
 }
@@ -500,6 +840,14 @@ void Device::createSamplers()
     samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
 
     VK_CHECK(vkCreateSampler(device_, &samplerCI, nullptr, &samplers_[3]));
+
+    // Linear Repeat, mip 0 only
+    samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerCI.maxLod = 0.f;
+
+    VK_CHECK(vkCreateSampler(device_, &samplerCI, nullptr, &samplers_[4]));
 }
 
 void Device::createQueryPools()
@@ -523,8 +871,15 @@ void Device::createQueryPools()
     }
 }
 
-VkShaderModule Device::createShaderModule(const std::string& spv) const
+VkShaderModule Device::shaderModule(const std::string& spv)
 {
+    std::lock_guard lock(pipelineMutex_);
+
+    auto it = shaderModules_.find(spv);
+    if (it != shaderModules_.end()) {
+        return it->second;
+    }
+
     std::ifstream ifs(spv, std::ios::ate | std::ios::binary);
     if (!ifs.is_open()) {
         exitLog("failed to open file! [{}]", spv);
@@ -542,10 +897,17 @@ VkShaderModule Device::createShaderModule(const std::string& spv) const
     shaderModuleCI.codeSize = buffer.size();
     shaderModuleCI.pCode = reinterpret_cast<const uint32_t*>(buffer.data());
 
-    VkShaderModule shaderModule;
-    VK_CHECK(vkCreateShaderModule(device_, &shaderModuleCI, nullptr, &shaderModule));
+    VkShaderModule module;
+    VK_CHECK(vkCreateShaderModule(device_, &shaderModuleCI, nullptr, &module));
+    shaderModules_[spv] = module;
+
+    return module;
+}
 
-    return shaderModule;
+VkShaderModule Device::hdrShaderModule(const std::string& name)
+{
+    return shaderModule(storageWithoutFormat() ? "./shaders/" + name + ".comp.spv"
+                                               : "./shaders/" + name + "_rgba16f.comp.spv");
 }
 
 } // namespace guk
\ No newline at end of file
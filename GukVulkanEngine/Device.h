@@ -4,7 +4,12 @@
 #include <memory>
 #include <vector>
 #include <array>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 namespace guk {
 
@@ -21,24 +26,59 @@ class Device
     VkDevice get() const;
 
     VkQueue queue() const;
+    // separate compute queue family, timeline semaphores are enabled along with it
+    bool asyncCompute() const;
+    VkQueue computeQueue() const;
+    // families render targets are shared between, one when there is no async compute
+    const std::vector<uint32_t>& queueFamilies() const;
     VkPipelineCache cache() const;
+    // created with the persistent pipeline cache, times are summed for the cold/warm log.
+    // safe to call from several threads
+    VkPipeline createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& pipelineCI);
+    VkPipeline createComputePipeline(const VkComputePipelineCreateInfo& pipelineCI);
+    // runs create on a worker thread, waitPipelines joins all of them and returns the wall time
+    void compilePipeline(std::function<void()> create);
+    float waitPipelines();
+    bool pipelineCacheWarm() const;
+    uint32_t pipelineCount() const;
+    float pipelineCreationMs() const;
     void checkSurfaceSupport(VkSurfaceKHR surface) const;
 
     VkFormat depthStencilFormat() const;
     VkSampleCountFlagBits smapleCount() const;
+    VkSampleCountFlags sampleCounts() const;
+    // optimal tiling features, the storage without format bits included
+    bool formatSupported(VkFormat format, VkFormatFeatureFlags2 features) const;
+    // rgba16f storage images can be read and written from compute without a format qualifier
+    bool storageWithoutFormat() const;
+    bool textureCompressionBC() const;
+    // gl_PrimitiveID in fragment shaders needs the geometry shader feature
+    bool geometryShader() const;
     uint32_t getMemoryTypeIndex(uint32_t memoryType, VkMemoryPropertyFlags memoryProperty) const;
 
     VkCommandBuffer cmdBuffers(uint32_t index) const;
+    // graphics work of a frame that waits on its compute work
+    VkCommandBuffer lateCmdBuffers(uint32_t index) const;
+    VkCommandBuffer computeCmdBuffers(uint32_t index) const;
     VkCommandBuffer beginCmd() const;
     void submitWait(VkCommandBuffer cmd) const;
-
-    VkShaderModule createShaderModule(const std::string& spv) const;
+    // submits without waiting, poll submitDone with the returned fence until it returns true,
+    // the command buffer and the fence are freed then
+    VkFence submit(VkCommandBuffer cmd) const;
+    bool submitDone(VkCommandBuffer cmd, VkFence fence) const;
+
+    // loaded once and kept until the device is destroyed, callers do not destroy it
+    VkShaderModule shaderModule(const std::string& spv);
+    // compute shader that accesses hdr scene format images, ./shaders/name.comp.spv or, without
+    // storageWithoutFormat, its build with -DSCENE_RGBA16F in ./shaders/name_rgba16f.comp.spv
+    VkShaderModule hdrShaderModule(const std::string& name);
     const VkDescriptorPool& descriptorPool() const;
 
     VkSampler samplerAnisoRepeat() const;
     VkSampler samplerAnisoClamp() const;
     VkSampler samplerLinearRepeat() const;
     VkSampler samplerLinearClamp() const;
+    VkSampler samplerLinearRepeatBaseLevel() const;
 
     VkQueryPool queryPools(size_t index);
     float timestampPeriod() const;
@@ -48,15 +88,32 @@ class Device
     VkPhysicalDevice physicalDevice_{};
     VkDevice device_{};
 
+    static constexpr const char* PIPELINE_CACHE_FILE{"pipeline_cache.bin"};
+
     VkPipelineCache cache_{};
+    bool pipelineCacheWarm_{};
+    uint32_t pipelineCount_{};
+    float pipelineCreationMs_{};
+    std::mutex pipelineMutex_;
+    std::vector<std::future<void>> pipelineJobs_;
+    std::chrono::steady_clock::time_point pipelineStart_{};
+    std::unordered_map<std::string, VkShaderModule> shaderModules_;
     VkFormat depthStencilFmt_{};
-    std::array<VkSampler, 4> samplers_{};
+    bool textureCompressionBC_{};
+    bool geometryShader_{};
+    std::array<VkSampler, 5> samplers_{};
 
     uint32_t queueFaimlyIdx_{uint32_t(-1)};
     VkQueue queue_{};
+    uint32_t computeFamilyIdx_{uint32_t(-1)};
+    std::vector<uint32_t> queueFamilies_;
+    VkQueue computeQueue_{};
 
     VkCommandPool cmdPool_{};
     std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT> cmdBuffers_{};
+    std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT> lateCmdBuffers_{};
+    VkCommandPool computeCmdPool_{};
+    std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT> computeCmdBuffers_{};
     VkDescriptorPool descPool_{};
 
     std::array<VkQueryPool, MAX_FRAMES_IN_FLIGHT> queryPools_;
@@ -69,6 +126,8 @@ class Device
     void selectPhysicalDevice();
     void createDevice();
     void createPipelineCache();
+    std::vector<char> readPipelineCache() const;
+    void savePipelineCache() const;
 
     void createCommandPool();
     void createDescriptorPool();
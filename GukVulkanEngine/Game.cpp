@@ -3,33 +3,144 @@
 #include "Model.h"
 
 #include <imgui.h>
+#include <algorithm>
 #include <chrono>
+#include <random>
 
 namespace guk {
 
+// anti-aliasing modes offered in the gui, post anti-aliasing runs on the single sample scene
+struct AntiAliasingMode
+{
+    const char* name;
+    AntiAliasing scene;
+    PostAntiAliasing post;
+};
+
+static constexpr std::array<AntiAliasingMode, 7> ANTI_ALIASING_MODES{{
+    {"MSAA 1x", AntiAliasing::Msaa1, PostAntiAliasing::None},
+    {"MSAA 2x", AntiAliasing::Msaa2, PostAntiAliasing::None},
+    {"MSAA 4x", AntiAliasing::Msaa4, PostAntiAliasing::None},
+    {"MSAA 8x", AntiAliasing::Msaa8, PostAntiAliasing::None},
+    {"TAA", AntiAliasing::Taa, PostAntiAliasing::None},
+    {"FXAA", AntiAliasing::Msaa1, PostAntiAliasing::Fxaa},
+    {"SMAA 1x", AntiAliasing::Msaa1, PostAntiAliasing::Smaa},
+}};
+
+// passes whose gpu time depends on the anti-aliasing mode
+static bool antiAliasingPass(const std::string& name)
+{
+    return name == "main" || name == "depthPrepass" || name == "taa" || name == "fxaa" ||
+           name.starts_with("smaa") || name == "visibility" || name.starts_with("material") ||
+           name == "skybox";
+}
+
+// formats of the hdr scene color and bloom chain offered in the gui
+struct HdrFormat
+{
+    const char* name;
+    VkFormat format;
+};
+
+static constexpr std::array<HdrFormat, 3> HDR_FORMATS{{
+    {"RGBA16F (8 B/px)", VK_FORMAT_R16G16B16A16_SFLOAT},
+    {"B10G11R11 (4 B/px)", VK_FORMAT_B10G11R11_UFLOAT_PACK32},
+    {"E5B9G9R9 (4 B/px)", VK_FORMAT_E5B9G9R9_UFLOAT_PACK32},
+}};
+
+// the scene is rendered, filtered and resolved into, and the bloom chain is read and written
+// from compute without a format qualifier. rgba16f falls back to shaders built with an explicit
+// qualifier instead, see Device::hdrShaderModule
+static constexpr VkFormatFeatureFlags2 HDR_FORMAT_FEATURES =
+    VK_FORMAT_FEATURE_2_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_2_SAMPLED_IMAGE_BIT |
+    VK_FORMAT_FEATURE_2_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_2_STORAGE_IMAGE_BIT |
+    VK_FORMAT_FEATURE_2_STORAGE_READ_WITHOUT_FORMAT_BIT |
+    VK_FORMAT_FEATURE_2_STORAGE_WRITE_WITHOUT_FORMAT_BIT;
+
+// passes whose gpu time depends on the hdr format, all but shadow and gui
+static bool hdrPass(const std::string& name)
+{
+    return name != "shadow" && name != "gui";
+}
+
+static VkSemaphoreSubmitInfo semaphoreSubmitInfo(VkSemaphore semaphore,
+                                                 VkPipelineStageFlags2 stageMask,
+                                                 uint64_t value = 0)
+{
+    VkSemaphoreSubmitInfo semaphoreSI{};
+    semaphoreSI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    semaphoreSI.semaphore = semaphore;
+    semaphoreSI.stageMask = stageMask;
+    semaphoreSI.value = value;
+    semaphoreSI.deviceIndex = 0;
+
+    return semaphoreSI;
+}
+
+static void queueSubmit(VkQueue queue, VkCommandBuffer cmd,
+                        const std::vector<VkSemaphoreSubmitInfo>& waits,
+                        const std::vector<VkSemaphoreSubmitInfo>& signals,
+                        VkFence fence = VK_NULL_HANDLE)
+{
+    VkCommandBufferSubmitInfo cmdBufferSI{};
+    cmdBufferSI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    cmdBufferSI.commandBuffer = cmd;
+    cmdBufferSI.deviceMask = 0;
+
+    VkSubmitInfo2 si{};
+    si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    si.waitSemaphoreInfoCount = static_cast<uint32_t>(waits.size());
+    si.pWaitSemaphoreInfos = waits.data();
+    si.commandBufferInfoCount = 1;
+    si.pCommandBufferInfos = &cmdBufferSI;
+    si.signalSemaphoreInfoCount = static_cast<uint32_t>(signals.size());
+    si.pSignalSemaphoreInfos = signals.data();
+
+    VK_CHECK(vkQueueSubmit2(queue, 1, &si, fence));
+}
+
 Game::Game()
     : window_(std::make_unique<Window>()),
       device_(std::make_shared<Device>(window_->getRequiredExts())),
       swapchain_(std::make_unique<Swapchain>(window_, device_)),
-      renderer_(std::make_unique<Renderer>(device_, swapchain_->width(), swapchain_->height())),
+      renderGraph_(std::make_shared<RenderGraph>(device_)),
+      threadPool_(std::make_shared<ThreadPool>()),
+      assetRegistry_(std::make_shared<AssetRegistry>()),
+      textureStreamer_(std::make_shared<TextureStreamer>(
+          device_, static_cast<VkDeviceSize>(TEXTURE_BUDGET_MB) * 1024 * 1024)),
+      renderer_(std::make_unique<Renderer>(device_, renderGraph_, textureStreamer_,
+                                           swapchain_->width(), swapchain_->height())),
       rendererPost_(std::make_unique<RendererPost>(
-          device_, swapchain_->format(), swapchain_->width(), swapchain_->height(),
-          renderer_->colorAttachment(), renderer_->shadowAttachment())),
+          device_, renderGraph_, swapchain_->format(), swapchain_->storage(), swapchain_->width(),
+          swapchain_->height(), renderer_->colorAttachment(), renderer_->shadowAttachment())),
       rendererGui_(std::make_unique<RendererGui>(device_, swapchain_->format()))
 {
+    // renderers queue their pipelines on worker threads while the rest of them is built
+    float pipelineWallMs = device_->waitPipelines();
+    log("{} pipelines created in {:.1f} ms wall, {:.1f} ms summed ({} pipeline cache)",
+        device_->pipelineCount(), pipelineWallMs, device_->pipelineCreationMs(),
+        device_->pipelineCacheWarm() ? "warm" : "cold");
+
     setCallBack();
     createSyncObjects();
+    assetRegistry_->setEvictionHook([](const std::string& name) { log("evicted {}", name); });
     createModels();
-    renderer_->allocateModelDescriptorSets(models_);
 }
 
 Game::~Game()
 {
+    if (loadingBenchmark_.valid()) {
+        loadingBenchmark_.wait();
+    }
+
     for (size_t i = 0; i < swapchain_->size(); i++) {
         vkDestroySemaphore(device_->get(), drawSemaphores_[i], nullptr);
         vkDestroySemaphore(device_->get(), prsntSemaphores_[i], nullptr);
     }
 
+    vkDestroySemaphore(device_->get(), graphicsTimeline_, nullptr);
+    vkDestroySemaphore(device_->get(), computeTimeline_, nullptr);
+
     for (const auto& fence : fences_) {
         vkDestroyFence(device_->get(), fence, nullptr);
     }
@@ -41,6 +152,8 @@ void Game::run()
 
     while (!window_->shouldClose()) {
         window_->pollEvents();
+        updateModelLoads();
+        updateTextureStreaming();
 
         auto currentTime = std::chrono::high_resolution_clock::now();
         float deltaTime =
@@ -53,8 +166,15 @@ void Game::run()
         updateGui();
 
         camera_.update(deltaTime);
+        if (renderer_->antiAliasing() == AntiAliasing::Taa) {
+            VkExtent2D renderExtent = renderer_->renderExtent();
+            camera_.jitter(postUniform_.frame, renderExtent.width, renderExtent.height);
+        } else {
+            camera_.resetJitter();
+        }
         camera_.writeScene(sceneUniform_);
         calculateDirectionalLight();
+        updateLights(deltaTime);
 
         drawFrame();
     }
@@ -190,17 +310,87 @@ void Game::createSyncObjects()
         VK_CHECK(vkCreateSemaphore(device_->get(), &semaphoreInfo, nullptr, &drawSemaphores_[i]));
         VK_CHECK(vkCreateSemaphore(device_->get(), &semaphoreInfo, nullptr, &prsntSemaphores_[i]));
     }
+
+    if (!device_->asyncCompute()) {
+        return;
+    }
+
+    VkSemaphoreTypeCreateInfo semaphoreTypeInfo{};
+    semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeInfo.initialValue = 0;
+    semaphoreInfo.pNext = &semaphoreTypeInfo;
+
+    VK_CHECK(vkCreateSemaphore(device_->get(), &semaphoreInfo, nullptr, &graphicsTimeline_));
+    VK_CHECK(vkCreateSemaphore(device_->get(), &semaphoreInfo, nullptr, &computeTimeline_));
+    renderGraph_->setAsyncCompute(true);
 }
 
 void Game::createModels()
 {
-    models_.push_back(Model::load(device_, "assets\\DamagedHelmet\\glTF-"
-                                           "Binary\\DamagedHelmet.glb")
-                          .setRotation(glm::vec3(180.f, 0.f, 0.f)));
+    modelLoads_.push_back(
+        Model::loadAsync(device_, threadPool_, assetRegistry_, textureStreamer_,
+                         "assets\\DamagedHelmet\\glTF-Binary\\DamagedHelmet.glb"));
+    modelLoads_.back()->model().setRotation(glm::vec3(180.f, 0.f, 0.f));
+
+    loadSponza();
+}
+
+void Game::loadSponza()
+{
+    modelLoads_.push_back(Model::loadAsync(device_, threadPool_, assetRegistry_, textureStreamer_,
+                                           "assets\\Sponza\\glTF\\Sponza.gltf", sponzaImport_));
+    modelLoads_.back()->model().setTranslation(glm::vec3(0.f, -1.f, 0.f));
+    modelLoads_.back()->model().setRotation(glm::vec3(0.f, 90.f, 0.f));
+}
+
+void Game::updateModelLoads()
+{
+    if (modelLoads_.empty()) {
+        return;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<float, std::milli>(MODEL_UPLOAD_BUDGET_MS));
+    float elapsed =
+        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime_)
+            .count();
+
+    for (auto& load : modelLoads_) {
+        bool geometryReady = load->geometryReady();
+        bool texturesUploaded = load->upload(deadline);
+        Model& model = load->model();
+
+        if (!geometryReady && load->geometryReady()) {
+            // new descriptor sets are not in use yet, textures still missing read the dummy
+            renderer_->allocateModelDescriptorSets(model);
+            models_.push_back(model);
+            log("{}: geometry ready at {:.1f} ms", model.name(), elapsed);
+        } else if (texturesUploaded) {
+            // models_ shares the descriptor sets, frames in flight may still read them.
+            // textures are shared through the registry, other models may be waiting on them too
+            VK_CHECK(vkQueueWaitIdle(device_->queue()));
+            for (auto& m : models_) {
+                m.updateMaterialDescriptorSets();
+            }
+        }
 
-    models_.push_back(Model::load(device_, "assets\\Sponza\\glTF\\Sponza.gltf")
-                          .setTranslation(glm::vec3(0.f, -1.f, 0.f))
-                          .setRotation(glm::vec3(0.f, 90.f, 0.f)));
+        if (load->texturesReady()) {
+            log("{}: textures ready at {:.1f} ms", model.name(), elapsed);
+        }
+    }
+
+    std::erase_if(modelLoads_, [](const auto& load) { return load->texturesReady(); });
+}
+
+void Game::updateTextureStreaming()
+{
+    // feedback of the last recorded frame, each frame takes the new images in drawFrame once the
+    // last use of its material sets finished
+    if (textureStreamer_->update()) {
+        materialSetsStale_.fill(true);
+    }
 }
 
 void Game::recreateSwapChain()
@@ -237,6 +427,205 @@ void Game::calculatePerformanceMetrics(float deltaTime)
     }
 }
 
+void Game::updateRenderScale(float gpuMs)
+{
+    smoothedGpuMs_ = smoothedGpuMs_ > 0.f ? glm::mix(smoothedGpuMs_, gpuMs, 0.1f) : gpuMs;
+    if (!dynamicResolution_ || smoothedGpuMs_ <= 0.f) {
+        return;
+    }
+
+    // gpu time follows the pixel count, the square of the scale
+    float scale = renderer_->renderScale();
+    float wanted = scale * std::sqrt(targetFrameMs_ / smoothedGpuMs_);
+
+    // small errors are left alone so the image does not keep changing size
+    if (std::abs(wanted - scale) < RENDER_SCALE_STEP * 0.5f) {
+        return;
+    }
+    scale += glm::clamp(wanted - scale, -RENDER_SCALE_STEP, RENDER_SCALE_STEP);
+    renderer_->setRenderScale(glm::clamp(scale, minRenderScale_, maxRenderScale_));
+}
+
+uint32_t Game::antiAliasingMode() const
+{
+    for (uint32_t i = 0; i < ANTI_ALIASING_MODES.size(); i++) {
+        if (ANTI_ALIASING_MODES[i].scene == renderer_->antiAliasing() &&
+            ANTI_ALIASING_MODES[i].post == rendererPost_->postAntiAliasing()) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+bool Game::antiAliasingSupported(uint32_t mode) const
+{
+    AntiAliasing scene = ANTI_ALIASING_MODES[mode].scene;
+    return scene == AntiAliasing::Taa ||
+           device_->sampleCounts() & static_cast<VkSampleCountFlags>(scene);
+}
+
+void Game::setAntiAliasing(uint32_t mode)
+{
+    const AntiAliasingMode& antiAliasing = ANTI_ALIASING_MODES[mode];
+    if (!antiAliasingSupported(mode)) {
+        log("{} is not supported", antiAliasing.name);
+        return;
+    }
+
+    // scene attachments and pipelines are only rebuilt when the sample count changes
+    VK_CHECK(vkQueueWaitIdle(device_->queue()));
+    if (renderer_->antiAliasing() != antiAliasing.scene) {
+        renderer_->setAntiAliasing(antiAliasing.scene);
+    }
+    rendererPost_->setPostAntiAliasing(antiAliasing.post);
+}
+
+void Game::startAntiAliasingBenchmark()
+{
+    aaBenchmarkRestore_ = antiAliasingMode();
+    aaBenchmarkModes_.clear();
+    for (uint32_t i = 0; i < ANTI_ALIASING_MODES.size(); i++) {
+        if (antiAliasingSupported(i)) {
+            aaBenchmarkModes_.push_back(i);
+        }
+    }
+
+    aaBenchmarkFrames_ = 0;
+    aaBenchmarkMs_ = 0.f;
+    setAntiAliasing(aaBenchmarkModes_.front());
+}
+
+void Game::updateAntiAliasingBenchmark()
+{
+    if (aaBenchmarkModes_.empty()) {
+        return;
+    }
+
+    // timestamps of the frames in flight at the switch belong to the previous mode
+    if (aaBenchmarkFrames_++ >= Device::MAX_FRAMES_IN_FLIGHT) {
+        for (const auto& passTime : renderGraph_->passTimes()) {
+            if (antiAliasingPass(passTime.name)) {
+                aaBenchmarkMs_ += passTime.ms;
+            }
+        }
+    }
+    if (aaBenchmarkFrames_ < AA_BENCHMARK_FRAMES + Device::MAX_FRAMES_IN_FLIGHT) {
+        return;
+    }
+
+    VkExtent2D renderExtent = renderer_->renderExtent();
+    log("{}: {:.3f} ms scene gpu, {:.1f} MB scene attachments at {}x{}",
+        ANTI_ALIASING_MODES[antiAliasingMode()].name, aaBenchmarkMs_ / AA_BENCHMARK_FRAMES,
+        (renderer_->attachmentMemory() + rendererPost_->antiAliasingMemory()) / 1048576.0,
+        renderExtent.width, renderExtent.height);
+
+    aaBenchmarkModes_.erase(aaBenchmarkModes_.begin());
+    aaBenchmarkFrames_ = 0;
+    aaBenchmarkMs_ = 0.f;
+    setAntiAliasing(aaBenchmarkModes_.empty() ? aaBenchmarkRestore_ : aaBenchmarkModes_.front());
+}
+
+uint32_t Game::hdrFormat() const
+{
+    for (uint32_t i = 0; i < HDR_FORMATS.size(); i++) {
+        if (HDR_FORMATS[i].format == renderer_->sceneFormat()) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+bool Game::hdrFormatSupported(uint32_t format) const
+{
+    // the other formats share the hdr shaders of rgba16f, which only go without a qualifier when
+    // rgba16f allows it
+    return format == 0 ||
+           (device_->storageWithoutFormat() &&
+            device_->formatSupported(HDR_FORMATS[format].format, HDR_FORMAT_FEATURES));
+}
+
+void Game::setHdrFormat(uint32_t format)
+{
+    if (!hdrFormatSupported(format)) {
+        log("{} is not supported", HDR_FORMATS[format].name);
+        return;
+    }
+
+    VK_CHECK(vkQueueWaitIdle(device_->queue()));
+    renderer_->setSceneFormat(HDR_FORMATS[format].format);
+    rendererPost_->sceneFormatChanged();
+}
+
+VkDeviceSize Game::hdrMemory() const
+{
+    return renderer_->attachmentMemory() + rendererPost_->antiAliasingMemory() +
+           rendererPost_->bloomMemory();
+}
+
+void Game::startHdrFormatBenchmark()
+{
+    hdrBenchmarkRestore_ = hdrFormat();
+    hdrBenchmarkFormats_.clear();
+    for (uint32_t i = 0; i < HDR_FORMATS.size(); i++) {
+        if (hdrFormatSupported(i)) {
+            hdrBenchmarkFormats_.push_back(i);
+        }
+    }
+
+    hdrBenchmarkFrames_ = 0;
+    hdrBenchmarkMs_ = 0.f;
+    setHdrFormat(hdrBenchmarkFormats_.front());
+}
+
+void Game::updateHdrFormatBenchmark()
+{
+    if (hdrBenchmarkFormats_.empty()) {
+        return;
+    }
+
+    // timestamps of the frames in flight at the switch belong to the previous format
+    if (hdrBenchmarkFrames_++ >= Device::MAX_FRAMES_IN_FLIGHT) {
+        for (const auto& passTime : renderGraph_->passTimes()) {
+            if (hdrPass(passTime.name)) {
+                hdrBenchmarkMs_ += passTime.ms;
+            }
+        }
+    }
+    if (hdrBenchmarkFrames_ < AA_BENCHMARK_FRAMES + Device::MAX_FRAMES_IN_FLIGHT) {
+        return;
+    }
+
+    VkExtent2D renderExtent = renderer_->renderExtent();
+    log("{}: {:.3f} ms main and post gpu, {:.1f} MB scene and bloom images at {}x{} ({})",
+        HDR_FORMATS[hdrFormat()].name, hdrBenchmarkMs_ / AA_BENCHMARK_FRAMES,
+        hdrMemory() / 1048576.0, renderExtent.width, renderExtent.height,
+        ANTI_ALIASING_MODES[antiAliasingMode()].name);
+
+    hdrBenchmarkFormats_.erase(hdrBenchmarkFormats_.begin());
+    hdrBenchmarkFrames_ = 0;
+    hdrBenchmarkMs_ = 0.f;
+    setHdrFormat(hdrBenchmarkFormats_.empty() ? hdrBenchmarkRestore_
+                                              : hdrBenchmarkFormats_.front());
+}
+
+void Game::startLoadingBenchmark(std::vector<std::string> (*benchmark)(std::shared_ptr<Device>,
+                                                                      const std::string&))
+{
+    loadingBenchmarkResults_.clear();
+    // the gui reads the results only after the future is ready
+    loadingBenchmark_ = threadPool_->submit([this, benchmark, device = device_]() {
+        loadingBenchmarkResults_ = benchmark(device, "assets\\Sponza\\glTF\\Sponza.gltf");
+    });
+}
+
+bool Game::loadingBenchmarkRunning() const
+{
+    return loadingBenchmark_.valid() &&
+           loadingBenchmark_.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
 void Game::updateGui()
 {
     ImGuiIO& io = ImGui::GetIO();
@@ -288,6 +677,206 @@ void Game::updateGui()
             ImGui::SameLine();
             ImGui::Text("GPU FPS: %.1f (%.2f ms/frame)", currentGpuFps_,
                         1e3f / std::max(currentGpuFps_, 1.0f));
+
+            float bloomMs{};
+            for (const auto& passTime : renderGraph_->passTimes()) {
+                ImGui::Text("  %s: %.3f ms", passTime.name.c_str(), passTime.ms);
+                if (passTime.name.starts_with("bloom")) {
+                    bloomMs += passTime.ms;
+                }
+            }
+            ImGui::Text("Bloom GPU: %.3f ms at %ux%u", bloomMs, swapchain_->width(),
+                        swapchain_->height());
+
+            // bloom and post of a frame overlap the shadow pass of the next one
+            bool asyncCompute = renderGraph_->asyncCompute();
+            ImGui::BeginDisabled(!device_->asyncCompute());
+            if (ImGui::Checkbox("Async Compute", &asyncCompute)) {
+                VK_CHECK(vkDeviceWaitIdle(device_->get()));
+                renderGraph_->setAsyncCompute(asyncCompute);
+            }
+            ImGui::EndDisabled();
+            drawGpuTimeline();
+        }
+
+        // Dynamic Resolution Controls
+        if (ImGui::CollapsingHeader("Dynamic Resolution Controls",
+                                    ImGuiTreeNodeFlags_DefaultOpen)) {
+            ImGui::Checkbox("Dynamic Resolution", &dynamicResolution_);
+            if (dynamicResolution_) {
+                ImGui::SliderFloat("Target GPU Time", &targetFrameMs_, 4.0f, 33.3f, "%.1f ms");
+                ImGui::SliderFloat("Min Render Scale", &minRenderScale_, 0.25f, 1.0f, "%.2f");
+                ImGui::SliderFloat("Max Render Scale", &maxRenderScale_, 0.25f, 1.0f, "%.2f");
+                maxRenderScale_ = std::max(maxRenderScale_, minRenderScale_);
+            } else {
+                float renderScale = renderer_->renderScale();
+                if (ImGui::SliderFloat("Render Scale", &renderScale, 0.25f, 1.0f, "%.2f")) {
+                    renderer_->setRenderScale(renderScale);
+                }
+            }
+
+            VkExtent2D renderExtent = renderer_->renderExtent();
+            ImGui::Text("Render Resolution: %ux%u (%.0f%%)", renderExtent.width,
+                        renderExtent.height, renderer_->renderScale() * 100.f);
+            ImGui::Text("Smoothed GPU Time: %.2f ms", smoothedGpuMs_);
+        }
+
+        // Anti-Aliasing Controls
+        if (ImGui::CollapsingHeader("Anti-Aliasing Controls", ImGuiTreeNodeFlags_DefaultOpen)) {
+            uint32_t mode = antiAliasingMode();
+            if (ImGui::BeginCombo("Anti-Aliasing", ANTI_ALIASING_MODES[mode].name)) {
+                for (uint32_t i = 0; i < ANTI_ALIASING_MODES.size(); i++) {
+                    ImGui::BeginDisabled(!antiAliasingSupported(i));
+                    if (ImGui::Selectable(ANTI_ALIASING_MODES[i].name, i == mode) && i != mode) {
+                        setAntiAliasing(i);
+                    }
+                    ImGui::EndDisabled();
+                }
+                ImGui::EndCombo();
+            }
+
+            float sceneMs{};
+            for (const auto& passTime : renderGraph_->passTimes()) {
+                if (antiAliasingPass(passTime.name)) {
+                    sceneMs += passTime.ms;
+                }
+            }
+            VkDeviceSize memory =
+                renderer_->attachmentMemory() + rendererPost_->antiAliasingMemory();
+            ImGui::Text("Scene GPU: %.3f ms, attachments %.1f MB", sceneMs, memory / 1048576.0);
+
+            // results go to the log
+            ImGui::BeginDisabled(!aaBenchmarkModes_.empty() || !hdrBenchmarkFormats_.empty());
+            if (ImGui::Button("Benchmark Anti-Aliasing Modes")) {
+                startAntiAliasingBenchmark();
+            }
+            ImGui::EndDisabled();
+        }
+
+        // HDR Format Controls
+        if (ImGui::CollapsingHeader("HDR Format Controls", ImGuiTreeNodeFlags_DefaultOpen)) {
+            uint32_t format = hdrFormat();
+            if (ImGui::BeginCombo("Scene/Bloom Format", HDR_FORMATS[format].name)) {
+                for (uint32_t i = 0; i < HDR_FORMATS.size(); i++) {
+                    ImGui::BeginDisabled(!hdrFormatSupported(i));
+                    if (ImGui::Selectable(HDR_FORMATS[i].name, i == format) && i != format) {
+                        setHdrFormat(i);
+                    }
+                    ImGui::EndDisabled();
+                }
+                ImGui::EndCombo();
+            }
+
+            float hdrMs{};
+            for (const auto& passTime : renderGraph_->passTimes()) {
+                if (hdrPass(passTime.name)) {
+                    hdrMs += passTime.ms;
+                }
+            }
+            ImGui::Text("Main+Post GPU: %.3f ms, images %.1f MB", hdrMs, hdrMemory() / 1048576.0);
+
+            // results go to the log
+            ImGui::BeginDisabled(!aaBenchmarkModes_.empty() || !hdrBenchmarkFormats_.empty());
+            if (ImGui::Button("Benchmark HDR Formats")) {
+                startHdrFormatBenchmark();
+            }
+            ImGui::EndDisabled();
+        }
+
+        // Depth Pre-Pass Controls
+        if (ImGui::CollapsingHeader("Depth Pre-Pass Controls", ImGuiTreeNodeFlags_DefaultOpen)) {
+            ImGui::Checkbox("Depth Pre-Pass", &renderer_->depthPrepass());
+
+            // the pass list tells which mode the timings belong to, the toggle lags a frame
+            float mainMs{};
+            float prepassMs{};
+            bool prepass{};
+            for (const auto& passTime : renderGraph_->passTimes()) {
+                if (passTime.name == "main") {
+                    mainMs = passTime.ms;
+                } else if (passTime.name == "depthPrepass") {
+                    prepassMs = passTime.ms;
+                    prepass = true;
+                }
+            }
+            (prepass ? prepassMainMs_ : mainMs_) = mainMs + prepassMs;
+            if (prepass) {
+                ImGui::Text("Pre-Pass GPU: %.3f ms, Main GPU: %.3f ms", prepassMs, mainMs);
+            }
+            ImGui::Text("Main GPU without: %.3f ms, with pre-pass: %.3f ms", mainMs_,
+                        prepassMainMs_);
+        }
+
+        // Visibility Buffer Controls
+        if (ImGui::CollapsingHeader("Visibility Buffer Controls",
+                                    ImGuiTreeNodeFlags_DefaultOpen)) {
+            // overrides the depth pre-pass, there is no shading in the visibility pass to save
+            ImGui::BeginDisabled(!renderer_->visibilityBufferSupported());
+            ImGui::Checkbox("Visibility Buffer", &renderer_->visibilityBuffer());
+            ImGui::EndDisabled();
+            if (!renderer_->visibilityBufferSupported()) {
+                ImGui::Text("Needs a single sample scene without TAA");
+            }
+
+            float visibilityMs{};
+            float classifyMs{};
+            float resolveMs{};
+            bool visibility{};
+            for (const auto& passTime : renderGraph_->passTimes()) {
+                if (passTime.name == "visibility") {
+                    visibilityMs = passTime.ms;
+                    visibility = true;
+                } else if (passTime.name == "materialClassify") {
+                    classifyMs = passTime.ms;
+                } else if (passTime.name == "materialResolve") {
+                    resolveMs = passTime.ms;
+                }
+            }
+            if (visibility) {
+                ImGui::Text("Visibility GPU: %.3f ms, Classify: %.3f ms, Resolve: %.3f ms",
+                            visibilityMs, classifyMs, resolveMs);
+            } else if (renderer_->visibilityBuffer() && renderer_->visibilityBufferSupported()) {
+                ImGui::Text("Forward, over %u meshes or %u materials in view",
+                            Renderer::MAX_VISIBILITY_DRAWS, Renderer::MAX_VISIBILITY_MATERIALS);
+            }
+        }
+
+        // Material Permutation Controls
+        if (ImGui::CollapsingHeader("Material Permutation Controls",
+                                    ImGuiTreeNodeFlags_DefaultOpen)) {
+            int shadowFilter = static_cast<int>(renderer_->shadowFilter());
+            if (ImGui::Combo("Shadow Filter", &shadowFilter, "Hard\0PCF 3x3\0PCF 5x5\0")) {
+                renderer_->shadowFilter() = static_cast<ShadowFilter>(shadowFilter);
+            }
+            ImGui::Text("Permutations Drawn: %u, Pipelines Cached: %u",
+                        renderer_->drawnPermutations_, renderer_->cachedPermutations());
+        }
+
+        // Clustered Lighting Controls
+        if (ImGui::CollapsingHeader("Clustered Lighting Controls",
+                                    ImGuiTreeNodeFlags_DefaultOpen)) {
+            int lightCount = static_cast<int>(lights_.size());
+            if (ImGui::SliderInt("Point/Spot Lights", &lightCount, 0, Renderer::MAX_LIGHTS)) {
+                createLights(static_cast<uint32_t>(lightCount));
+            }
+            if (ImGui::Button("Stress Scene (1024 Lights)")) {
+                createLights(STRESS_LIGHTS);
+            }
+            ImGui::Checkbox("Animate Lights", &animateLights_);
+
+            float clusterMs{};
+            float mainMs{};
+            for (const auto& passTime : renderGraph_->passTimes()) {
+                if (passTime.name == "lightCluster") {
+                    clusterMs = passTime.ms;
+                } else if (passTime.name == "main") {
+                    mainMs = passTime.ms;
+                }
+            }
+            ImGui::Text("Light Binning GPU: %.3f ms, Main GPU: %.3f ms", clusterMs, mainMs);
+            ImGui::Text("Clusters: %ux%ux%u, up to %u lights each", Renderer::CLUSTER_GRID[0],
+                        Renderer::CLUSTER_GRID[1], Renderer::CLUSTER_GRID[2],
+                        Renderer::MAX_CLUSTER_LIGHTS);
         }
 
         // Meshes Rendering Metrics
@@ -350,9 +939,33 @@ void Game::updateGui()
         // Post Processing Controls
         if (ImGui::CollapsingHeader("Post Processing Controls", ImGuiTreeNodeFlags_DefaultOpen)) {
             ImGui::SliderFloat("Bloom Strength", &postUniform_.bloomStrength, 0.0f, 1.0f, "%.2f");
+            ImGui::Checkbox("Compute Bloom", &rendererPost_->computeBloom());
+            int bloomLevels = static_cast<int>(rendererPost_->bloomLevels());
+            if (ImGui::SliderInt("Bloom Levels", &bloomLevels, 2,
+                                 static_cast<int>(RendererPost::MAX_BLOOM_LEVELS))) {
+                VK_CHECK(vkQueueWaitIdle(device_->queue()));
+                rendererPost_->setBloomLevels(static_cast<uint32_t>(bloomLevels));
+            }
             ImGui::SliderFloat("Exposure", &postUniform_.exposure, 0.1f, 5.0f, "%.2f");
             ImGui::SliderFloat("Gamma", &postUniform_.gamma, 1.0f / 2.2f, 2.2f, "%.2f");
 
+            // the fused pass needs a swapchain that can be written from compute
+            if (rendererPost_->storageTarget()) {
+                ImGui::Checkbox("Fused Compute Post", &rendererPost_->fusedPost());
+            }
+            if (rendererPost_->storageTarget() && rendererPost_->fusedPost()) {
+                int tonemapper = static_cast<int>(rendererPost_->tonemapper());
+                if (ImGui::Combo("Tonemapper", &tonemapper, "Reinhard\0ACES\0AgX\0")) {
+                    rendererPost_->tonemapper() = static_cast<Tonemapper>(tonemapper);
+                }
+                ImGui::SliderFloat("Vignette", &postUniform_.vignette, 0.0f, 1.0f, "%.2f");
+                ImGui::SliderFloat("Grain", &postUniform_.grain, 0.0f, 0.1f, "%.3f");
+                bool dither = postUniform_.dither != 0;
+                if (ImGui::Checkbox("Dither", &dither)) {
+                    postUniform_.dither = dither ? 1 : 0;
+                }
+            }
+
             bool shadowDepthView = postUniform_.shadowDepthView != 0;
             if (ImGui::Checkbox("Shadow Depth View", &shadowDepthView)) {
                 postUniform_.shadowDepthView = shadowDepthView ? 1 : 0;
@@ -363,6 +976,45 @@ void Game::updateGui()
 
         // Models Controls
         if (ImGui::CollapsingHeader("Models Controls", ImGuiTreeNodeFlags_DefaultOpen)) {
+            if (ImGui::Checkbox("Texture Mipmaps", &textureMipmaps_)) {
+                VK_CHECK(vkQueueWaitIdle(device_->queue()));
+                for (auto& model : models_) {
+                    model.setTextureSampler(textureMipmaps_
+                                                ? device_->samplerLinearRepeat()
+                                                : device_->samplerLinearRepeatBaseLevel());
+                }
+            }
+
+            // compare draw calls and cpu frame time in the metrics after a reload
+            ImGui::Checkbox("Merge Sponza Meshes", &sponzaImport_.mergeMeshes);
+            int mergeDepth = static_cast<int>(sponzaImport_.mergeDepth);
+            if (ImGui::SliderInt("Merge Octree Depth", &mergeDepth, 0, 4)) {
+                sponzaImport_.mergeDepth = static_cast<uint32_t>(mergeDepth);
+            }
+            if (ImGui::TreeNode("Sponza Import Optimizations")) {
+                ImGui::Checkbox("Join Identical Vertices", &sponzaImport_.joinIdenticalVertices);
+                ImGui::Checkbox("Remove Degenerates", &sponzaImport_.removeDegenerates);
+                ImGui::Checkbox("Improve Cache Locality", &sponzaImport_.improveCacheLocality);
+                ImGui::Checkbox("Split Large Meshes", &sponzaImport_.splitLargeMeshes);
+                ImGui::Checkbox("Sort By Primitive Type", &sponzaImport_.sortByPrimitiveType);
+                ImGui::TreePop();
+            }
+            // the released and kept cpu geometry is logged once the meshes are uploaded
+            int residency = static_cast<int>(sponzaImport_.residency);
+            if (ImGui::Combo("Sponza CPU Geometry", &residency, "None\0Positions\0Full\0")) {
+                sponzaImport_.residency = static_cast<GeometryResidency>(residency);
+            }
+            if (ImGui::Button("Reload Sponza") && modelLoads_.empty()) {
+                VK_CHECK(vkQueueWaitIdle(device_->queue()));
+                for (auto& m : models_) {
+                    if (m.name() == "Sponza") {
+                        m.freeMaterialDescriptorSets();
+                    }
+                }
+                std::erase_if(models_, [](const Model& m) { return m.name() == "Sponza"; });
+                loadSponza();
+            }
+
             for (uint32_t i = 0; i < models_.size(); i++) {
                 auto& m = models_[i];
 
@@ -388,14 +1040,123 @@ void Game::updateGui()
                 }
             }
         }
+
+        // Asset Registry
+        if (ImGui::CollapsingHeader("Asset Registry")) {
+            ImGui::Text("Textures: %u", assetRegistry_->textureCount());
+            ImGui::Text("Models: %u", assetRegistry_->modelCount());
+
+            if (ImGui::Button("Load Helmet")) {
+                modelLoads_.push_back(
+                    Model::loadAsync(device_, threadPool_, assetRegistry_, textureStreamer_,
+                                     "assets\\DamagedHelmet\\glTF-Binary\\DamagedHelmet.glb"));
+                modelLoads_.back()->model().setRotation(glm::vec3(180.f, 0.f, 0.f));
+                modelLoads_.back()->model().setTranslation(
+                    glm::vec3(2.5f * static_cast<float>(models_.size()), 0.f, 0.f));
+            }
+
+            ImGui::SameLine();
+            if (ImGui::Button("Unload Last") && modelLoads_.empty() && !models_.empty()) {
+                VK_CHECK(vkQueueWaitIdle(device_->queue()));
+                models_.back().freeMaterialDescriptorSets();
+                models_.pop_back();
+            }
+
+            ImGui::SameLine();
+            if (ImGui::Button("Evict Unused")) {
+                VK_CHECK(vkQueueWaitIdle(device_->queue()));
+                log("evicted {} assets", assetRegistry_->evictUnused());
+            }
+        }
+
+        // Texture Streaming
+        if (ImGui::CollapsingHeader("Texture Streaming")) {
+            ImGui::Text("Textures: %u", textureStreamer_->textureCount());
+            ImGui::Text("Resident: %.1f / %.1f MB (all mips %.1f MB)",
+                        textureStreamer_->residentSize() / 1048576.0,
+                        textureStreamer_->budget() / 1048576.0,
+                        textureStreamer_->fullSize() / 1048576.0);
+            ImGui::Text("Uploads: %u, Evictions: %u", textureStreamer_->uploads(),
+                        textureStreamer_->evictions());
+
+            int budget = static_cast<int>(textureStreamer_->budget() / 1048576);
+            if (ImGui::SliderInt("Budget (MB)", &budget, 16, 2048)) {
+                textureStreamer_->setBudget(static_cast<VkDeviceSize>(budget) * 1048576);
+            }
+        }
+
+        // Loading Benchmarks, run on the thread pool, results go to the log and below
+        if (ImGui::CollapsingHeader("Loading Benchmarks")) {
+            bool running = loadingBenchmarkRunning();
+            // model loads share the thread pool and would skew the timings
+            ImGui::BeginDisabled(running || !modelLoads_.empty());
+            if (ImGui::Button("Texture Decode (Sponza)")) {
+                startLoadingBenchmark(&Model::benchmarkDecode);
+            }
+            if (ImGui::Button("Mesh Import (Sponza)")) {
+                startLoadingBenchmark(&Model::benchmarkImport);
+            }
+            if (ImGui::Button("Mesh Cache Cold/Warm (Sponza)")) {
+                startLoadingBenchmark(&Model::benchmarkMeshCache);
+            }
+            ImGui::EndDisabled();
+            if (running) {
+                ImGui::Text("Running...");
+            } else {
+                for (const auto& result : loadingBenchmarkResults_) {
+                    ImGui::TextUnformatted(result.c_str());
+                }
+            }
+        }
     }
 
     ImGui::End();
     ImGui::Render();
 }
 
+void Game::drawGpuTimeline()
+{
+    // one row per queue, passes are placed by their timestamps in the frame
+    const auto& passTimes = renderGraph_->passTimes();
+    float frameMs{};
+    for (const auto& passTime : passTimes) {
+        frameMs = std::max(frameMs, passTime.start + passTime.ms);
+    }
+    if (frameMs <= 0.f) {
+        return;
+    }
+
+    ImGui::Text("GPU Timeline: %.3f ms (graphics, compute)", frameMs);
+
+    float rowHeight = ImGui::GetTextLineHeight();
+    float width = ImGui::GetContentRegionAvail().x;
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    for (const auto& passTime : passTimes) {
+        float row = passTime.async ? rowHeight + 2.f : 0.f;
+        ImVec2 min(origin.x + passTime.start / frameMs * width, origin.y + row);
+        ImVec2 max(origin.x + (passTime.start + passTime.ms) / frameMs * width,
+                   origin.y + row + rowHeight);
+        max.x = std::max(max.x, min.x + 1.f);
+
+        drawList->AddRectFilled(min, max,
+                                passTime.async ? IM_COL32(230, 150, 60, 255)
+                                               : IM_COL32(80, 150, 230, 255));
+        drawList->AddRect(min, max, IM_COL32(20, 20, 20, 255));
+        if (ImGui::IsMouseHoveringRect(min, max)) {
+            ImGui::SetTooltip("%s: %.3f ms at %.3f ms", passTime.name.c_str(), passTime.ms,
+                              passTime.start);
+        }
+    }
+    ImGui::Dummy(ImVec2(width, rowHeight * 2.f + 2.f));
+}
+
 void Game::calculateDirectionalLight()
 {
+    if (models_.empty()) {
+        return;
+    }
+
     glm::vec3 forward = -sceneUniform_.directionalLightDir;
     glm::vec3 up = glm::vec3(0.f, 0.f, 1.f);
     if (glm::abs(glm::dot(forward, up)) > 0.99f) {
@@ -428,9 +1189,93 @@ void Game::calculateDirectionalLight()
     postUniform_.inverseProj = glm::inverse(lightProj);
 }
 
+void Game::createLights(uint32_t count)
+{
+    glm::vec3 wMin(-10.f);
+    glm::vec3 wMax(10.f);
+    if (!models_.empty()) {
+        wMin = glm::vec3(std::numeric_limits<float>::max());
+        wMax = glm::vec3(std::numeric_limits<float>::lowest());
+        for (const auto& model : models_) {
+            for (const auto& corner : ViewFrustum::corners(model.boundMin(), model.boundMax())) {
+                glm::vec3 wCorner = glm::vec3(model.matrix() * glm::vec4(corner, 1.f));
+                wMin = glm::min(wMin, wCorner);
+                wMax = glm::max(wMax, wCorner);
+            }
+        }
+    }
+    glm::vec3 extent = wMax - wMin;
+    float size = glm::length(extent);
+
+    // seeded by the count, the same scene every time for comparable timings
+    std::mt19937 rng{count};
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+    lights_.resize(count);
+    lightOrigins_.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        Light& light = lights_[i];
+        lightOrigins_[i] = wMin + extent * glm::vec3(unit(rng), unit(rng), unit(rng));
+        light.position = lightOrigins_[i];
+        light.range = size * (0.02f + 0.04f * unit(rng));
+
+        // saturated hue, about as bright as the sun at half the range
+        float hue = unit(rng) * 6.f;
+        glm::vec3 color = glm::clamp(
+            glm::abs(glm::mod(glm::vec3(hue, hue + 4.f, hue + 2.f), 6.f) - 3.f) - 1.f, 0.f, 1.f);
+        light.color = color * light.range * light.range * 0.25f;
+
+        // every fourth light is a spot pointing down
+        if (i % 4 == 3) {
+            light.range *= 2.f;
+            light.color *= 4.f;
+            light.direction = glm::normalize(glm::vec3(unit(rng) - 0.5f, -2.f, unit(rng) - 0.5f));
+            light.spotInnerCos = glm::cos(glm::radians(20.f));
+            light.spotOuterCos = glm::cos(glm::radians(35.f));
+        } else {
+            light.spotInnerCos = -1.f;
+            light.spotOuterCos = -1.f;
+        }
+    }
+
+    log("{} lights in [{:.1f}, {:.1f}, {:.1f}] - [{:.1f}, {:.1f}, {:.1f}]", count, wMin.x,
+        wMin.y, wMin.z, wMax.x, wMax.y, wMax.z);
+}
+
+void Game::updateLights(float deltaTime)
+{
+    if (!animateLights_) {
+        return;
+    }
+
+    lightTime_ += deltaTime;
+    for (size_t i = 0; i < lights_.size(); i++) {
+        float angle = lightTime_ * 0.5f + static_cast<float>(i);
+        float radius = lights_[i].range * 0.5f;
+        lights_[i].position =
+            lightOrigins_[i] + glm::vec3(glm::cos(angle), 0.f, glm::sin(angle)) * radius;
+    }
+}
+
 void Game::drawFrame()
 {
     VK_CHECK(vkWaitForFences(device_->get(), 1, &fences_[frameIdx_], VK_TRUE, UINT64_MAX));
+    if (computeValues_[frameIdx_]) {
+        // the compute command buffer of this frame is reused below
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &computeTimeline_;
+        waitInfo.pValues = &computeValues_[frameIdx_];
+        VK_CHECK(vkWaitSemaphores(device_->get(), &waitInfo, UINT64_MAX));
+    }
+
+    if (materialSetsStale_[frameIdx_]) {
+        for (auto& model : models_) {
+            model.updateMaterialDescriptorSets(frameIdx_);
+        }
+        materialSetsStale_[frameIdx_] = false;
+    }
 
     uint64_t timestamps[2];
     if (queryDataReady_[frameIdx_]) {
@@ -442,9 +1287,13 @@ void Game::drawFrame()
             gpuTimesSinceLastUpdate_ +=
                 static_cast<float>(timeDiff) * device_->timestampPeriod() * 1e-9f;
             gpuFramesSinceLastUpdate_++;
+            updateRenderScale(static_cast<float>(timeDiff) * device_->timestampPeriod() * 1e-6f);
         }
     }
     queryDataReady_[frameIdx_] = true;
+    renderGraph_->readTimestamps(frameIdx_);
+    updateAntiAliasingBenchmark();
+    updateHdrFormatBenchmark();
 
     uint32_t imageIdx{};
     VkResult result =
@@ -457,71 +1306,106 @@ void Game::drawFrame()
         exitLog("failed to acquire swap chain image!");
     }
 
-    renderer_->update(frameIdx_, sceneUniform_, skyboxUniform_);
+    renderer_->update(frameIdx_, sceneUniform_, skyboxUniform_, lights_);
+    postUniform_.frame++;
+    VkExtent2D renderExtent = renderer_->renderExtent();
+    postUniform_.sceneScale =
+        glm::vec2(renderExtent.width, renderExtent.height) /
+        glm::vec2(renderer_->colorAttachment()->width(), renderer_->colorAttachment()->height());
     rendererPost_->update(frameIdx_, postUniform_);
     rendererGui_->update(frameIdx_);
 
-    VK_CHECK(vkResetFences(device_->get(), 1, &fences_[frameIdx_]));
-    VK_CHECK(vkResetCommandBuffer(device_->cmdBuffers(frameIdx_), 0));
-
+    std::shared_ptr<Image2D> swapchainImage = swapchain_->image(imageIdx);
+
+    renderGraph_->reset();
+    renderer_->addPasses(frameIdx_, models_);
+    rendererPost_->addPasses(frameIdx_, swapchainImage);
+    renderGraph_->addPass("gui",
+                          {{swapchainImage.get(), VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                            VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT |
+                                VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}},
+                          [this, swapchainImage](VkCommandBuffer cmd) {
+                              rendererGui_->draw(cmd, frameIdx_, swapchainImage);
+                          });
+    renderGraph_->output({swapchainImage.get(), VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
+                          VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR});
+    renderGraph_->compile();
+
+    // with async compute the frame is split in graphics, compute and late graphics submissions
+    bool async = renderGraph_->asyncCompute();
     VkCommandBuffer cmd = device_->cmdBuffers(frameIdx_);
+    VkCommandBuffer computeCmd = async ? device_->computeCmdBuffers(frameIdx_) : cmd;
+    VkCommandBuffer lateCmd = async ? device_->lateCmdBuffers(frameIdx_) : cmd;
+
+    VK_CHECK(vkResetFences(device_->get(), 1, &fences_[frameIdx_]));
 
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags = 0;
     beginInfo.pInheritanceInfo = nullptr;
-    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+    std::vector<VkCommandBuffer> cmds{cmd};
+    if (async) {
+        cmds.push_back(computeCmd);
+        cmds.push_back(lateCmd);
+    }
+    for (VkCommandBuffer buffer : cmds) {
+        VK_CHECK(vkResetCommandBuffer(buffer, 0));
+        VK_CHECK(vkBeginCommandBuffer(buffer, &beginInfo));
+    }
 
     vkCmdResetQueryPool(cmd, device_->queryPools(frameIdx_), 0, 2);
     vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, device_->queryPools(frameIdx_), 0);
 
-    renderer_->drawShadow(cmd, frameIdx_, models_);
-    renderer_->draw(cmd, frameIdx_, models_);
-
-    swapchain_->image(imageIdx)->transition(cmd, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
-                                            VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
-                                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    SubmissionWaits waits = renderGraph_->execute({cmd, computeCmd, lateCmd}, frameIdx_);
 
-    rendererPost_->draw(cmd, frameIdx_, swapchain_->image(imageIdx));
-    rendererGui_->draw(cmd, frameIdx_, swapchain_->image(imageIdx));
+    vkCmdWriteTimestamp(lateCmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        device_->queryPools(frameIdx_), 1);
 
-    swapchain_->image(imageIdx)->transition(cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
-                                            VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-
-    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, device_->queryPools(frameIdx_),
-                        1);
-
-    VK_CHECK(vkEndCommandBuffer(device_->cmdBuffers(frameIdx_)));
-
-    VkSemaphoreSubmitInfo waitSemaphoreSI{};
-    waitSemaphoreSI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
-    waitSemaphoreSI.semaphore = drawSemaphores_[semaphoreIdx_];
-    waitSemaphoreSI.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
-    waitSemaphoreSI.value = 0;
-    waitSemaphoreSI.deviceIndex = 0;
-
-    VkSemaphoreSubmitInfo signalSemaphoreSI{};
-    signalSemaphoreSI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
-    signalSemaphoreSI.semaphore = prsntSemaphores_[semaphoreIdx_];
-    signalSemaphoreSI.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-    signalSemaphoreSI.value = 0;
-    signalSemaphoreSI.deviceIndex = 0;
+    for (VkCommandBuffer buffer : cmds) {
+        VK_CHECK(vkEndCommandBuffer(buffer));
+    }
 
-    VkCommandBufferSubmitInfo cmdBufferSI{};
-    cmdBufferSI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
-    cmdBufferSI.commandBuffer = device_->cmdBuffers(frameIdx_);
-    cmdBufferSI.deviceMask = 0;
+    VkSemaphoreSubmitInfo acquireSI = semaphoreSubmitInfo(
+        drawSemaphores_[semaphoreIdx_], VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+    VkSemaphoreSubmitInfo presentSI = semaphoreSubmitInfo(prsntSemaphores_[semaphoreIdx_],
+                                                          VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+
+    if (!async) {
+        queueSubmit(device_->queue(), cmd, {acquireSI}, {presentSI}, fences_[frameIdx_]);
+    } else {
+        // graphics waits for the previous compute work only where it reuses its images, the
+        // shadow pass runs next to it
+        uint64_t value = ++timelineValue_;
+        std::vector<VkSemaphoreSubmitInfo> graphicsWaits;
+        std::vector<VkSemaphoreSubmitInfo> computeWaits{semaphoreSubmitInfo(
+            graphicsTimeline_, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, value)};
+        std::vector<VkSemaphoreSubmitInfo> lateWaits{semaphoreSubmitInfo(
+            computeTimeline_, waits.late ? waits.late : VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            value)};
+        if (waits.graphics) {
+            graphicsWaits.push_back(
+                semaphoreSubmitInfo(computeTimeline_, waits.graphics, value - 1));
+        }
 
-    VkSubmitInfo2 si{};
-    si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
-    si.waitSemaphoreInfoCount = 1;
-    si.pWaitSemaphoreInfos = &waitSemaphoreSI;
-    si.commandBufferInfoCount = 1;
-    si.pCommandBufferInfos = &cmdBufferSI;
-    si.signalSemaphoreInfoCount = 1;
-    si.pSignalSemaphoreInfos = &signalSemaphoreSI;
+        if (waits.output == Submission::Compute) {
+            acquireSI.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            computeWaits.push_back(acquireSI);
+        } else if (waits.output == Submission::Late) {
+            lateWaits.push_back(acquireSI);
+        } else {
+            graphicsWaits.push_back(acquireSI);
+        }
 
-    VK_CHECK(vkQueueSubmit2(device_->queue(), 1, &si, fences_[frameIdx_]));
+        queueSubmit(device_->queue(), cmd, graphicsWaits,
+                    {semaphoreSubmitInfo(graphicsTimeline_, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                         value)});
+        queueSubmit(device_->computeQueue(), computeCmd, computeWaits,
+                    {semaphoreSubmitInfo(computeTimeline_, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                         value)});
+        queueSubmit(device_->queue(), lateCmd, lateWaits, {presentSI}, fences_[frameIdx_]);
+        computeValues_[frameIdx_] = value;
+    }
 
     VkPresentInfoKHR pi{};
     pi.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -541,6 +1425,13 @@ void Game::drawFrame()
         exitLog("failed to present swap chain image!");
     }
 
+    if (!firstFramePresented_) {
+        firstFramePresented_ = true;
+        log("first frame presented at {:.1f} ms",
+            std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime_)
+                .count());
+    }
+
     frameIdx_ = (frameIdx_ + 1) % Device::MAX_FRAMES_IN_FLIGHT;
     semaphoreIdx_ = (semaphoreIdx_ + 1) % swapchain_->size();
 }
@@ -17,13 +17,31 @@ class Game
     void run();
 
   private:
+    static constexpr float MODEL_UPLOAD_BUDGET_MS{4.f};
+    static constexpr int TEXTURE_BUDGET_MB{256};
+    // largest render scale change per frame of the dynamic resolution controller
+    static constexpr float RENDER_SCALE_STEP{0.05f};
+    // frames measured per anti-aliasing mode and hdr format by the benchmarks
+    static constexpr uint32_t AA_BENCHMARK_FRAMES{120};
+    static constexpr uint32_t STRESS_LIGHTS{1024};
+
+    std::chrono::steady_clock::time_point startTime_{std::chrono::steady_clock::now()};
     std::unique_ptr<Window> window_;
     std::shared_ptr<Device> device_;
     std::unique_ptr<Swapchain> swapchain_;
+    std::shared_ptr<RenderGraph> renderGraph_;
+    std::shared_ptr<ThreadPool> threadPool_;
+    std::shared_ptr<AssetRegistry> assetRegistry_;
+    std::shared_ptr<TextureStreamer> textureStreamer_;
 
     std::array<VkFence, Device::MAX_FRAMES_IN_FLIGHT> fences_;
     std::vector<VkSemaphore> drawSemaphores_;
     std::vector<VkSemaphore> prsntSemaphores_;
+    // async compute, the graphics and compute submissions of a frame signal its value
+    VkSemaphore graphicsTimeline_{};
+    VkSemaphore computeTimeline_{};
+    uint64_t timelineValue_{};
+    std::array<uint64_t, Device::MAX_FRAMES_IN_FLIGHT> computeValues_{};
 
     std::unique_ptr<Renderer> renderer_;
     std::unique_ptr<RendererPost> rendererPost_;
@@ -33,6 +51,39 @@ class Game
     MouseState mouseState_{};
     Camera camera_{};
     std::vector<Model> models_{};
+    std::vector<std::shared_ptr<ModelHandle>> modelLoads_{};
+    // loading benchmark running as a job on threadPool_, the gui shows the results once it's done
+    std::future<void> loadingBenchmark_{};
+    std::vector<std::string> loadingBenchmarkResults_{};
+    bool firstFramePresented_{};
+    bool textureMipmaps_{true};
+    ImportOptions sponzaImport_{};
+
+    bool dynamicResolution_{};
+    float targetFrameMs_{16.6f};
+    float minRenderScale_{0.5f};
+    float maxRenderScale_{1.f};
+    float smoothedGpuMs_{};
+
+    // indices into the anti-aliasing modes of the gui
+    std::vector<uint32_t> aaBenchmarkModes_{};
+    uint32_t aaBenchmarkRestore_{};
+    uint32_t aaBenchmarkFrames_{};
+    float aaBenchmarkMs_{};
+    // indices into the hdr formats of the gui
+    std::vector<uint32_t> hdrBenchmarkFormats_{};
+    uint32_t hdrBenchmarkRestore_{};
+    uint32_t hdrBenchmarkFrames_{};
+    float hdrBenchmarkMs_{};
+    // last main pass gpu time without and with the depth pre-pass, the latter includes it
+    float mainMs_{};
+    float prepassMainMs_{};
+
+    // point and spot lights, circling around their origins while animated
+    std::vector<Light> lights_{};
+    std::vector<glm::vec3> lightOrigins_{};
+    bool animateLights_{true};
+    float lightTime_{};
 
     SceneUniform sceneUniform_{};
     SkyboxUniform skyboxUniform_{};
@@ -41,6 +92,8 @@ class Game
     uint32_t frameIdx_{};
     uint32_t semaphoreIdx_{};
     std::array<bool, Device::MAX_FRAMES_IN_FLIGHT> queryDataReady_;
+    // streamed images were swapped in since the material sets of the frame were last written
+    std::array<bool, Device::MAX_FRAMES_IN_FLIGHT> materialSetsStale_{};
 
     float currentCpuFps_{};
     float cpuTimesSinceLastUpdate_{};
@@ -53,12 +106,33 @@ class Game
     void setCallBack();
     void createSyncObjects();
     void createModels();
+    void loadSponza();
+    void updateModelLoads();
+    void updateTextureStreaming();
 
     void recreateSwapChain();
     void calculatePerformanceMetrics(float deltaTime);
+    void updateRenderScale(float gpuMs);
+    uint32_t antiAliasingMode() const;
+    bool antiAliasingSupported(uint32_t mode) const;
+    void setAntiAliasing(uint32_t mode);
+    void startAntiAliasingBenchmark();
+    void updateAntiAliasingBenchmark();
+    uint32_t hdrFormat() const;
+    bool hdrFormatSupported(uint32_t format) const;
+    void setHdrFormat(uint32_t format);
+    VkDeviceSize hdrMemory() const;
+    void startHdrFormatBenchmark();
+    void updateHdrFormatBenchmark();
+    void startLoadingBenchmark(std::vector<std::string> (*benchmark)(std::shared_ptr<Device>,
+                                                                     const std::string&));
+    bool loadingBenchmarkRunning() const;
 
     void updateGui();
+    void drawGpuTimeline();
     void calculateDirectionalLight();
+    void createLights(uint32_t count);
+    void updateLights(float deltaTime);
 
     void drawFrame();
 };
@@ -2,6 +2,8 @@
 #include "Logger.h"
 #include "Buffer.h"
 
+#include <algorithm>
+#include <cmath>
 #include <ktx.h>
 #include <ktxvulkan.h>
 #define STB_IMAGE_IMPLEMENTATION
@@ -18,6 +20,27 @@ Image2D::~Image2D()
     clean();
 }
 
+void Image2D::swap(Image2D& other)
+{
+    std::swap(imgOwner_, other.imgOwner_);
+    std::swap(image_, other.image_);
+    std::swap(view_, other.view_);
+    std::swap(memory_, other.memory_);
+    std::swap(sampler_, other.sampler_);
+    std::swap(format_, other.format_);
+    std::swap(width_, other.width_);
+    std::swap(height_, other.height_);
+    std::swap(baseMipLevel_, other.baseMipLevel_);
+    std::swap(mipLevels_, other.mipLevels_);
+    std::swap(arrayLayers_, other.arrayLayers_);
+    std::swap(components_, other.components_);
+    std::swap(usage_, other.usage_);
+    std::swap(samples_, other.samples_);
+    std::swap(currentStage_, other.currentStage_);
+    std::swap(currentAccess_, other.currentAccess_);
+    std::swap(currentLayout_, other.currentLayout_);
+}
+
 VkImage Image2D::get() const
 {
     return image_;
@@ -53,6 +76,11 @@ const VkFormat& Image2D::format() const
     return format_;
 }
 
+VkImageUsageFlags Image2D::usage() const
+{
+    return usage_;
+}
+
 void Image2D::createImage(VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usage,
                           VkSampleCountFlagBits samples, uint32_t baseMipLevel, uint32_t mipLevels)
 {
@@ -79,31 +107,90 @@ void Image2D::createView(VkImage image, VkFormat format, uint32_t width, uint32_
     createView(VK_IMAGE_VIEW_TYPE_2D);
 }
 
-void Image2D::createTexture(const unsigned char* data, uint32_t width, uint32_t height,
-                            uint32_t channels, bool srgb)
+void Image2D::declareImage(VkFormat format, uint32_t width, uint32_t height,
+                           VkImageUsageFlags usage, VkSampleCountFlagBits samples,
+                           uint32_t mipLevels)
 {
-    format_ = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    clean();
+    imgOwner_ = true;
+
+    format_ = format;
     width_ = width;
     height_ = height;
-    mipLevels_ = 1;
+    baseMipLevel_ = 0;
+    mipLevels_ = mipLevels;
     arrayLayers_ = 1;
+    usage_ = usage;
+    samples_ = samples;
+}
+
+VkMemoryRequirements Image2D::memoryRequirements() const
+{
+    VkImageCreateInfo imageCI = imageCreateInfo(0);
+
+    VkDeviceImageMemoryRequirements imageMemoryRs{};
+    imageMemoryRs.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+    imageMemoryRs.pCreateInfo = &imageCI;
+
+    VkMemoryRequirements2 memoryRs{};
+    memoryRs.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    vkGetDeviceImageMemoryRequirements(device_->get(), &imageMemoryRs, &memoryRs);
+
+    return memoryRs.memoryRequirements;
+}
+
+void Image2D::bindMemory(VkDeviceMemory memory, VkDeviceSize offset)
+{
+    VkSampler sampler = sampler_;
+    clean();
+    sampler_ = sampler;
+
+    VkImageCreateInfo imageCI = imageCreateInfo(0);
+    VK_CHECK(vkCreateImage(device_->get(), &imageCI, nullptr, &image_));
+    VK_CHECK(vkBindImageMemory(device_->get(), image_, memory, offset));
 
+    createView(VK_IMAGE_VIEW_TYPE_2D);
+}
+
+void Image2D::createTexture(const unsigned char* data, uint32_t width, uint32_t height,
+                            uint32_t channels, bool srgb)
+{
     VkDeviceSize size =
-        static_cast<VkDeviceSize>(width_) * static_cast<VkDeviceSize>(height_) * channels;
+        static_cast<VkDeviceSize>(width) * static_cast<VkDeviceSize>(height) * channels;
 
     Buffer buffer{device_};
     buffer.createStagingBuffer(data, size);
 
-    createImage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT,
-                0, VK_IMAGE_VIEW_TYPE_2D);
-
     VkCommandBuffer cmd = device_->beginCmd();
+    createTexture(cmd, buffer.get(), 0, width, height, srgb);
+    device_->submitWait(cmd);
+}
+
+void Image2D::createTexture(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset,
+                            uint32_t width, uint32_t height, bool srgb)
+{
+    format_ = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    width_ = width;
+    height_ = height;
+    mipLevels_ = 1;
+    arrayLayers_ = 1;
+    components_ = {};
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(device_->physical(), format_, &formatProperties);
+    if (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) {
+        mipLevels_ = static_cast<uint32_t>(std::floor(std::log2(std::max(width_, height_)))) + 1;
+    }
+
+    createImage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                VK_SAMPLE_COUNT_1_BIT, 0, VK_IMAGE_VIEW_TYPE_2D);
 
     transition(cmd, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
     VkBufferImageCopy copy{};
-    copy.bufferOffset = 0;
+    copy.bufferOffset = offset;
     copy.bufferRowLength = 0;
     copy.bufferImageHeight = 0;
     copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -113,13 +200,50 @@ void Image2D::createTexture(const unsigned char* data, uint32_t width, uint32_t
     copy.imageOffset = {0, 0, 0};
     copy.imageExtent = {width_, height_, 1};
 
-    vkCmdCopyBufferToImage(cmd, buffer.get(), image_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                           &copy);
+    vkCmdCopyBufferToImage(cmd, buffer, image_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+    generateMipmaps(cmd);
+}
+
+void Image2D::createTexture(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset,
+                            VkFormat format, uint32_t width, uint32_t height,
+                            const std::vector<VkDeviceSize>& levelSizes,
+                            VkComponentMapping components)
+{
+    format_ = format;
+    width_ = width;
+    height_ = height;
+    mipLevels_ = static_cast<uint32_t>(levelSizes.size());
+    arrayLayers_ = 1;
+    components_ = components;
+
+    createImage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT,
+                0, VK_IMAGE_VIEW_TYPE_2D);
+
+    std::vector<VkBufferImageCopy> copies;
+    for (uint32_t level = 0; level < mipLevels_; level++) {
+        VkBufferImageCopy copy{};
+        copy.bufferOffset = offset;
+        copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy.imageSubresource.mipLevel = level;
+        copy.imageSubresource.baseArrayLayer = 0;
+        copy.imageSubresource.layerCount = 1;
+        copy.imageExtent.width = std::max(1u, width_ >> level);
+        copy.imageExtent.height = std::max(1u, height_ >> level);
+        copy.imageExtent.depth = 1;
+
+        copies.push_back(copy);
+        offset += levelSizes[level];
+    }
+
+    transition(cmd, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    vkCmdCopyBufferToImage(cmd, buffer, image_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(copies.size()), copies.data());
 
     transition(cmd, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT,
                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    device_->submitWait(cmd);
 }
 
 void Image2D::createTexture(const std::string& image, bool srgb)
@@ -266,6 +390,77 @@ VkImageMemoryBarrier2 Image2D::barrier2(VkPipelineStageFlagBits2 stage, VkAccess
     return barrier;
 }
 
+void Image2D::generateMipmaps(VkCommandBuffer cmd)
+{
+    auto levelBarrier = [this](uint32_t level, VkPipelineStageFlags2 srcStage,
+                               VkAccessFlags2 srcAccess, VkImageLayout oldLayout,
+                               VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess,
+                               VkImageLayout newLayout) {
+        VkImageMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = srcStage;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstStageMask = dstStage;
+        barrier.dstAccessMask = dstAccess;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image_;
+        barrier.subresourceRange.aspectMask = aspect();
+        barrier.subresourceRange.baseMipLevel = level;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = arrayLayers_;
+        return barrier;
+    };
+
+    // each level is blitted from the previous one, srgb texels are filtered in linear space
+    int32_t width = static_cast<int32_t>(width_);
+    int32_t height = static_cast<int32_t>(height_);
+    for (uint32_t level = 1; level < mipLevels_; level++) {
+        transition(cmd, levelBarrier(level - 1, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                     VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                     VK_ACCESS_2_TRANSFER_READ_BIT,
+                                     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL));
+
+        VkImageBlit blit{};
+        blit.srcSubresource.aspectMask = aspect();
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = arrayLayers_;
+        blit.srcOffsets[1] = {width, height, 1};
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        blit.dstSubresource = blit.srcSubresource;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstOffsets[1] = {width, height, 1};
+
+        vkCmdBlitImage(cmd, image_, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image_,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        transition(cmd, levelBarrier(level - 1, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                     VK_ACCESS_2_TRANSFER_READ_BIT,
+                                     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                     VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                                     VK_ACCESS_2_SHADER_READ_BIT,
+                                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+    }
+
+    transition(cmd, levelBarrier(mipLevels_ - 1, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                 VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                                 VK_ACCESS_2_SHADER_READ_BIT,
+                                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+
+    currentStage_ = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+    currentAccess_ = VK_ACCESS_2_SHADER_READ_BIT;
+    currentLayout_ = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
 void Image2D::clean()
 {
     if (sampler_) {
@@ -293,23 +488,11 @@ void Image2D::createImage(VkImageUsageFlags usage, VkSampleCountFlagBits samples
                           VkImageCreateFlags flags, VkImageViewType viewType)
 {
     clean();
+    imgOwner_ = true;
+    usage_ = usage;
+    samples_ = samples;
 
-    VkImageCreateInfo imageCI{};
-    imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageCI.flags = flags;
-    imageCI.imageType = VK_IMAGE_TYPE_2D;
-    imageCI.format = format_;
-    imageCI.extent.width = width_;
-    imageCI.extent.height = height_;
-    imageCI.extent.depth = 1;
-    imageCI.mipLevels = mipLevels_;
-    imageCI.arrayLayers = arrayLayers_;
-    imageCI.samples = samples;
-    imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageCI.usage = usage;
-    imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-
+    VkImageCreateInfo imageCI = imageCreateInfo(flags);
     VK_CHECK(vkCreateImage(device_->get(), &imageCI, nullptr, &image_));
 
     VkMemoryRequirements memoryRs;
@@ -334,8 +517,7 @@ void Image2D::createView(VkImageViewType viewType)
     imageViewCI.image = image_;
     imageViewCI.viewType = viewType;
     imageViewCI.format = format_;
-    imageViewCI.components = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G,
-                              VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A};
+    imageViewCI.components = components_;
     imageViewCI.subresourceRange.aspectMask = aspect();
     imageViewCI.subresourceRange.baseMipLevel = baseMipLevel_;
     imageViewCI.subresourceRange.levelCount = mipLevels_;
@@ -345,6 +527,38 @@ void Image2D::createView(VkImageViewType viewType)
     VK_CHECK(vkCreateImageView(device_->get(), &imageViewCI, nullptr, &view_));
 }
 
+VkImageCreateInfo Image2D::imageCreateInfo(VkImageCreateFlags flags) const
+{
+    VkImageCreateInfo imageCI{};
+    imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCI.flags = flags;
+    imageCI.imageType = VK_IMAGE_TYPE_2D;
+    imageCI.format = format_;
+    imageCI.extent.width = width_;
+    imageCI.extent.height = height_;
+    imageCI.extent.depth = 1;
+    imageCI.mipLevels = mipLevels_;
+    imageCI.arrayLayers = arrayLayers_;
+    imageCI.samples = samples_;
+    imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCI.usage = usage_;
+    imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // render targets may be written on one queue and read on the other
+    VkImageUsageFlags shared = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                               VK_IMAGE_USAGE_STORAGE_BIT;
+    const auto& queueFamilies = device_->queueFamilies();
+    if (queueFamilies.size() > 1 && (usage_ & shared)) {
+        imageCI.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageCI.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        imageCI.pQueueFamilyIndices = queueFamilies.data();
+    }
+    imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    return imageCI;
+}
+
 VkImageAspectFlags Image2D::aspect() const
 {
     VkImageAspectFlags aspect{VK_IMAGE_ASPECT_COLOR_BIT};
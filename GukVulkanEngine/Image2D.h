@@ -3,6 +3,7 @@
 #include "Device.h"
 
 #include <string>
+#include <vector>
 
 namespace guk {
 
@@ -20,6 +21,7 @@ class Image2D
     uint32_t width() const;
     uint32_t height() const;
     const VkFormat& format() const;
+    VkImageUsageFlags usage() const;
 
     void createImage(VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usage,
                      VkSampleCountFlagBits samples, uint32_t baseMipLevel = 0,
@@ -28,13 +30,29 @@ class Image2D
     void createView(VkImage image, VkFormat format, uint32_t width, uint32_t height,
                     uint32_t baseMipLevel = 0, uint32_t mipLevels = 1);
 
+    // image whose memory is bound later (transient attachments aliased by the render graph)
+    void declareImage(VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usage,
+                      VkSampleCountFlagBits samples, uint32_t mipLevels = 1);
+    VkMemoryRequirements memoryRequirements() const;
+    void bindMemory(VkDeviceMemory memory, VkDeviceSize offset);
+
     void createTexture(const unsigned char* data, uint32_t width, uint32_t height,
                        uint32_t channels, bool srgb);
+    // records the copy of rgba8 texels at offset of a staging buffer, submitted by the caller
+    void createTexture(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, uint32_t width,
+                       uint32_t height, bool srgb);
+    // same for a prebuilt mip chain (block compressed), levels packed one after another
+    void createTexture(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, VkFormat format,
+                       uint32_t width, uint32_t height, const std::vector<VkDeviceSize>& levelSizes,
+                       VkComponentMapping components = {});
     void createTexture(const std::string& image, bool srgb);
     void createTextureFromMemory(const unsigned char* data, int size, bool srgb);
 
     void createTextureKtx2(const std::string& image, bool isSkybox);
 
+    // exchanges the images and their state, so holders of this object see the other image
+    void swap(Image2D& other);
+
     void transition(VkCommandBuffer cmd, VkPipelineStageFlagBits2 stage, VkAccessFlagBits2 access,
                     VkImageLayout layout);
     static void transition(VkCommandBuffer cmd, VkImageMemoryBarrier2 barrier);
@@ -57,16 +75,21 @@ class Image2D
     uint32_t baseMipLevel_{0};
     uint32_t mipLevels_{1};
     uint32_t arrayLayers_{1};
+    VkComponentMapping components_{};
+    VkImageUsageFlags usage_{};
+    VkSampleCountFlagBits samples_{VK_SAMPLE_COUNT_1_BIT};
 
     VkPipelineStageFlags2 currentStage_{};
     VkAccessFlags2 currentAccess_{};
     VkImageLayout currentLayout_{};
 
     void clean();
+    void generateMipmaps(VkCommandBuffer cmd);
 
     void createImage(VkImageUsageFlags usage, VkSampleCountFlagBits samples,
                      VkImageCreateFlags flags, VkImageViewType viewType);
     void createView(VkImageViewType viewType);
+    VkImageCreateInfo imageCreateInfo(VkImageCreateFlags flags) const;
 
     VkImageAspectFlags aspect() const;
 };
@@ -1,9 +1,18 @@
 #include "Game.h"
+#include "TextureBaker.h"
 
-int main()
+int main(int argc, char* argv[])
 {
     using namespace guk;
 
+    // GukVulkanEngine --bake <model>... writes .ktx2 textures next to each model and exits
+    if (argc > 2 && std::string(argv[1]) == "--bake") {
+        for (int i = 2; i < argc; i++) {
+            TextureBaker::bake(argv[i]);
+        }
+        return 0;
+    }
+
     auto game = std::make_unique<Game>();
 
     game->run();
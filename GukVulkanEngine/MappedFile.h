@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace guk {
+
+// read only mapping of a whole file, empty when the file can not be opened
+class MappedFile
+{
+  public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const;
+    size_t size() const;
+
+  private:
+    void* file_{};
+    void* mapping_{};
+    const unsigned char* data_{};
+    size_t size_{};
+};
+
+} // namespace guk
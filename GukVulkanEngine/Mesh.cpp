@@ -1,33 +1,49 @@
 #include "Mesh.h"
 
+#include <array>
+#include <cmath>
+
 namespace guk {
 
 Mesh::Mesh(std::shared_ptr<Device> device)
-    : device_(device), vertexBuffer_(std::make_shared<Buffer>(device_)),
+    : device_(device), geometry_(std::make_shared<Geometry>()),
+      vertexBuffer_(std::make_shared<Buffer>(device_)),
       indexBuffer_(std::make_shared<Buffer>(device_))
 {
 }
 
-void Mesh::addVertex(Vertex vertex)
+void Mesh::setGeometry(std::vector<Vertex> vertices, std::vector<uint32_t> indices)
 {
-    vertices_.push_back(vertex);
+    geometry_->vertices = std::move(vertices);
+    geometry_->indices = std::move(indices);
+    indexCount_ = static_cast<uint32_t>(geometry_->indices.size());
 }
 
-void Mesh::addIndex(uint32_t index)
+void Mesh::setGeometry(std::shared_ptr<MappedFile> file, std::span<const Vertex> vertices,
+                       std::span<const uint32_t> indices)
 {
-    indices_.push_back(index);
+    geometry_->mappedFile = file;
+    geometry_->mappedVertices = vertices;
+    geometry_->mappedIndices = indices;
+    indexCount_ = static_cast<uint32_t>(indices.size());
 }
 
 void Mesh::createVertexBuffer()
 {
-    vertexBuffer_->createLocalBuffer(vertices_.data(), sizeof(vertices_[0]) * vertices_.size(),
-                                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    std::span<const Vertex> vertices = vertexData();
+    // also read from the visibility buffer resolve through its address, no storage binding so
+    // the buffer keeps exclusive sharing
+    vertexBuffer_->createLocalBuffer(vertices.data(), vertices.size_bytes(),
+                                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                         VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
 }
 
 void Mesh::createIndexBuffer()
 {
-    indexBuffer_->createLocalBuffer(indices_.data(), sizeof(indices_[0]) * indices_.size(),
-                                    VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    std::span<const uint32_t> indices = indexData();
+    indexBuffer_->createLocalBuffer(indices.data(), indices.size_bytes(),
+                                    VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
 }
 
 VkBuffer Mesh::getVertexBuffer() const
@@ -40,57 +56,148 @@ VkBuffer Mesh::getIndexBuffer() const
     return indexBuffer_->get();
 }
 
+VkDeviceAddress Mesh::vertexAddress() const
+{
+    return vertexBuffer_->address();
+}
+
+VkDeviceAddress Mesh::indexAddress() const
+{
+    return indexBuffer_->address();
+}
+
 std::vector<Vertex>& Mesh::vertices()
 {
-    return vertices_;
+    return geometry_->vertices;
 }
 
-uint32_t Mesh::indicesSize() const
+std::span<const Vertex> Mesh::vertexData() const
 {
-    return static_cast<uint32_t>(indices_.size());
+    return geometry_->mappedFile ? geometry_->mappedVertices
+                                 : std::span<const Vertex>(geometry_->vertices);
 }
 
-void Mesh::setMaterialIndex(uint32_t index)
+std::span<const uint32_t> Mesh::indexData() const
 {
-    materialIndex_ = index;
+    return geometry_->mappedFile ? geometry_->mappedIndices
+                                 : std::span<const uint32_t>(geometry_->indices);
 }
 
-uint32_t Mesh::getMaterialIndex() const
+std::span<const glm::vec3> Mesh::positions() const
 {
-    return materialIndex_;
+    return geometry_->positions;
 }
 
-void Mesh::calculateTangents()
+uint32_t Mesh::indicesSize() const
+{
+    return indexCount_;
+}
+
+void Mesh::releaseGeometry(GeometryResidency residency)
 {
-    std::vector<glm::vec3> tangents(vertices_.size(), glm::vec3(0.0f));
+    if (residency == GeometryResidency::Full) {
+        return;
+    }
 
-    for (size_t i = 0; i < indicesSize(); i += 3) {
-        const uint32_t& i0 = indices_[i];
-        const uint32_t& i1 = indices_[i + 1];
-        const uint32_t& i2 = indices_[i + 2];
+    Geometry released{};
+    if (residency == GeometryResidency::Positions) {
+        std::span<const Vertex> vertices = vertexData();
+        std::span<const uint32_t> indices = indexData();
+        released.positions.reserve(vertices.size());
+        for (const auto& vertex : vertices) {
+            released.positions.push_back(vertex.position);
+        }
+        released.indices.assign(indices.begin(), indices.end());
+    }
 
-        const Vertex& v0 = vertices_[i0];
-        const Vertex& v1 = vertices_[i1];
-        const Vertex& v2 = vertices_[i2];
+    // swapped rather than cleared so the capacity goes too, the mapping is unmapped once the
+    // last mesh of the cache file lets go of it
+    std::swap(*geometry_, released);
+}
 
-        glm::vec3 e1 = v1.position - v0.position;
-        glm::vec3 e2 = v2.position - v0.position;
+size_t Mesh::hostSize() const
+{
+    return geometry_->vertices.capacity() * sizeof(Vertex) +
+           geometry_->indices.capacity() * sizeof(uint32_t) +
+           geometry_->positions.capacity() * sizeof(glm::vec3) +
+           geometry_->mappedVertices.size_bytes() + geometry_->mappedIndices.size_bytes();
+}
 
-        glm::vec2 d1 = v1.texcoord - v0.texcoord;
-        glm::vec2 d2 = v2.texcoord - v0.texcoord;
+void Mesh::setMaterialIndex(uint32_t index)
+{
+    materialIndex_ = index;
+}
 
-        float f = 1.0f / (d1.x * d2.y - d2.x * d1.y);
-        glm::vec3 tangent = f * (d2.y * e1 - d1.y * e2);
+uint32_t Mesh::getMaterialIndex() const
+{
+    return materialIndex_;
+}
 
-        tangents[i0] += tangent;
-        tangents[i1] += tangent;
-        tangents[i2] += tangent;
+void Mesh::calculateTangents()
+{
+    // MikkTSpace style: face tangents projected onto each corner's normal plane, weighted by the
+    // corner angle, with the bitangent sign in w. vertices are not split on mirrored seams
+    std::vector<Vertex>& vertices = geometry_->vertices;
+    const std::vector<uint32_t>& indices = geometry_->indices;
+    std::vector<glm::vec3> tangents(vertices.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> bitangents(vertices.size(), glm::vec3(0.0f));
+
+    auto projectNormalized = [](glm::vec3 v, glm::vec3 n) {
+        v -= glm::dot(v, n) * n;
+        float length2 = glm::dot(v, v);
+        return length2 > 0.f ? v / std::sqrt(length2) : v;
+    };
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        std::array<uint32_t, 3> index{indices[i], indices[i + 1], indices[i + 2]};
+        std::array<const Vertex*, 3> v{&vertices[index[0]], &vertices[index[1]],
+                                       &vertices[index[2]]};
+
+        glm::vec3 e1 = v[1]->position - v[0]->position;
+        glm::vec3 e2 = v[2]->position - v[0]->position;
+
+        glm::vec2 d1 = v[1]->texcoord - v[0]->texcoord;
+        glm::vec2 d2 = v[2]->texcoord - v[0]->texcoord;
+
+        // degenerate uvs add nothing, the vertex falls back to an arbitrary tangent
+        float area = d1.x * d2.y - d2.x * d1.y;
+        if (area == 0.f) {
+            continue;
+        }
+
+        glm::vec3 os = d2.y * e1 - d1.y * e2;
+        glm::vec3 ot = d1.x * e2 - d2.x * e1;
+        if (area < 0.f) {
+            os = -os;
+            ot = -ot;
+        }
+
+        for (uint32_t c = 0; c < 3; c++) {
+            glm::vec3 a = v[(c + 1) % 3]->position - v[c]->position;
+            glm::vec3 b = v[(c + 2) % 3]->position - v[c]->position;
+            float lengths = glm::length(a) * glm::length(b);
+            if (lengths == 0.f) {
+                continue;
+            }
+            float angle = std::acos(glm::clamp(glm::dot(a, b) / lengths, -1.f, 1.f));
+
+            glm::vec3 n = v[c]->normal;
+            tangents[index[c]] += angle * projectNormalized(os, n);
+            bitangents[index[c]] += angle * projectNormalized(ot, n);
+        }
     }
 
-    for (size_t i = 0; i < vertices_.size(); i++) {
-        glm::vec3 N = vertices_[i].normal;
-        glm::vec3 T = tangents[i];
-        vertices_[i].tangent = glm::normalize(T - glm::dot(T, N) * N);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        glm::vec3 N = vertices[i].normal;
+        glm::vec3 T = projectNormalized(tangents[i], N);
+        if (glm::dot(T, T) == 0.f) {
+            T = glm::normalize(glm::cross(std::abs(N.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f)
+                                                                : glm::vec3(0.f, 1.f, 0.f),
+                                          N));
+        }
+
+        float sign = glm::dot(glm::cross(N, T), bitangents[i]) < 0.f ? -1.f : 1.f;
+        vertices[i].tangent = glm::vec4(T, sign);
     }
 }
 
@@ -99,7 +206,7 @@ void Mesh::calculateBound()
     boundMin_ = glm::vec3(std::numeric_limits<float>::max());
     boundMax_ = glm::vec3(std::numeric_limits<float>::lowest());
 
-    for (const auto& vertex : vertices_) {
+    for (const auto& vertex : geometry_->vertices) {
         boundMin_ = glm::min(boundMin_, vertex.position);
         boundMax_ = glm::max(boundMax_, vertex.position);
     }
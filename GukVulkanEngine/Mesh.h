@@ -3,6 +3,9 @@
 #include "Device.h"
 #include "Buffer.h"
 #include "DataStructures.h"
+#include "MappedFile.h"
+
+#include <span>
 
 namespace guk {
 
@@ -11,18 +14,30 @@ class Mesh
   public:
     Mesh(std::shared_ptr<Device> device);
 
-    void addVertex(Vertex vertex);
-    void addIndex(uint32_t index);
+    void setGeometry(std::vector<Vertex> vertices, std::vector<uint32_t> indices);
+    // geometry in a mapped mesh cache, uploaded from the mapping without an intermediate copy
+    void setGeometry(std::shared_ptr<MappedFile> file, std::span<const Vertex> vertices,
+                     std::span<const uint32_t> indices);
 
     void createVertexBuffer();
     void createIndexBuffer();
 
     VkBuffer getVertexBuffer() const;
     VkBuffer getIndexBuffer() const;
+    VkDeviceAddress vertexAddress() const;
+    VkDeviceAddress indexAddress() const;
 
     std::vector<Vertex>& vertices();
+    std::span<const Vertex> vertexData() const;
+    std::span<const uint32_t> indexData() const;
+    std::span<const glm::vec3> positions() const;
     uint32_t indicesSize() const;
 
+    // drops what the residency does not keep, for every copy of the mesh
+    void releaseGeometry(GeometryResidency residency);
+    // bytes of cpu geometry held, heap and mapped
+    size_t hostSize() const;
+
     void setMaterialIndex(uint32_t index);
     uint32_t getMaterialIndex() const;
 
@@ -34,10 +49,20 @@ class Mesh
     void setBounds(glm::vec3 min, glm::vec3 max);
 
   private:
-    std::shared_ptr<Device> device_;
+    // shared by copies of the mesh (models_, per frame draws, the asset registry)
+    struct Geometry
+    {
+        std::vector<Vertex> vertices{};
+        std::vector<uint32_t> indices{};
+        std::shared_ptr<MappedFile> mappedFile;
+        std::span<const Vertex> mappedVertices;
+        std::span<const uint32_t> mappedIndices;
+        std::vector<glm::vec3> positions{};
+    };
 
-    std::vector<Vertex> vertices_{};
-    std::vector<uint32_t> indices_{};
+    std::shared_ptr<Device> device_;
+    std::shared_ptr<Geometry> geometry_;
+    uint32_t indexCount_{};
 
     glm::vec3 boundMin_{};
     glm::vec3 boundMax_{};
@@ -0,0 +1,245 @@
+#include "MeshCache.h"
+#include "Model.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace guk {
+
+static constexpr char MAGIC[4]{'G', 'U', 'K', 'M'};
+
+std::string MeshCache::cachePath(const std::string& file)
+{
+    return std::filesystem::path(file).replace_extension(".gukmesh").string();
+}
+
+uint64_t MeshCache::sourceHash(AssetRegistry& registry, const std::string& file,
+                               const ImportOptions& options)
+{
+    uint64_t hash = registry.fileHash(file);
+
+    // external buffers change the geometry without touching the gltf itself
+    std::filesystem::path path(file);
+    if (path.extension() == ".gltf") {
+        std::vector<std::string> buffers;
+        for (const auto& entry : std::filesystem::directory_iterator(path.parent_path())) {
+            if (entry.path().extension() == ".bin") {
+                buffers.push_back(entry.path().string());
+            }
+        }
+        std::sort(buffers.begin(), buffers.end());
+
+        for (const auto& buffer : buffers) {
+            uint64_t bufferHash = registry.fileHash(buffer);
+            hash = AssetRegistry::hash(&bufferHash, sizeof(bufferHash), hash);
+        }
+    }
+
+    // field by field, the struct has padding
+    hash = AssetRegistry::hash(&options.normalize, sizeof(options.normalize), hash);
+    hash = AssetRegistry::hash(&options.mergeMeshes, sizeof(options.mergeMeshes), hash);
+    hash = AssetRegistry::hash(&options.mergeDepth, sizeof(options.mergeDepth), hash);
+    for (bool step : {options.joinIdenticalVertices, options.removeDegenerates,
+                      options.improveCacheLocality, options.splitLargeMeshes,
+                      options.sortByPrimitiveType}) {
+        hash = AssetRegistry::hash(&step, sizeof(step), hash);
+    }
+    return hash;
+}
+
+std::shared_ptr<MappedFile> MeshCache::read(const std::string& path, uint64_t sourceHash,
+                                            Model& model)
+{
+    if (!std::filesystem::exists(path)) {
+        return nullptr;
+    }
+
+    auto file = std::make_shared<MappedFile>(path);
+    const unsigned char* data = file->data();
+    size_t size = file->size();
+
+    Header header{};
+    if (size < sizeof(Header)) {
+        log("{}: mesh cache is truncated, importing again", path);
+        return nullptr;
+    }
+    memcpy(&header, data, sizeof(Header));
+
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+        header.vertexSize != sizeof(Vertex) || header.sourceHash != sourceHash) {
+        log("{}: mesh cache is out of date, importing again", path);
+        return nullptr;
+    }
+
+    auto inside = [size](uint64_t offset, uint64_t length) {
+        return offset <= size && length <= size - offset;
+    };
+
+    // tables follow the header, all of them are checked before the model is touched
+    std::vector<MeshEntry> meshes(header.meshCount);
+    std::vector<MaterialUniform> materials(header.materialCount);
+    std::vector<TextureEntry> textures(header.textureCount);
+    std::vector<EmbeddedEntry> embedded(header.embeddedCount);
+
+    uint64_t offset = sizeof(Header);
+    auto table = [&](void* dst, uint64_t length) {
+        if (!inside(offset, length)) {
+            return false;
+        }
+        memcpy(dst, data + offset, static_cast<size_t>(length));
+        offset += length;
+        return true;
+    };
+
+    bool valid = table(meshes.data(), meshes.size() * sizeof(MeshEntry)) &&
+                 table(materials.data(), materials.size() * sizeof(MaterialUniform)) &&
+                 table(textures.data(), textures.size() * sizeof(TextureEntry)) &&
+                 table(embedded.data(), embedded.size() * sizeof(EmbeddedEntry));
+
+    for (const auto& mesh : meshes) {
+        valid = valid && inside(mesh.vertexOffset, uint64_t{mesh.vertexCount} * sizeof(Vertex)) &&
+                inside(mesh.indexOffset, uint64_t{mesh.indexCount} * sizeof(uint32_t)) &&
+                mesh.materialIndex < header.materialCount;
+    }
+    for (const auto& texture : textures) {
+        valid = valid && inside(texture.nameOffset, texture.nameSize) && texture.nameSize > 0;
+    }
+    for (const auto& texture : embedded) {
+        valid = valid && inside(texture.offset, texture.size);
+    }
+
+    if (!valid) {
+        log("{}: mesh cache is corrupt, importing again", path);
+        return nullptr;
+    }
+
+    for (const auto& entry : meshes) {
+        Mesh mesh{model.device_};
+        mesh.setGeometry(
+            file,
+            {reinterpret_cast<const Vertex*>(data + entry.vertexOffset), entry.vertexCount},
+            {reinterpret_cast<const uint32_t*>(data + entry.indexOffset), entry.indexCount});
+        mesh.setBounds(entry.boundMin, entry.boundMax);
+        mesh.setMaterialIndex(entry.materialIndex);
+        model.meshes_.push_back(mesh);
+    }
+
+    model.materials_ = materials;
+
+    for (const auto& texture : textures) {
+        model.textureFiles_.emplace_back(reinterpret_cast<const char*>(data + texture.nameOffset),
+                                         texture.nameSize);
+        model.textureKinds_.push_back(texture.kind);
+    }
+
+    for (const auto& texture : embedded) {
+        model.embeddedTextures_.push_back(
+            {data + texture.offset, static_cast<size_t>(texture.size), texture.width,
+             texture.height});
+    }
+
+    model.boundMin_ = header.boundMin;
+    model.boundMax_ = header.boundMax;
+
+    return file;
+}
+
+void MeshCache::write(const std::string& path, uint64_t sourceHash, const Model& model)
+{
+    Header header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.meshCount = static_cast<uint32_t>(model.meshes_.size());
+    header.sourceHash = sourceHash;
+    header.materialCount = static_cast<uint32_t>(model.materials_.size());
+    header.textureCount = static_cast<uint32_t>(model.textureFiles_.size());
+    header.embeddedCount = static_cast<uint32_t>(model.embeddedTextures_.size());
+    header.boundMin = model.boundMin_;
+    header.boundMax = model.boundMax_;
+
+    // blobs start after the tables, aligned so the mapping can be read in place
+    uint64_t offset = sizeof(Header) + header.meshCount * sizeof(MeshEntry) +
+                      header.materialCount * sizeof(MaterialUniform) +
+                      header.textureCount * sizeof(TextureEntry) +
+                      header.embeddedCount * sizeof(EmbeddedEntry);
+    auto reserve = [&offset](uint64_t length) {
+        uint64_t aligned = (offset + 15) / 16 * 16;
+        offset = aligned + length;
+        return aligned;
+    };
+
+    std::vector<MeshEntry> meshes;
+    for (const auto& mesh : model.meshes_) {
+        MeshEntry entry{};
+        entry.vertexCount = static_cast<uint32_t>(mesh.vertexData().size());
+        entry.indexCount = static_cast<uint32_t>(mesh.indexData().size());
+        entry.vertexOffset = reserve(mesh.vertexData().size_bytes());
+        entry.indexOffset = reserve(mesh.indexData().size_bytes());
+        entry.materialIndex = mesh.getMaterialIndex();
+        entry.boundMin = mesh.boundMin();
+        entry.boundMax = mesh.boundMax();
+        meshes.push_back(entry);
+    }
+
+    std::vector<TextureEntry> textures;
+    for (uint32_t i = 0; i < header.textureCount; i++) {
+        const std::string& name = model.textureFiles_[i];
+        textures.push_back({reserve(name.size()), static_cast<uint32_t>(name.size()),
+                            model.textureKinds_[i]});
+    }
+
+    std::vector<EmbeddedEntry> embedded;
+    for (const auto& texture : model.embeddedTextures_) {
+        embedded.push_back({reserve(texture.size), texture.size, texture.width, texture.height});
+    }
+
+    // written aside and renamed so an interrupted write never leaves a half cache behind
+    std::string temp = path + ".tmp";
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+
+    auto put = [&out](const void* data, uint64_t length) {
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(length));
+    };
+    auto putAt = [&out, &put](uint64_t offset, const void* data, uint64_t length) {
+        static constexpr char zeros[16]{};
+        put(zeros, offset - static_cast<uint64_t>(out.tellp()));
+        put(data, length);
+    };
+
+    put(&header, sizeof(Header));
+    put(meshes.data(), meshes.size() * sizeof(MeshEntry));
+    put(model.materials_.data(), model.materials_.size() * sizeof(MaterialUniform));
+    put(textures.data(), textures.size() * sizeof(TextureEntry));
+    put(embedded.data(), embedded.size() * sizeof(EmbeddedEntry));
+
+    for (uint32_t i = 0; i < header.meshCount; i++) {
+        const Mesh& mesh = model.meshes_[i];
+        putAt(meshes[i].vertexOffset, mesh.vertexData().data(), mesh.vertexData().size_bytes());
+        putAt(meshes[i].indexOffset, mesh.indexData().data(), mesh.indexData().size_bytes());
+    }
+    for (uint32_t i = 0; i < header.textureCount; i++) {
+        putAt(textures[i].nameOffset, model.textureFiles_[i].data(), textures[i].nameSize);
+    }
+    for (uint32_t i = 0; i < header.embeddedCount; i++) {
+        putAt(embedded[i].offset, model.embeddedTextures_[i].data, embedded[i].size);
+    }
+
+    out.close();
+    std::error_code error;
+    if (out.fail()) {
+        log("failed to write mesh cache: {}", path);
+        std::filesystem::remove(temp, error);
+        return;
+    }
+
+    std::filesystem::rename(temp, path, error);
+    if (error) {
+        log("failed to write mesh cache: {}", path);
+        std::filesystem::remove(temp, error);
+    }
+}
+
+} // namespace guk
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "AssetRegistry.h"
+
+#include <memory>
+#include <string>
+
+namespace guk {
+
+class Model;
+
+// versioned binary copy of an imported model written next to its source: gpu ready vertex and
+// index blobs, bounds, materials, texture references and embedded textures, read through a
+// file mapping so a warm start skips assimp, tangents and bounds
+class MeshCache
+{
+  public:
+    static std::string cachePath(const std::string& file);
+    // covers the source file, external gltf buffers and the import options
+    static uint64_t sourceHash(AssetRegistry& registry, const std::string& file,
+                               const ImportOptions& options);
+
+    // fills model, the returned mapping backs its meshes and embedded textures.
+    // nullptr when the cache is missing, from another version or from another source
+    static std::shared_ptr<MappedFile> read(const std::string& path, uint64_t sourceHash,
+                                            Model& model);
+    static void write(const std::string& path, uint64_t sourceHash, const Model& model);
+
+  private:
+    static constexpr uint32_t VERSION{2};
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t vertexSize;
+        uint32_t meshCount;
+        uint64_t sourceHash;
+        uint32_t materialCount;
+        uint32_t textureCount;
+        uint32_t embeddedCount;
+        glm::vec3 boundMin;
+        glm::vec3 boundMax;
+    };
+
+    struct MeshEntry
+    {
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t materialIndex;
+        glm::vec3 boundMin;
+        glm::vec3 boundMax;
+    };
+
+    struct TextureEntry
+    {
+        uint64_t nameOffset;
+        uint32_t nameSize;
+        TextureKind kind;
+    };
+
+    struct EmbeddedEntry
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t width;
+        uint32_t height;
+    };
+};
+
+} // namespace guk
@@ -1,12 +1,18 @@
 #include "Model.h"
 #include "Logger.h"
+#include "TextureBaker.h"
+#include "MeshCache.h"
 
 #include <filesystem>
+#include <map>
 #include <assimp\Importer.hpp>
 #include <assimp\postprocess.h>
+#include <assimp\config.h>
 #include <glm/gtc/type_ptr.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
+#include <stb_image.h>
+#include <ktx.h>
 
 namespace guk {
 
@@ -14,7 +20,186 @@ Model::Model(std::shared_ptr<Device> device) : device_(device)
 {
 }
 
-Model Model::load(std::shared_ptr<Device> device, const std::string& file, bool normalizeModel)
+Model Model::load(std::shared_ptr<Device> device, std::shared_ptr<ThreadPool> threadPool,
+                  std::shared_ptr<AssetRegistry> registry,
+                  std::shared_ptr<TextureStreamer> streamer, const std::string& file,
+                  ImportOptions options)
+{
+    Model model = import(device, threadPool, registry, file, options);
+    model.createMeshBuffers();
+    model.releaseGeometry(options.residency);
+    model.createMaterialBuffers();
+    model.createTextures(streamer.get());
+
+    return model;
+}
+
+std::shared_ptr<ModelHandle> Model::loadAsync(std::shared_ptr<Device> device,
+                                              std::shared_ptr<ThreadPool> threadPool,
+                                              std::shared_ptr<AssetRegistry> registry,
+                                              std::shared_ptr<TextureStreamer> streamer,
+                                              const std::string& file, ImportOptions options)
+{
+    return std::make_shared<ModelHandle>(device, threadPool, registry, streamer, file, options);
+}
+
+std::vector<std::string> Model::benchmarkDecode(std::shared_ptr<Device> device,
+                                               const std::string& file)
+{
+    std::vector<std::string> results;
+    uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (uint32_t threads = 1; threads <= maxThreads;
+         threads = threads == maxThreads ? threads + 1 : std::min(threads * 2, maxThreads)) {
+        auto threadPool = std::make_shared<ThreadPool>(threads);
+        auto registry = std::make_shared<AssetRegistry>();
+
+        auto start = std::chrono::steady_clock::now();
+        Model model = import(device, threadPool, registry, file, {});
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start)
+                       .count();
+
+        results.push_back(
+            std::format("{}: import with {} threads took {:.1f} ms", model.name_, threads, ms));
+        log("{}", results.back());
+    }
+
+    return results;
+}
+
+std::vector<std::string> Model::benchmarkMeshCache(std::shared_ptr<Device> device,
+                                                  const std::string& file)
+{
+    std::vector<std::string> results;
+    std::error_code error;
+    std::filesystem::path cachePath = std::filesystem::temp_directory_path(error) /
+                                      std::filesystem::path(MeshCache::cachePath(file)).filename();
+    if (error) {
+        results.push_back(std::format("{}: no temp directory for the mesh cache benchmark: {}",
+                                      file, error.message()));
+        log("{}", results.back());
+        return results;
+    }
+    std::filesystem::remove(cachePath, error);
+    if (error) {
+        results.push_back(
+            std::format("{}: failed to remove {}: {}", file, cachePath.string(), error.message()));
+        log("{}", results.back());
+        return results;
+    }
+
+    for (const char* run : {"cold", "warm"}) {
+        auto threadPool = std::make_shared<ThreadPool>();
+        auto registry = std::make_shared<AssetRegistry>();
+
+        auto start = std::chrono::steady_clock::now();
+        Model model = import(device, threadPool, registry, file, {}, cachePath.string());
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start)
+                       .count();
+
+        results.push_back(std::format("{}: {} import took {:.1f} ms", model.name_, run, ms));
+        log("{}", results.back());
+    }
+
+    std::filesystem::remove(cachePath, error);
+    if (error) {
+        results.push_back(
+            std::format("{}: failed to remove {}: {}", file, cachePath.string(), error.message()));
+        log("{}", results.back());
+    }
+
+    return results;
+}
+
+std::vector<std::string> Model::benchmarkImport(std::shared_ptr<Device> device,
+                                                const std::string& file)
+{
+    std::vector<std::string> results;
+    auto start = std::chrono::steady_clock::now();
+    Assimp::Importer aiImporter;
+    const aiScene* scene = aiImporter.ReadFile(file, aiProcess_Triangulate);
+    if (!scene) {
+        exitLog("failed to load model: {}", file);
+    }
+    float readMs =
+        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    results.push_back(std::format("{}: assimp read took {:.1f} ms", file, readMs));
+    log("{}", results.back());
+
+    uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (uint32_t threads = 1; threads <= maxThreads;
+         threads = threads == maxThreads ? threads + 1 : std::min(threads * 2, maxThreads)) {
+        ThreadPool threadPool(threads);
+        Model model{device};
+        model.extension_ = std::filesystem::path(file).extension().string();
+
+        start = std::chrono::steady_clock::now();
+        model.processMeshes(scene, threadPool);
+        model.calculateBound(false, threadPool);
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start)
+                       .count();
+
+        size_t vertices{};
+        for (const auto& mesh : model.meshes_) {
+            vertices += mesh.vertexData().size();
+        }
+        results.push_back(
+            std::format("{}: {} meshes, {} vertices processed with {} threads in {:.1f} ms", file,
+                        model.meshes_.size(), vertices, threads, ms));
+        log("{}", results.back());
+    }
+
+    return results;
+}
+
+static uint32_t postProcessSteps(const ImportOptions& options)
+{
+    uint32_t steps{};
+    if (options.joinIdenticalVertices) {
+        steps |= aiProcess_JoinIdenticalVertices;
+    }
+    if (options.removeDegenerates) {
+        steps |= aiProcess_FindDegenerates;
+    }
+    if (options.improveCacheLocality) {
+        steps |= aiProcess_ImproveCacheLocality;
+    }
+    if (options.splitLargeMeshes) {
+        steps |= aiProcess_SplitLargeMeshes;
+    }
+    if (options.sortByPrimitiveType) {
+        steps |= aiProcess_SortByPType;
+    }
+
+    return steps;
+}
+
+// vertices, indices and their memory as the renderer stores them
+static std::string geometryStats(size_t vertices, size_t indices)
+{
+    float mb = static_cast<float>(vertices * sizeof(Vertex) + indices * sizeof(uint32_t)) /
+               (1024.f * 1024.f);
+    return std::format("{} vertices, {} indices, {:.2f} MB", vertices, indices, mb);
+}
+
+static std::string geometryStats(const aiScene* scene)
+{
+    size_t vertices{};
+    size_t indices{};
+    for (uint32_t m = 0; m < scene->mNumMeshes; m++) {
+        vertices += scene->mMeshes[m]->mNumVertices;
+        for (uint32_t f = 0; f < scene->mMeshes[m]->mNumFaces; f++) {
+            indices += scene->mMeshes[m]->mFaces[f].mNumIndices;
+        }
+    }
+
+    return geometryStats(vertices, indices);
+}
+
+Model Model::import(std::shared_ptr<Device> device, std::shared_ptr<ThreadPool> threadPool,
+                    std::shared_ptr<AssetRegistry> registry, const std::string& file,
+                    ImportOptions options, const std::string& cachePath)
 {
     Model model{device};
 
@@ -23,15 +208,84 @@ Model Model::load(std::shared_ptr<Device> device, const std::string& file, bool
     model.name_ = path.stem().string();
     model.extension_ = path.extension().string();
 
+    // another load of the same file shares its meshes, buffers and textures. residency is not
+    // part of the cache but decides what the shared meshes keep
+    bool created{};
+    uint64_t sourceHash = MeshCache::sourceHash(*registry, file, options);
+    uint64_t assetKey =
+        AssetRegistry::hash(&options.residency, sizeof(options.residency), sourceHash);
+    model.asset_ = registry->acquireModel(assetKey, file, created);
+    if (!created) {
+        model.asset_->imported.wait();
+        model.meshes_ = model.asset_->meshes;
+        model.materials_ = model.asset_->materials;
+        model.textureFiles_ = model.asset_->textureFiles;
+        model.textureKinds_ = model.asset_->textureKinds;
+        model.textures_ = model.asset_->textures;
+        model.boundMin_ = model.asset_->boundMin;
+        model.boundMax_ = model.asset_->boundMax;
+        log("{}: shared with an earlier load", model.name_);
+        return model;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // the importer and the mapping back the embedded textures until they are decoded
     Assimp::Importer aiImporter;
-    const aiScene* scene = aiImporter.ReadFile(file, aiProcess_Triangulate);
+    std::string cacheFile = cachePath.empty() ? MeshCache::cachePath(file) : cachePath;
+    std::shared_ptr<MappedFile> cache = MeshCache::read(cacheFile, sourceHash, model);
+    if (!cache) {
+        // degenerate triangles are dropped instead of becoming lines and points, which the
+        // triangle list pipelines cannot draw
+        aiImporter.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);
+        aiImporter.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE,
+                                      aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+
+        const aiScene* scene = aiImporter.ReadFile(file, aiProcess_Triangulate);
+        if (!scene) {
+            exitLog("failed to load model: {}", file);
+        }
 
-    model.processMesh(scene->mRootNode, scene, glm::mat4{1.f});
-    model.calculateBound(normalizeModel);
-    model.createMeshBuffers();
+        std::string before = geometryStats(scene);
+        scene = aiImporter.ApplyPostProcessing(postProcessSteps(options));
+        if (!scene) {
+            exitLog("failed to optimize model: {}", file);
+        }
+        log("{}: optimized from {} to {}", model.name_, before, geometryStats(scene));
 
-    model.processMaterial(scene);
-    model.createTextures(scene);
+        model.processMeshes(scene, *threadPool);
+        model.calculateBound(options.normalize, *threadPool);
+        if (options.mergeMeshes) {
+            model.mergeMeshes(options.mergeDepth);
+        }
+
+        model.processMaterial(scene);
+        model.processEmbeddedTextures(scene);
+        MeshCache::write(cacheFile, sourceHash, model);
+    }
+
+    float ms =
+        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    size_t vertices{};
+    size_t indices{};
+    for (const auto& mesh : model.meshes_) {
+        vertices += mesh.vertexData().size();
+        indices += mesh.indexData().size();
+    }
+    log("{}: {} {} meshes ({}) in {:.1f} ms", model.name_, cache ? "read cached" : "imported",
+        model.meshes_.size(), geometryStats(vertices, indices), ms);
+
+    model.decodeTextures(*threadPool, *registry);
+    model.embeddedTextures_.clear();
+
+    model.asset_->meshes = model.meshes_;
+    model.asset_->materials = model.materials_;
+    model.asset_->textureFiles = model.textureFiles_;
+    model.asset_->textureKinds = model.textureKinds_;
+    model.asset_->textures = model.textures_;
+    model.asset_->boundMin = model.boundMin_;
+    model.asset_->boundMax = model.boundMax_;
+    model.asset_->promise.set_value();
 
     return model;
 }
@@ -46,6 +300,11 @@ bool& Model::visible()
     return visible_;
 }
 
+bool Model::visible() const
+{
+    return visible_;
+}
+
 const std::vector<Mesh>& Model::meshes() const
 {
     return meshes_;
@@ -93,15 +352,45 @@ Model Model::setScale(glm::vec3 scale)
     return *this;
 }
 
-VkDescriptorSet Model::getMaterialDescriptorSets(uint32_t index) const
+VkDescriptorSet Model::getMaterialDescriptorSets(uint32_t frameIdx, uint32_t index) const
 {
-    return materialDescriptorSets_[index];
+    return materialDescriptorSets_[frameIdx][index];
+}
+
+uint32_t Model::materialFeatures(uint32_t index) const
+{
+    const MaterialUniform& m = materials_[index];
+    uint32_t features{};
+    uint32_t bit{};
+    for (int32_t textureIndex : {m.baseColorTextureIndex, m.emissiveTextureIndex,
+                                 m.normalTextureIndex, m.metallicRoughnessTextureIndex,
+                                 m.occlusionTextureIndex}) {
+        if (textureIndex >= 0) {
+            features |= 1u << bit;
+        }
+        bit++;
+    }
+    return features;
+}
+
+void Model::freeMaterialDescriptorSets()
+{
+    for (auto& descriptorSets : materialDescriptorSets_) {
+        if (descriptorSets.empty()) {
+            continue;
+        }
+
+        VK_CHECK(vkFreeDescriptorSets(device_->get(), device_->descriptorPool(),
+                                      static_cast<uint32_t>(descriptorSets.size()),
+                                      descriptorSets.data()));
+        descriptorSets.clear();
+    }
 }
 
 void Model::allocateMaterialDescriptorSets(VkDescriptorSetLayout layout,
                                            std::shared_ptr<Image2D> dummyTexture)
 {
-    materialDescriptorSets_.resize(materials_.size());
+    dummyTexture_ = dummyTexture;
 
     std::vector<VkDescriptorSetLayout> layouts(materials_.size(), layout);
 
@@ -111,7 +400,56 @@ void Model::allocateMaterialDescriptorSets(VkDescriptorSetLayout layout,
     descSetAI.descriptorSetCount = static_cast<uint32_t>(layouts.size());
     descSetAI.pSetLayouts = layouts.data();
 
-    VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, materialDescriptorSets_.data()));
+    for (auto& descriptorSets : materialDescriptorSets_) {
+        descriptorSets.resize(materials_.size());
+        VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, descriptorSets.data()));
+    }
+
+    updateMaterialDescriptorSets();
+}
+
+void Model::setTextureSampler(VkSampler sampler)
+{
+    for (auto& texture : textures_) {
+        if (texture->view()) {
+            texture->setSampler(sampler);
+        }
+    }
+
+    updateMaterialDescriptorSets();
+}
+
+void Model::requestTextures(TextureStreamer& streamer, uint32_t materialIndex,
+                            float pixels) const
+{
+    const MaterialUniform& m = materials_[materialIndex];
+    for (int32_t index : {m.baseColorTextureIndex, m.emissiveTextureIndex, m.normalTextureIndex,
+                          m.metallicRoughnessTextureIndex, m.occlusionTextureIndex}) {
+        if (index >= 0) {
+            streamer.request(textures_[index].get(), pixels);
+        }
+    }
+}
+
+void Model::updateMaterialDescriptorSets()
+{
+    for (uint32_t frameIdx = 0; frameIdx < Device::MAX_FRAMES_IN_FLIGHT; frameIdx++) {
+        updateMaterialDescriptorSets(frameIdx);
+    }
+}
+
+void Model::updateMaterialDescriptorSets(uint32_t frameIdx)
+{
+    auto imageInfo = [this](int32_t index) {
+        std::shared_ptr<Image2D> texture =
+            index < 0 || !textures_[index]->view() ? dummyTexture_ : textures_[index];
+
+        VkDescriptorImageInfo info{};
+        info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        info.imageView = texture->view();
+        info.sampler = texture->sampler();
+        return info;
+    };
 
     for (size_t i = 0; i < materials_.size(); i++) {
         const MaterialUniform& m = materials_[i];
@@ -120,87 +458,50 @@ void Model::allocateMaterialDescriptorSets(VkDescriptorSetLayout layout,
         uniformInfo.buffer = materialUniformBuffers_[i]->get();
         uniformInfo.range = sizeof(MaterialUniform);
 
-        VkDescriptorImageInfo baseColorInfo{};
-        baseColorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        baseColorInfo.imageView = m.baseColorTextureIndex < 0
-                                      ? dummyTexture->view()
-                                      : textures_[m.baseColorTextureIndex]->view();
-        baseColorInfo.sampler = m.baseColorTextureIndex < 0
-                                    ? dummyTexture->sampler()
-                                    : textures_[m.baseColorTextureIndex]->sampler();
-
-        VkDescriptorImageInfo emissiveInfo{};
-        emissiveInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        emissiveInfo.imageView = m.emissiveTextureIndex < 0
-                                     ? dummyTexture->view()
-                                     : textures_[m.emissiveTextureIndex]->view();
-        emissiveInfo.sampler = m.emissiveTextureIndex < 0
-                                   ? dummyTexture->sampler()
-                                   : textures_[m.emissiveTextureIndex]->sampler();
-
-        VkDescriptorImageInfo normalInfo{};
-        normalInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        normalInfo.imageView = m.normalTextureIndex < 0 ? dummyTexture->view()
-                                                        : textures_[m.normalTextureIndex]->view();
-        normalInfo.sampler = m.normalTextureIndex < 0 ? dummyTexture->sampler()
-                                                      : textures_[m.normalTextureIndex]->sampler();
-
-        VkDescriptorImageInfo metallicRoughnessInfo{};
-        metallicRoughnessInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        metallicRoughnessInfo.imageView = m.metallicRoughnessTextureIndex < 0
-                                              ? dummyTexture->view()
-                                              : textures_[m.metallicRoughnessTextureIndex]->view();
-        metallicRoughnessInfo.sampler = m.metallicRoughnessTextureIndex < 0
-                                            ? dummyTexture->sampler()
-                                            : textures_[m.metallicRoughnessTextureIndex]->sampler();
-
-        VkDescriptorImageInfo occlusionInfo{};
-        occlusionInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        occlusionInfo.imageView = m.occlusionTextureIndex < 0
-                                      ? dummyTexture->view()
-                                      : textures_[m.occlusionTextureIndex]->view();
-        occlusionInfo.sampler = m.occlusionTextureIndex < 0
-                                    ? dummyTexture->sampler()
-                                    : textures_[m.occlusionTextureIndex]->sampler();
+        VkDescriptorImageInfo baseColorInfo = imageInfo(m.baseColorTextureIndex);
+        VkDescriptorImageInfo emissiveInfo = imageInfo(m.emissiveTextureIndex);
+        VkDescriptorImageInfo normalInfo = imageInfo(m.normalTextureIndex);
+        VkDescriptorImageInfo metallicRoughnessInfo = imageInfo(m.metallicRoughnessTextureIndex);
+        VkDescriptorImageInfo occlusionInfo = imageInfo(m.occlusionTextureIndex);
 
         std::array<VkWriteDescriptorSet, 6> write{};
         write[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write[0].dstSet = materialDescriptorSets_[i];
+        write[0].dstSet = materialDescriptorSets_[frameIdx][i];
         write[0].dstBinding = 0;
         write[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         write[0].descriptorCount = 1;
         write[0].pBufferInfo = &uniformInfo;
 
         write[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write[1].dstSet = materialDescriptorSets_[i];
+        write[1].dstSet = materialDescriptorSets_[frameIdx][i];
         write[1].dstBinding = 1;
         write[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         write[1].descriptorCount = 1;
         write[1].pImageInfo = &baseColorInfo;
 
         write[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write[2].dstSet = materialDescriptorSets_[i];
+        write[2].dstSet = materialDescriptorSets_[frameIdx][i];
         write[2].dstBinding = 2;
         write[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         write[2].descriptorCount = 1;
         write[2].pImageInfo = &emissiveInfo;
 
         write[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write[3].dstSet = materialDescriptorSets_[i];
+        write[3].dstSet = materialDescriptorSets_[frameIdx][i];
         write[3].dstBinding = 3;
         write[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         write[3].descriptorCount = 1;
         write[3].pImageInfo = &normalInfo;
 
         write[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write[4].dstSet = materialDescriptorSets_[i];
+        write[4].dstSet = materialDescriptorSets_[frameIdx][i];
         write[4].dstBinding = 4;
         write[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         write[4].descriptorCount = 1;
         write[4].pImageInfo = &metallicRoughnessInfo;
 
         write[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write[5].dstSet = materialDescriptorSets_[i];
+        write[5].dstSet = materialDescriptorSets_[frameIdx][i];
         write[5].dstBinding = 5;
         write[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         write[5].descriptorCount = 1;
@@ -221,68 +522,110 @@ glm::vec3 Model::boundMax() const
     return boundMax_;
 }
 
-void Model::processMesh(aiNode* node, const aiScene* scene, glm::mat4 matrix)
+void Model::collectMeshes(aiNode* node, const aiScene* scene, glm::mat4 matrix,
+                          std::vector<std::pair<const aiMesh*, glm::mat4>>& meshes) const
 {
     matrix *= glm::transpose(glm::make_mat4(&node->mTransformation.a1));
 
     for (uint32_t i = 0; i < node->mNumMeshes; i++) {
-        aiMesh* aiMesh = scene->mMeshes[node->mMeshes[i]];
-        Mesh mesh{device_};
+        meshes.push_back({scene->mMeshes[node->mMeshes[i]], matrix});
+    }
 
-        for (uint32_t i = 0; i < aiMesh->mNumVertices; i++) {
-            Vertex vertex{};
+    for (uint32_t i = 0; i < node->mNumChildren; i++) {
+        collectMeshes(node->mChildren[i], scene, matrix, meshes);
+    }
+}
 
-            vertex.position.x = aiMesh->mVertices[i].x;
-            vertex.position.y = aiMesh->mVertices[i].y;
-            vertex.position.z = aiMesh->mVertices[i].z;
-            vertex.position = glm::vec3(glm::vec4(vertex.position, 1.f) * matrix);
+void Model::processMeshes(const aiScene* scene, ThreadPool& threadPool)
+{
+    std::vector<std::pair<const aiMesh*, glm::mat4>> aiMeshes;
+    collectMeshes(scene->mRootNode, scene, glm::mat4{1.f}, aiMeshes);
 
-            vertex.normal.x = aiMesh->mNormals[i].x;
-            if (extension_ == ".glb") {
-                vertex.normal.y = aiMesh->mNormals[i].z;
-                vertex.normal.z = -aiMesh->mNormals[i].y;
-            } else {
-                vertex.normal.y = aiMesh->mNormals[i].y;
-                vertex.normal.z = aiMesh->mNormals[i].z;
-            }
+    for (size_t i = 0; i < aiMeshes.size(); i++) {
+        meshes_.emplace_back(device_);
+    }
 
-            if (aiMesh->mTextureCoords[0]) {
-                vertex.texcoord.x = (float)aiMesh->mTextureCoords[0][i].x;
-                vertex.texcoord.y = 1.0f - (float)aiMesh->mTextureCoords[0][i].y;
+    bool glb = extension_ == ".glb";
+
+    // every mesh converts, builds tangents and bounds on its own worker
+    std::vector<std::future<void>> jobs;
+    for (size_t m = 0; m < aiMeshes.size(); m++) {
+        jobs.push_back(threadPool.submit([this, &aiMeshes, glb, m]() {
+            const auto& [aiMesh, matrix] = aiMeshes[m];
+            const aiVector3D* positions = aiMesh->mVertices;
+            const aiVector3D* normals = aiMesh->mNormals;
+            const aiVector3D* texcoords = aiMesh->mTextureCoords[0];
+
+            std::vector<Vertex> vertices(aiMesh->mNumVertices);
+            for (uint32_t i = 0; i < aiMesh->mNumVertices; i++) {
+                vertices[i].position =
+                    glm::vec3(glm::vec4(positions[i].x, positions[i].y, positions[i].z, 1.f) *
+                              matrix);
             }
 
-            mesh.addVertex(vertex);
-        }
-
-        for (uint32_t i = 0; i < aiMesh->mNumFaces; i++) {
-            aiFace face = aiMesh->mFaces[i];
-            for (uint32_t j = 0; j < face.mNumIndices; j++) {
+            if (glb) {
+                for (uint32_t i = 0; i < aiMesh->mNumVertices; i++) {
+                    vertices[i].normal = glm::vec3(normals[i].x, normals[i].z, -normals[i].y);
+                }
+            } else {
+                for (uint32_t i = 0; i < aiMesh->mNumVertices; i++) {
+                    vertices[i].normal = glm::vec3(normals[i].x, normals[i].y, normals[i].z);
+                }
+            }
 
-                mesh.addIndex(face.mIndices[j]);
+            if (texcoords) {
+                for (uint32_t i = 0; i < aiMesh->mNumVertices; i++) {
+                    vertices[i].texcoord = glm::vec2(texcoords[i].x, 1.f - texcoords[i].y);
+                }
             }
-        }
 
-        mesh.calculateTangents();
-        mesh.calculateBound();
-        mesh.setMaterialIndex(aiMesh->mMaterialIndex);
+            std::vector<uint32_t> indices;
+            indices.reserve(static_cast<size_t>(aiMesh->mNumFaces) * 3);
+            for (uint32_t i = 0; i < aiMesh->mNumFaces; i++) {
+                const aiFace& face = aiMesh->mFaces[i];
+                indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
+            }
 
-        meshes_.push_back(mesh);
+            Mesh& mesh = meshes_[m];
+            mesh.setGeometry(std::move(vertices), std::move(indices));
+            mesh.calculateTangents();
+            mesh.calculateBound();
+            mesh.setMaterialIndex(aiMesh->mMaterialIndex);
+        }));
     }
 
-    for (uint32_t i = 0; i < node->mNumChildren; i++) {
-        processMesh(node->mChildren[i], scene, matrix);
+    for (auto& job : jobs) {
+        job.get();
     }
 }
 
 void Model::createMeshBuffers()
 {
     for (auto& mesh : meshes_) {
+        if (mesh.getVertexBuffer()) {
+            continue;
+        }
         mesh.createVertexBuffer();
         mesh.createIndexBuffer();
     }
 }
 
-void Model::calculateBound(bool normalizeModel)
+void Model::releaseGeometry(GeometryResidency residency)
+{
+    size_t before{};
+    size_t after{};
+    for (auto& mesh : meshes_) {
+        before += mesh.hostSize();
+        mesh.releaseGeometry(residency);
+        after += mesh.hostSize();
+    }
+
+    log("{}: released {:.2f} MB of cpu geometry, {:.2f} MB kept", name_,
+        static_cast<float>(before - after) / (1024.f * 1024.f),
+        static_cast<float>(after) / (1024.f * 1024.f));
+}
+
+void Model::calculateBound(bool normalizeModel, ThreadPool& threadPool)
 {
     boundMin_ = glm::vec3(std::numeric_limits<float>::max());
     boundMax_ = glm::vec3(std::numeric_limits<float>::lowest());
@@ -296,12 +639,20 @@ void Model::calculateBound(bool normalizeModel)
         glm::vec3 center = (boundMax_ + boundMin_) * 0.5f;
         float delta = glm::compMax(boundMax_ - boundMin_);
 
+        std::vector<std::future<void>> jobs;
         for (auto& mesh : meshes_) {
-            for (auto& vertex : mesh.vertices()) {
-                vertex.position = (vertex.position - center) / delta;
-            }
+            jobs.push_back(threadPool.submit([&mesh, center, delta]() {
+                for (auto& vertex : mesh.vertices()) {
+                    vertex.position = (vertex.position - center) / delta;
+                }
 
-            mesh.setBounds((mesh.boundMin() - center) / delta, (mesh.boundMax() - center) / delta);
+                mesh.setBounds((mesh.boundMin() - center) / delta,
+                               (mesh.boundMax() - center) / delta);
+            }));
+        }
+
+        for (auto& job : jobs) {
+            job.get();
         }
 
         boundMin_ = (boundMin_ - center) / delta;
@@ -309,6 +660,71 @@ void Model::calculateBound(bool normalizeModel)
     }
 }
 
+void Model::mergeMeshes(uint32_t depth)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // batches keep culling effective by never spanning more than one octree cell
+    uint32_t cells = 1u << depth;
+    glm::vec3 cellSize = glm::max((boundMax_ - boundMin_) / static_cast<float>(cells),
+                                  glm::vec3(1e-6f));
+
+    std::map<std::pair<uint32_t, uint32_t>, std::vector<size_t>> batches;
+    for (size_t i = 0; i < meshes_.size(); i++) {
+        glm::vec3 center = (meshes_[i].boundMin() + meshes_[i].boundMax()) * 0.5f;
+        glm::uvec3 cell(glm::clamp(glm::ivec3((center - boundMin_) / cellSize), glm::ivec3(0),
+                                   glm::ivec3(cells - 1)));
+        uint32_t cellIndex = cell.x + cells * (cell.y + cells * cell.z);
+        batches[{meshes_[i].getMaterialIndex(), cellIndex}].push_back(i);
+    }
+
+    std::vector<Mesh> merged;
+    for (const auto& [key, batch] : batches) {
+        if (batch.size() == 1) {
+            merged.push_back(std::move(meshes_[batch[0]]));
+            continue;
+        }
+
+        size_t vertexCount{};
+        size_t indexCount{};
+        for (size_t i : batch) {
+            vertexCount += meshes_[i].vertexData().size();
+            indexCount += meshes_[i].indexData().size();
+        }
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        vertices.reserve(vertexCount);
+        indices.reserve(indexCount);
+        glm::vec3 boundMin(std::numeric_limits<float>::max());
+        glm::vec3 boundMax(std::numeric_limits<float>::lowest());
+
+        for (size_t i : batch) {
+            const Mesh& mesh = meshes_[i];
+            uint32_t base = static_cast<uint32_t>(vertices.size());
+            vertices.insert(vertices.end(), mesh.vertexData().begin(), mesh.vertexData().end());
+            for (uint32_t index : mesh.indexData()) {
+                indices.push_back(base + index);
+            }
+            boundMin = glm::min(boundMin, mesh.boundMin());
+            boundMax = glm::max(boundMax, mesh.boundMax());
+        }
+
+        Mesh mesh{device_};
+        mesh.setGeometry(std::move(vertices), std::move(indices));
+        mesh.setBounds(boundMin, boundMax);
+        mesh.setMaterialIndex(key.first);
+        merged.push_back(std::move(mesh));
+    }
+
+    float ms =
+        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    log("{}: merged {} meshes into {} batches ({} cells) in {:.1f} ms", name_, meshes_.size(),
+        merged.size(), cells * cells * cells, ms);
+
+    meshes_ = std::move(merged);
+}
+
 void Model::processMaterial(const aiScene* scene)
 {
     for (uint32_t i = 0; i < scene->mNumMaterials; i++) {
@@ -338,27 +754,33 @@ void Model::processMaterial(const aiScene* scene)
         aiString path;
 
         if (aiMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS) {
-            material.baseColorTextureIndex = getTextureIndex(path.C_Str(), true);
+            material.baseColorTextureIndex = getTextureIndex(path.C_Str(), TextureKind::Color);
         }
 
         if (aiMaterial->GetTexture(aiTextureType_GLTF_METALLIC_ROUGHNESS, 0, &path) == AI_SUCCESS) {
-            material.metallicRoughnessTextureIndex = getTextureIndex(path.C_Str(), false);
+            material.metallicRoughnessTextureIndex =
+                getTextureIndex(path.C_Str(), TextureKind::MetallicRoughness);
         }
 
         if (aiMaterial->GetTexture(aiTextureType_NORMALS, 0, &path) == AI_SUCCESS) {
-            material.normalTextureIndex = getTextureIndex(path.C_Str(), false);
+            material.normalTextureIndex = getTextureIndex(path.C_Str(), TextureKind::Normal);
         }
 
         if (aiMaterial->GetTexture(aiTextureType_LIGHTMAP, 0, &path) == AI_SUCCESS) {
-            material.occlusionTextureIndex = getTextureIndex(path.C_Str(), false);
+            material.occlusionTextureIndex = getTextureIndex(path.C_Str(), TextureKind::Occlusion);
         }
 
         if (aiMaterial->GetTexture(aiTextureType_EMISSIVE, 0, &path) == AI_SUCCESS) {
-            material.emissiveTextureIndex = getTextureIndex(path.C_Str(), true);
+            material.emissiveTextureIndex = getTextureIndex(path.C_Str(), TextureKind::Color);
         }
 
         materials_.push_back(material);
+    }
+}
 
+void Model::createMaterialBuffers()
+{
+    for (const auto& material : materials_) {
         std::shared_ptr<Buffer> uniformBuffer = std::make_shared<Buffer>(device_);
         uniformBuffer->createUniformBuffer(sizeof(MaterialUniform));
         uniformBuffer->update(material);
@@ -367,56 +789,380 @@ void Model::processMaterial(const aiScene* scene)
     }
 }
 
-uint32_t Model::getTextureIndex(const std::string& textureFile, bool srgb)
+uint32_t Model::getTextureIndex(const std::string& textureFile, TextureKind kind)
 {
     auto it = std::find(textureFiles_.begin(), textureFiles_.end(), textureFile);
 
     if (it != textureFiles_.end()) {
-        return static_cast<uint32_t>(std::distance(textureFiles_.begin(), it));
+        uint32_t index = static_cast<uint32_t>(std::distance(textureFiles_.begin(), it));
+        // one file sampled two ways (packed occlusion/metallic/roughness) keeps all channels
+        if (textureKinds_[index] != kind) {
+            textureKinds_[index] = TextureKind::Linear;
+        }
+        return index;
     } else {
         textureFiles_.push_back(textureFile);
-        textureSrgb_.push_back(srgb);
+        textureKinds_.push_back(kind);
         return static_cast<uint32_t>(textureFiles_.size() - 1);
     }
 }
 
-void Model::createTextures(const aiScene* scene)
+void Model::processEmbeddedTextures(const aiScene* scene)
+{
+    for (uint32_t i = 0; i < scene->mNumTextures; i++) {
+        const aiTexture* aiTex = scene->mTextures[i];
+        size_t size = aiTex->mHeight == 0
+                          ? aiTex->mWidth
+                          : static_cast<size_t>(aiTex->mWidth) * aiTex->mHeight * sizeof(aiTexel);
+        embeddedTextures_.push_back({aiTex->pcData, size, aiTex->mWidth, aiTex->mHeight});
+    }
+}
+
+void Model::decodeTextures(ThreadPool& threadPool, AssetRegistry& registry)
 {
+    if (textureFiles_.empty()) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // content keys, textures already in the registry are shared instead of decoded again
+    std::vector<uint64_t> keys(textureFiles_.size());
+    std::vector<std::future<void>> hashes;
     for (uint32_t i = 0; i < textureFiles_.size(); i++) {
-        std::shared_ptr<Image2D> texture = std::make_shared<Image2D>(device_);
+        hashes.push_back(threadPool.submit([this, &registry, &keys, i]() {
+            const std::string& file = textureFiles_[i];
+            if (file[0] == '*') {
+                const EmbeddedTexture& embedded = embeddedTextures_[std::stoi(file.substr(1))];
+                keys[i] = AssetRegistry::hash(embedded.data, embedded.size);
+            } else {
+                keys[i] = registry.fileHash(directory_ + file);
+            }
+            keys[i] = AssetRegistry::hash(&textureKinds_[i], sizeof(TextureKind), keys[i]);
+        }));
+    }
+
+    for (auto& hash : hashes) {
+        hash.get();
+    }
 
-        std::string file = textureFiles_[i];
-        if (file[0] == '*') {
-            int texIdx = std::stoi(file.substr(1));
-            const aiTexture* aiTex = scene->mTextures[texIdx];
+    uint32_t shared{};
+    for (uint32_t i = 0; i < textureFiles_.size(); i++) {
+        bool created{};
+        textures_.push_back(registry.acquireTexture(device_, keys[i], textureFiles_[i], created));
+        textureRegions_.push_back({});
+        textureRegions_[i].owned = created;
+        shared += created ? 0 : 1;
+    }
+
+    if (shared == textureFiles_.size()) {
+        log("{}: all {} textures shared", name_, shared);
+        return;
+    }
 
-            if (aiTex->mHeight == 0) {
-                texture->createTextureFromMemory(reinterpret_cast<unsigned char*>(aiTex->pcData),
-                                                 aiTex->mWidth, textureSrgb_[i]);
+    // headers first so every texture gets its slice of one staging buffer
+    VkDeviceSize size{};
+    VkDeviceSize rgba8Size{};
+    uint32_t baked{};
+    for (uint32_t i = 0; i < textureFiles_.size(); i++) {
+        TextureRegion& region = textureRegions_[i];
+        if (!region.owned) {
+            continue;
+        }
+
+        if (readBakedHeader(i, region)) {
+            baked++;
+        } else {
+            readImageHeader(i, region);
+        }
+
+        // block compressed copies need offsets aligned to the block size
+        region.offset = (size + 15) / 16 * 16;
+        size = region.offset + region.size;
+        rgba8Size += static_cast<VkDeviceSize>(region.width) * region.height * 4;
+    }
+
+    textureStaging_ = std::make_shared<Buffer>(device_);
+    textureStaging_->createStagingBuffer(size);
+    unsigned char* staging = static_cast<unsigned char*>(textureStaging_->mapped());
+
+    std::vector<std::future<void>> decodes;
+    for (uint32_t i = 0; i < textureFiles_.size(); i++) {
+        if (!textureRegions_[i].owned) {
+            continue;
+        }
+        decodes.push_back(threadPool.submit([this, staging, i]() {
+            unsigned char* dst = staging + textureRegions_[i].offset;
+            if (textureRegions_[i].baked.empty()) {
+                decodeImage(i, dst);
             } else {
-                int width = aiTex->mWidth;
-                int height = aiTex->mHeight;
-                int channels = 4;
-                unsigned char* data = new unsigned char[width * height * channels];
-
-                for (int i = 0; i < width * height; i++) {
-                    data[i * channels + 0] = aiTex->pcData[i].r;
-                    data[i * channels + 1] = aiTex->pcData[i].g;
-                    data[i * channels + 2] = aiTex->pcData[i].b;
-                    data[i * channels + 3] = aiTex->pcData[i].a;
-                }
+                transcodeBaked(i, dst);
+            }
+        }));
+    }
+
+    for (auto& decode : decodes) {
+        decode.get();
+    }
+
+    VkDeviceSize vramSize{};
+    for (const auto& region : textureRegions_) {
+        vramSize += region.levelSizes.empty() ? region.size * 4 / 3 : region.size;
+    }
+
+    float ms =
+        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    log("{}: decoded {} textures, {:.1f} MB in {:.1f} ms ({:.1f} MB/s, {} threads)", name_,
+        decodes.size(), size / 1048576.0, ms, size / 1048576.0 / (ms * 1e-3),
+        threadPool.size());
+    log("{}: {} of {} textures baked, {} shared, {:.1f} MB in vram ({:.1f} MB as rgba8)", name_,
+        baked, textureFiles_.size(), shared, vramSize / 1048576.0,
+        rgba8Size * 4 / 3 / 1048576.0);
+}
+
+bool Model::readBakedHeader(uint32_t index, TextureRegion& region) const
+{
+    std::string baked = TextureBaker::bakedPath(directory_, name_, textureFiles_[index]);
+    if (!std::filesystem::exists(baked)) {
+        return false;
+    }
+
+    ktxTexture2* texture;
+    if (ktxTexture2_CreateFromNamedFile(baked.c_str(), KTX_TEXTURE_CREATE_NO_FLAGS, &texture) !=
+        KTX_SUCCESS) {
+        log("failed to read {}, decoding the source image", baked);
+        return false;
+    }
+
+    TextureKind kind = textureKinds_[index];
+    region.baked = baked;
+    region.width = texture->baseWidth;
+    region.height = texture->baseHeight;
+    region.format = TextureBaker::transcodeFormat(kind, device_->textureCompressionBC());
+    if (kind == TextureKind::MetallicRoughness) {
+        // baked as roughness/metallic in red/green, sampled from green/blue
+        region.components = {VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_R,
+                             VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_ONE};
+    }
+
+    for (uint32_t level = 0; level < texture->numLevels; level++) {
+        VkDeviceSize levelSize = TextureBaker::levelSize(region.format, region.width >> level,
+                                                         region.height >> level);
+        region.levelSizes.push_back(levelSize);
+        region.size += levelSize;
+    }
+
+    ktxTexture_Destroy(ktxTexture(texture));
+    return true;
+}
+
+void Model::readImageHeader(uint32_t index, TextureRegion& region) const
+{
+    const std::string& file = textureFiles_[index];
+    int width{}, height{}, ch{};
 
-                texture->createTexture(data, width, height, channels, textureSrgb_[i]);
+    if (file[0] == '*') {
+        const EmbeddedTexture& embedded = embeddedTextures_[std::stoi(file.substr(1))];
 
-                delete[] data;
+        if (embedded.height == 0) {
+            stbi_info_from_memory(static_cast<const stbi_uc*>(embedded.data),
+                                  static_cast<int>(embedded.size), &width, &height, &ch);
+        } else {
+            width = embedded.width;
+            height = embedded.height;
+        }
+    } else {
+        stbi_info((directory_ + file).c_str(), &width, &height, &ch);
+    }
+
+    if (width <= 0 || height <= 0) {
+        exitLog("failed to load image: {}", file);
+    }
+
+    region.width = width;
+    region.height = height;
+    region.size = static_cast<VkDeviceSize>(width) * static_cast<VkDeviceSize>(height) * 4;
+}
+
+void Model::transcodeBaked(uint32_t index, unsigned char* dst) const
+{
+    const TextureRegion& region = textureRegions_[index];
+
+    ktxTexture2* texture;
+    if (ktxTexture2_CreateFromNamedFile(region.baked.c_str(),
+                                        KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
+                                        &texture) != KTX_SUCCESS) {
+        exitLog("failed to load baked texture: {}", region.baked);
+    }
+
+    if (ktxTexture2_NeedsTranscoding(texture) &&
+        ktxTexture2_TranscodeBasis(texture,
+                                   TextureBaker::transcodeTarget(textureKinds_[index],
+                                                                 device_->textureCompressionBC()),
+                                   0) != KTX_SUCCESS) {
+        exitLog("failed to transcode baked texture: {}", region.baked);
+    }
+
+    const unsigned char* levels = dst;
+    for (uint32_t level = 0; level < region.levelSizes.size(); level++) {
+        ktx_size_t offset{};
+        ktxTexture_GetImageOffset(ktxTexture(texture), level, 0, 0, &offset);
+        ktx_size_t size = ktxTexture_GetImageSize(ktxTexture(texture), level);
+        if (size != region.levelSizes[level]) {
+            exitLog("unexpected level size in baked texture: {}", region.baked);
+        }
+
+        memcpy(dst, ktxTexture_GetData(ktxTexture(texture)) + offset, size);
+        dst += size;
+    }
+
+    ktxTexture_Destroy(ktxTexture(texture));
+
+    // the streamer reads the finer levels back from this file instead of keeping them in memory
+    if (!TextureStreamer::readLevels(region.baked, region.format, region.size)) {
+        TextureStreamer::writeLevels(region.baked, region.format, levels, region.size);
+    }
+}
+
+void Model::decodeImage(uint32_t index, unsigned char* dst) const
+{
+    const std::string& file = textureFiles_[index];
+    const TextureRegion& region = textureRegions_[index];
+    int width{}, height{}, ch{};
+    unsigned char* data{};
+
+    if (file[0] == '*') {
+        const EmbeddedTexture& embedded = embeddedTextures_[std::stoi(file.substr(1))];
+
+        if (embedded.height != 0) {
+            const aiTexel* texels = static_cast<const aiTexel*>(embedded.data);
+            for (uint32_t i = 0; i < region.width * region.height; i++) {
+                dst[i * 4 + 0] = texels[i].r;
+                dst[i * 4 + 1] = texels[i].g;
+                dst[i * 4 + 2] = texels[i].b;
+                dst[i * 4 + 3] = texels[i].a;
             }
+            return;
+        }
+
+        data = stbi_load_from_memory(static_cast<const stbi_uc*>(embedded.data),
+                                     static_cast<int>(embedded.size), &width, &height, &ch,
+                                     STBI_rgb_alpha);
+    } else {
+        data = stbi_load((directory_ + file).c_str(), &width, &height, &ch, STBI_rgb_alpha);
+    }
+
+    if (!data) {
+        exitLog("failed to load image: {}", file);
+    }
+
+    memcpy(dst, data, static_cast<size_t>(region.size));
+    stbi_image_free(data);
+}
+
+void Model::createTextures(TextureStreamer* streamer)
+{
+    if (!textureStaging_) {
+        return;
+    }
+
+    // shared textures are uploaded by the model that created them
+    VkCommandBuffer cmd = device_->beginCmd();
+    for (uint32_t i = 0; i < textures_.size(); i++) {
+        const TextureRegion& region = textureRegions_[i];
+        if (!region.owned) {
+            continue;
+        }
+        if (region.levelSizes.empty()) {
+            textures_[i]->createTexture(cmd, textureStaging_->get(), region.offset, region.width,
+                                        region.height, textureKinds_[i] == TextureKind::Color);
+        } else if (streamer) {
+            const unsigned char* texels =
+                static_cast<const unsigned char*>(textureStaging_->mapped()) + region.offset;
+            streamer->add(cmd, textureStaging_->get(), region.offset, textures_[i], region.baked,
+                          texels, region.format, region.width, region.height,
+                          region.levelSizes, region.components);
         } else {
-            texture->createTexture(directory_ + file, textureSrgb_[i]);
+            textures_[i]->createTexture(cmd, textureStaging_->get(), region.offset, region.format,
+                                        region.width, region.height, region.levelSizes,
+                                        region.components);
         }
+        textures_[i]->setSampler(device_->samplerLinearRepeat());
+    }
+    device_->submitWait(cmd);
+
+    textureStaging_.reset();
+}
+
+ModelHandle::ModelHandle(std::shared_ptr<Device> device, std::shared_ptr<ThreadPool> threadPool,
+                         std::shared_ptr<AssetRegistry> registry,
+                         std::shared_ptr<TextureStreamer> streamer, const std::string& file,
+                         ImportOptions options)
+    : model_(device), import_(std::async(std::launch::async, &Model::import, device, threadPool,
+                                         registry, file, options, std::string{})),
+      streamer_(streamer), residency_(options.residency)
+{
+}
 
-        texture->setSampler(device_->samplerLinearRepeat());
-        textures_.push_back(texture);
+Model& ModelHandle::model()
+{
+    return model_;
+}
+
+bool ModelHandle::geometryReady() const
+{
+    return geometryReady_;
+}
+
+bool ModelHandle::texturesReady() const
+{
+    return texturesReady_;
+}
+
+bool ModelHandle::upload(std::chrono::steady_clock::time_point deadline)
+{
+    if (import_.valid()) {
+        if (import_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+
+        Model imported = import_.get();
+        imported.translation_ = model_.translation_;
+        imported.rotation_ = model_.rotation_;
+        imported.scale_ = model_.scale_;
+        imported.visible_ = model_.visible_;
+        model_ = std::move(imported);
+    }
+
+    // at least one mesh per call so loading always makes progress
+    while (uploadedMeshes_ < model_.meshes_.size()) {
+        Mesh& mesh = model_.meshes_[uploadedMeshes_++];
+        if (mesh.getVertexBuffer()) {
+            continue;
+        }
+        mesh.createVertexBuffer();
+        mesh.createIndexBuffer();
+
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+    }
+
+    if (!geometryReady_) {
+        model_.releaseGeometry(residency_);
+        model_.createMaterialBuffers();
+        geometryReady_ = true;
+        return false;
+    }
+
+    // decoded texels are already staged, all textures go up in one submit
+    if (!texturesReady_) {
+        model_.createTextures(streamer_.get());
+        texturesReady_ = true;
+        return true;
     }
+
+    return false;
 }
 
 } // namespace guk
@@ -3,22 +3,52 @@
 #include "Device.h"
 #include "Mesh.h"
 #include "Image2D.h"
+#include "ThreadPool.h"
+#include "AssetRegistry.h"
+#include "TextureStreamer.h"
 #include "DataStructures.h"
 
 #include <assimp\scene.h>
 #include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <future>
 
 namespace guk {
 
+class ModelHandle;
+
 class Model
 {
   public:
     Model(std::shared_ptr<Device> device);
 
-    static Model load(std::shared_ptr<Device> device, const std::string& file, bool normalizeModel = false);
+    static Model load(std::shared_ptr<Device> device, std::shared_ptr<ThreadPool> threadPool,
+                      std::shared_ptr<AssetRegistry> registry,
+                      std::shared_ptr<TextureStreamer> streamer, const std::string& file,
+                      ImportOptions options = {});
+    // imports on a worker thread, the handle uploads it on the calling thread piece by piece
+    static std::shared_ptr<ModelHandle> loadAsync(std::shared_ptr<Device> device,
+                                                  std::shared_ptr<ThreadPool> threadPool,
+                                                  std::shared_ptr<AssetRegistry> registry,
+                                                  std::shared_ptr<TextureStreamer> streamer,
+                                                  const std::string& file,
+                                                  ImportOptions options = {});
+    // the benchmarks log their results and return them line by line. they block for seconds,
+    // run them off the render thread
+    // decodes the textures of file with 1..hardware_concurrency threads and logs the throughput
+    static std::vector<std::string> benchmarkDecode(std::shared_ptr<Device> device,
+                                                    const std::string& file);
+    // imports file without and then with a mesh cache in the temp directory and logs both times,
+    // the cache next to file may be mapped by a loaded copy of the model
+    static std::vector<std::string> benchmarkMeshCache(std::shared_ptr<Device> device,
+                                                       const std::string& file);
+    // converts the meshes of file (tangents, bounds) with 1..hardware_concurrency threads
+    static std::vector<std::string> benchmarkImport(std::shared_ptr<Device> device,
+                                                    const std::string& file);
 
     std::string name() const;
     bool& visible();
+    bool visible() const;
     const std::vector<Mesh>& meshes() const;
     glm::mat4 matrix() const;
 
@@ -29,14 +59,56 @@ class Model
     glm::vec3 getScale() const;
     Model setScale(glm::vec3 scale);
 
-    VkDescriptorSet getMaterialDescriptorSets(uint32_t index) const;
+    // one set per frame in flight, so a frame can be pointed at new images while the other
+    // one may still read the old ones
+    VkDescriptorSet getMaterialDescriptorSets(uint32_t frameIdx, uint32_t index) const;
+    // bit i set when texture i of the material is present, in the order of MaterialUniform
+    uint32_t materialFeatures(uint32_t index) const;
+    // once no copy of the model is drawn anymore
+    void freeMaterialDescriptorSets();
+    // textures not uploaded yet are substituted by dummyTexture
     void allocateMaterialDescriptorSets(VkDescriptorSetLayout layout,
                                         std::shared_ptr<Image2D> dummyTexture);
+    // all frames, when none of them is in flight
+    void updateMaterialDescriptorSets();
+    // after the last use of the sets of frameIdx finished
+    void updateMaterialDescriptorSets(uint32_t frameIdx);
+    void setTextureSampler(VkSampler sampler);
+    // screen space feedback for the textures of a material drawn about pixels wide
+    void requestTextures(TextureStreamer& streamer, uint32_t materialIndex, float pixels) const;
 
     glm::vec3 boundMin() const;
     glm::vec3 boundMax() const;
 
   private:
+    friend class ModelHandle;
+    friend class MeshCache;
+
+    struct TextureRegion
+    {
+        VkDeviceSize offset{};
+        VkDeviceSize size{};
+        uint32_t width{};
+        uint32_t height{};
+
+        // baked textures are transcoded on load, levelSizes holds their whole mip chain
+        std::string baked;
+        VkFormat format{};
+        std::vector<VkDeviceSize> levelSizes;
+        VkComponentMapping components{};
+        // false when the texture came from the registry and someone else uploads it
+        bool owned{};
+    };
+
+    // as assimp stores it, compressed image file when height is 0, else aiTexel rows
+    struct EmbeddedTexture
+    {
+        const void* data{};
+        size_t size{};
+        uint32_t width{};
+        uint32_t height{};
+    };
+
     std::shared_ptr<Device> device_;
 
     std::string name_{};
@@ -51,22 +123,73 @@ class Model
     std::vector<Mesh> meshes_{};
     std::vector<MaterialUniform> materials_;
     std::vector<std::shared_ptr<Buffer>> materialUniformBuffers_;
-    std::vector<VkDescriptorSet> materialDescriptorSets_{};
+    std::array<std::vector<VkDescriptorSet>, Device::MAX_FRAMES_IN_FLIGHT>
+        materialDescriptorSets_{};
 
     std::vector<std::shared_ptr<Image2D>> textures_;
     std::vector<std::string> textureFiles_;
-    std::vector<bool> textureSrgb_;
+    std::vector<TextureKind> textureKinds_;
+    std::vector<TextureRegion> textureRegions_;
+    std::shared_ptr<Buffer> textureStaging_;
+    std::shared_ptr<Image2D> dummyTexture_;
+    // only valid while importing, points into the assimp scene or the mesh cache
+    std::vector<EmbeddedTexture> embeddedTextures_;
 
     glm::vec3 boundMin_{};
     glm::vec3 boundMax_{};
 
-    void processMesh(aiNode* node, const aiScene* scene, glm::mat4 matrix);
+    std::shared_ptr<ModelAsset> asset_;
+
+    // cpu side only, safe to run off the render thread. the mesh cache is read from and written
+    // to cachePath, next to file when empty
+    static Model import(std::shared_ptr<Device> device, std::shared_ptr<ThreadPool> threadPool,
+                        std::shared_ptr<AssetRegistry> registry, const std::string& file,
+                        ImportOptions options, const std::string& cachePath = {});
+
+    void collectMeshes(aiNode* node, const aiScene* scene, glm::mat4 matrix,
+                       std::vector<std::pair<const aiMesh*, glm::mat4>>& meshes) const;
+    void processMeshes(const aiScene* scene, ThreadPool& threadPool);
     void createMeshBuffers();
-    void calculateBound(bool normalizeModel);
+    void releaseGeometry(GeometryResidency residency);
+    void calculateBound(bool normalizeModel, ThreadPool& threadPool);
+    void mergeMeshes(uint32_t depth);
 
     void processMaterial(const aiScene* scene);
-    uint32_t getTextureIndex(const std::string& textureFile, bool srgb);
-    void createTextures(const aiScene* scene);
+    void createMaterialBuffers();
+    uint32_t getTextureIndex(const std::string& textureFile, TextureKind kind);
+    void processEmbeddedTextures(const aiScene* scene);
+    void decodeTextures(ThreadPool& threadPool, AssetRegistry& registry);
+    bool readBakedHeader(uint32_t index, TextureRegion& region) const;
+    void readImageHeader(uint32_t index, TextureRegion& region) const;
+    void transcodeBaked(uint32_t index, unsigned char* dst) const;
+    void decodeImage(uint32_t index, unsigned char* dst) const;
+    // baked textures are handed to streamer when given, only their mip tail is uploaded
+    void createTextures(TextureStreamer* streamer);
+};
+
+class ModelHandle
+{
+  public:
+    ModelHandle(std::shared_ptr<Device> device, std::shared_ptr<ThreadPool> threadPool,
+                std::shared_ptr<AssetRegistry> registry, std::shared_ptr<TextureStreamer> streamer,
+                const std::string& file, ImportOptions options);
+
+    // transform setters may be used while importing, they are carried over to the import
+    Model& model();
+    bool geometryReady() const;
+    bool texturesReady() const;
+
+    // returns true when textures were uploaded and descriptor sets need updating
+    bool upload(std::chrono::steady_clock::time_point deadline);
+
+  private:
+    Model model_;
+    std::future<Model> import_;
+    std::shared_ptr<TextureStreamer> streamer_;
+    GeometryResidency residency_{};
+    size_t uploadedMeshes_{};
+    bool geometryReady_{};
+    bool texturesReady_{};
 };
 
 } // namespace guk
\ No newline at end of file
@@ -0,0 +1,567 @@
+#include "RenderGraph.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include <tuple>
+#include <unordered_set>
+
+namespace guk {
+
+static constexpr VkAccessFlags2 WRITE_ACCESS =
+    VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+static constexpr VkPipelineStageFlags2 COMPUTE_QUEUE_STAGES =
+    VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT | VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT |
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT |
+    VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+static constexpr uint32_t GRAPHICS_QUEUE{1};
+static constexpr uint32_t COMPUTE_QUEUE{2};
+
+static void pipelineBarrier(VkCommandBuffer cmd, const std::vector<VkImageMemoryBarrier2>& barriers,
+                            const std::vector<VkMemoryBarrier2>& memoryBarriers = {})
+{
+    if (barriers.empty() && memoryBarriers.empty()) {
+        return;
+    }
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.memoryBarrierCount = static_cast<uint32_t>(memoryBarriers.size());
+    dependencyInfo.pMemoryBarriers = memoryBarriers.data();
+    dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size());
+    dependencyInfo.pImageMemoryBarriers = barriers.data();
+
+    vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+}
+
+RenderGraph::RenderGraph(std::shared_ptr<Device> device) : device_(device)
+{
+    for (auto& queryPool : queryPools_) {
+        VkQueryPoolCreateInfo queryPoolCI{};
+        queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolCI.queryCount = MAX_TIMED_PASSES * 2;
+
+        VK_CHECK(vkCreateQueryPool(device_->get(), &queryPoolCI, nullptr, &queryPool));
+    }
+}
+
+RenderGraph::~RenderGraph()
+{
+    for (const auto& queryPool : queryPools_) {
+        vkDestroyQueryPool(device_->get(), queryPool, nullptr);
+    }
+
+    if (memory_) {
+        vkFreeMemory(device_->get(), memory_, nullptr);
+    }
+}
+
+void RenderGraph::transient(const std::string& name, Image2D* image, std::vector<Image2D*> views)
+{
+    dirty_ = true;
+
+    for (auto& transient : transients_) {
+        if (transient.image == image) {
+            transient.views = views;
+            return;
+        }
+    }
+
+    Transient transient{};
+    transient.name = name;
+    transient.image = image;
+    transient.views = views;
+    transients_.push_back(transient);
+}
+
+void RenderGraph::onAllocated(std::function<void()> callback)
+{
+    callbacks_.push_back(callback);
+}
+
+void RenderGraph::reset()
+{
+    passes_.clear();
+    outputs_.clear();
+}
+
+void RenderGraph::addPass(const std::string& name, std::vector<ImageAccess> accesses,
+                          std::function<void(VkCommandBuffer)> record, bool async)
+{
+    passes_.push_back({name, accesses, record, async});
+}
+
+void RenderGraph::addPass(const std::string& name, std::vector<ImageAccess> accesses,
+                          std::vector<BufferAccess> buffers,
+                          std::function<void(VkCommandBuffer)> record)
+{
+    passes_.push_back({name, accesses, record});
+    passes_.back().buffers = buffers;
+}
+
+void RenderGraph::output(const ImageAccess& access)
+{
+    outputs_.push_back(access);
+}
+
+void RenderGraph::setAsyncCompute(bool asyncCompute)
+{
+    asyncCompute_ = asyncCompute && device_->asyncCompute();
+    lastQueue_.clear();
+}
+
+bool RenderGraph::asyncCompute() const
+{
+    return asyncCompute_;
+}
+
+void RenderGraph::compile()
+{
+    // walk backwards from the outputs, a pass is kept when something later reads what it writes
+    // images and buffers share the set
+    std::unordered_set<const void*> needed;
+    for (const auto& access : outputs_) {
+        needed.insert(access.image);
+    }
+
+    for (auto pass = passes_.rbegin(); pass != passes_.rend(); pass++) {
+        pass->culled =
+            std::none_of(pass->accesses.begin(), pass->accesses.end(),
+                         [&needed](const ImageAccess& access) {
+                             return (access.access & WRITE_ACCESS) && needed.contains(access.image);
+                         }) &&
+            std::none_of(pass->buffers.begin(), pass->buffers.end(),
+                         [&needed](const BufferAccess& access) {
+                             return (access.access & WRITE_ACCESS) &&
+                                    needed.contains(access.buffer);
+                         });
+        if (pass->culled) {
+            continue;
+        }
+
+        for (const auto& access : pass->accesses) {
+            if (access.access & ~WRITE_ACCESS) {
+                needed.insert(access.image);
+            } else {
+                needed.erase(access.image);
+            }
+        }
+        for (const auto& access : pass->buffers) {
+            if (access.access & ~WRITE_ACCESS) {
+                needed.insert(access.buffer);
+            } else {
+                needed.erase(access.buffer);
+            }
+        }
+    }
+
+    assignSubmissions();
+
+    if (computeLifetimes() || dirty_) {
+        allocate();
+    }
+}
+
+SubmissionWaits RenderGraph::execute(std::array<VkCommandBuffer, 3> cmds, uint32_t frameIdx)
+{
+    std::unordered_set<const Image2D*> touched;
+    std::vector<VkImageMemoryBarrier2> barriers;
+    std::vector<VkMemoryBarrier2> memoryBarriers;
+    // accesses since the last write of each buffer this frame, earlier frames are ordered by
+    // their fences as long as buffers are per frame in flight
+    std::unordered_map<const Buffer*, BufferAccess> bufferStates;
+    SubmissionWaits waits{};
+
+    VkQueryPool queryPool = queryPools_[frameIdx];
+    std::vector<PassTime>& timedPasses = timedPasses_[frameIdx];
+    timedPasses.clear();
+    vkCmdResetQueryPool(cmds[0], queryPool, 0, MAX_TIMED_PASSES * 2);
+
+    auto barrier = [&](const ImageAccess& access, Submission submission) {
+        VkImageMemoryBarrier2 barrier =
+            access.image->barrier2(access.stage, access.access, access.layout);
+
+        // first use this frame of memory shared with other transients, contents are discarded
+        size_t index{};
+        if (touched.insert(access.image).second && isTransient(access.image, index) &&
+            !transients_[index].aliases.empty()) {
+            const Transient& transient = transients_[index];
+            barrier.srcStageMask = transient.stages;
+            barrier.srcAccessMask = transient.accesses;
+            for (size_t alias : transient.aliases) {
+                barrier.srcStageMask |= transients_[alias].stages;
+                barrier.srcAccessMask |= transients_[alias].accesses;
+            }
+            barrier.srcAccessMask &= WRITE_ACCESS;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        }
+
+        // the semaphore wait orders the other queue's use and makes its writes visible, the
+        // barrier chains to the waited stage for the layout transition
+        bool compute = submission == Submission::Compute;
+        uint32_t queue = compute ? COMPUTE_QUEUE : GRAPHICS_QUEUE;
+        uint32_t& lastQueue = lastQueue_[access.image];
+        if (lastQueue && lastQueue != queue) {
+            barrier.srcStageMask = compute ? VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT : access.stage;
+            barrier.srcAccessMask = VK_ACCESS_2_NONE;
+            if (submission == Submission::Graphics) {
+                waits.graphics |= access.stage;
+            } else if (submission == Submission::Late) {
+                waits.late |= access.stage;
+            }
+        } else if (compute && (barrier.srcStageMask & ~COMPUTE_QUEUE_STAGES)) {
+            // graphics stages of a use before the last device wait
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            barrier.srcAccessMask = VK_ACCESS_2_NONE;
+        }
+        lastQueue = queue;
+
+        return barrier;
+    };
+
+    bool outputUsed{};
+    for (auto& pass : passes_) {
+        if (pass.culled) {
+            continue;
+        }
+
+        VkCommandBuffer cmd = cmds[static_cast<uint32_t>(pass.submission)];
+
+        barriers.clear();
+        for (const auto& access : pass.accesses) {
+            barriers.push_back(barrier(access, pass.submission));
+
+            if (!outputUsed && std::any_of(outputs_.begin(), outputs_.end(),
+                                           [&access](const ImageAccess& output) {
+                                               return output.image == access.image;
+                                           })) {
+                outputUsed = true;
+                waits.output = pass.submission;
+            }
+        }
+
+        memoryBarriers.clear();
+        for (const auto& access : pass.buffers) {
+            auto [state, first] = bufferStates.try_emplace(access.buffer, access);
+            if (first) {
+                continue;
+            }
+
+            BufferAccess& last = state->second;
+            if (!((last.access | access.access) & WRITE_ACCESS)) {
+                last.stage |= access.stage;
+                last.access |= access.access;
+                continue;
+            }
+
+            VkMemoryBarrier2 memoryBarrier{};
+            memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+            memoryBarrier.srcStageMask = last.stage;
+            memoryBarrier.srcAccessMask = last.access & WRITE_ACCESS;
+            memoryBarrier.dstStageMask = access.stage;
+            memoryBarrier.dstAccessMask = access.access;
+            memoryBarriers.push_back(memoryBarrier);
+            last = access;
+        }
+
+        pipelineBarrier(cmd, barriers, memoryBarriers);
+
+        uint32_t query = static_cast<uint32_t>(timedPasses.size()) * 2;
+        bool timed = timedPasses.size() < MAX_TIMED_PASSES;
+        if (timed) {
+            timedPasses.push_back({pass.name, 0.f, 0.f, pass.submission == Submission::Compute});
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, query);
+        }
+
+        pass.record(cmd);
+
+        if (timed) {
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, query + 1);
+        }
+    }
+
+    Submission last = asyncCompute_ ? Submission::Late : Submission::Graphics;
+    barriers.clear();
+    for (const auto& access : outputs_) {
+        barriers.push_back(barrier(access, last));
+    }
+    pipelineBarrier(cmds[static_cast<uint32_t>(last)], barriers);
+
+    return waits;
+}
+
+void RenderGraph::dump() const
+{
+    uint32_t culled = static_cast<uint32_t>(
+        std::count_if(passes_.begin(), passes_.end(), [](const Pass& pass) { return pass.culled; }));
+    log("render graph: {} passes, {} culled", passes_.size(), culled);
+
+    int32_t order{};
+    for (const auto& pass : passes_) {
+        if (pass.culled) {
+            log("  -- {:<16} culled", pass.name);
+        } else {
+            static constexpr const char* submissions[] = {"", ", compute queue", ", late"};
+            log("  {:>2} {:<16} {} barriers{}", order++, pass.name,
+                pass.accesses.size() + pass.buffers.size(),
+                submissions[static_cast<uint32_t>(pass.submission)]);
+        }
+    }
+
+    VkDeviceSize separate{};
+    for (const auto& transient : transients_) {
+        separate += transient.size;
+        log("  {:<16} {:>8.2f} MB at {:>8.2f} MB, passes [{}, {}], {} aliases", transient.name,
+            transient.size / 1048576.0, transient.offset / 1048576.0, transient.first,
+            transient.last, transient.aliases.size());
+    }
+
+    log("transient memory: {:.2f} MB aliased, {:.2f} MB separate, {:.2f} MB saved",
+        memorySize_ / 1048576.0, separate / 1048576.0,
+        (separate - std::min(separate, memorySize_)) / 1048576.0);
+}
+
+void RenderGraph::readTimestamps(uint32_t frameIdx)
+{
+    const std::vector<PassTime>& timedPasses = timedPasses_[frameIdx];
+    if (timedPasses.empty()) {
+        return;
+    }
+
+    std::vector<uint64_t> timestamps(timedPasses.size() * 2);
+    VkResult result = vkGetQueryPoolResults(
+        device_->get(), queryPools_[frameIdx], 0, static_cast<uint32_t>(timestamps.size()),
+        timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return;
+    }
+
+    uint64_t first = timestamps[0];
+    for (size_t i = 0; i < timedPasses.size(); i++) {
+        first = std::min(first, timestamps[i * 2]);
+    }
+
+    float period = device_->timestampPeriod() * 1e-6f;
+    passTimes_ = timedPasses;
+    for (size_t i = 0; i < passTimes_.size(); i++) {
+        passTimes_[i].ms = static_cast<float>(timestamps[i * 2 + 1] - timestamps[i * 2]) * period;
+        passTimes_[i].start = static_cast<float>(timestamps[i * 2] - first) * period;
+    }
+}
+
+const std::vector<PassTime>& RenderGraph::passTimes() const
+{
+    return passTimes_;
+}
+
+bool RenderGraph::isTransient(const Image2D* image, size_t& index) const
+{
+    for (size_t i = 0; i < transients_.size(); i++) {
+        const Transient& transient = transients_[i];
+        if (transient.image == image ||
+            std::find(transient.views.begin(), transient.views.end(), image) !=
+                transient.views.end()) {
+            index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void RenderGraph::assignSubmissions()
+{
+    // async passes go to the compute queue and graphics passes using what they touch wait for
+    // them in the late submission, as do async passes after one of those
+    std::unordered_set<const Image2D*> computeImages;
+    std::unordered_set<const Image2D*> lateImages;
+    for (auto& pass : passes_) {
+        pass.submission = Submission::Graphics;
+        if (pass.culled || !asyncCompute_) {
+            continue;
+        }
+
+        auto touches = [&pass](const std::unordered_set<const Image2D*>& images) {
+            return std::any_of(
+                pass.accesses.begin(), pass.accesses.end(),
+                [&images](const ImageAccess& access) { return images.contains(access.image); });
+        };
+        if (touches(lateImages) || (!pass.async && touches(computeImages))) {
+            pass.submission = Submission::Late;
+        } else if (pass.async) {
+            pass.submission = Submission::Compute;
+        } else {
+            continue;
+        }
+
+        auto& images = pass.submission == Submission::Compute ? computeImages : lateImages;
+        for (const auto& access : pass.accesses) {
+            images.insert(access.image);
+        }
+    }
+}
+
+bool RenderGraph::computeLifetimes()
+{
+    std::vector<std::tuple<int32_t, int32_t, uint32_t>> previous;
+    for (auto& transient : transients_) {
+        previous.emplace_back(transient.first, transient.last, transient.submissions);
+        transient.first = -1;
+        transient.last = -1;
+        transient.submissions = 0;
+        transient.stages = VK_PIPELINE_STAGE_2_NONE;
+        transient.accesses = VK_ACCESS_2_NONE;
+    }
+
+    int32_t order{};
+    for (const auto& pass : passes_) {
+        if (pass.culled) {
+            continue;
+        }
+
+        for (const auto& access : pass.accesses) {
+            size_t index{};
+            if (!isTransient(access.image, index)) {
+                continue;
+            }
+
+            Transient& transient = transients_[index];
+            if (transient.first < 0) {
+                transient.first = order;
+            }
+            transient.last = order;
+            transient.submissions |= 1u << static_cast<uint32_t>(pass.submission);
+            transient.stages |= access.stage;
+            transient.accesses |= access.access;
+        }
+        order++;
+    }
+
+    for (size_t i = 0; i < transients_.size(); i++) {
+        const Transient& transient = transients_[i];
+        if (previous[i] !=
+            std::make_tuple(transient.first, transient.last, transient.submissions)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void RenderGraph::allocate()
+{
+    VK_CHECK(vkDeviceWaitIdle(device_->get()));
+
+    uint32_t memoryTypeBits{~0u};
+    std::vector<VkDeviceSize> alignments;
+    for (auto& transient : transients_) {
+        VkMemoryRequirements memoryRs = transient.image->memoryRequirements();
+        transient.size = memoryRs.size;
+        alignments.push_back(memoryRs.alignment);
+        memoryTypeBits &= memoryRs.memoryTypeBits;
+    }
+
+    if (!memoryTypeBits) {
+        exitLog("transient images have no common memory type");
+    }
+
+    // pass order is only execution order within a submission, images of different or several
+    // submissions keep their own memory
+    auto overlaps = [](const Transient& a, const Transient& b) {
+        if (a.first < 0 || b.first < 0) {
+            return false;
+        }
+        if (a.submissions != b.submissions || std::popcount(a.submissions) > 1) {
+            return true;
+        }
+        return a.first <= b.last && b.first <= a.last;
+    };
+
+    // largest first, each at the lowest offset not taken by an image alive at the same time
+    std::vector<size_t> order(transients_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [this](size_t a, size_t b) { return transients_[a].size > transients_[b].size; });
+
+    std::vector<size_t> placed;
+    memorySize_ = 0;
+    for (size_t i : order) {
+        Transient& transient = transients_[i];
+        transient.offset = 0;
+
+        bool moved{true};
+        while (moved) {
+            moved = false;
+            for (size_t j : placed) {
+                const Transient& other = transients_[j];
+                if (overlaps(transient, other) &&
+                    transient.offset < other.offset + other.size &&
+                    other.offset < transient.offset + transient.size) {
+                    VkDeviceSize end = other.offset + other.size;
+                    transient.offset = (end + alignments[i] - 1) / alignments[i] * alignments[i];
+                    moved = true;
+                }
+            }
+        }
+
+        placed.push_back(i);
+        memorySize_ = std::max(memorySize_, transient.offset + transient.size);
+    }
+
+    for (size_t i = 0; i < transients_.size(); i++) {
+        Transient& transient = transients_[i];
+        transient.aliases.clear();
+        for (size_t j = 0; j < transients_.size(); j++) {
+            const Transient& other = transients_[j];
+            if (i != j && transient.offset < other.offset + other.size &&
+                other.offset < transient.offset + transient.size) {
+                transient.aliases.push_back(j);
+            }
+        }
+    }
+
+    VkDeviceMemory memory{};
+    if (memorySize_) {
+        VkMemoryAllocateInfo memoryAI{};
+        memoryAI.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memoryAI.allocationSize = memorySize_;
+        memoryAI.memoryTypeIndex =
+            device_->getMemoryTypeIndex(memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VK_CHECK(vkAllocateMemory(device_->get(), &memoryAI, nullptr, &memory));
+    }
+
+    // sampled transients start readable, descriptors of culled passes still point at them
+    VkCommandBuffer cmd = device_->beginCmd();
+    for (auto& transient : transients_) {
+        transient.image->bindMemory(memory, transient.offset);
+        if (transient.image->usage() & VK_IMAGE_USAGE_SAMPLED_BIT) {
+            transient.image->transition(cmd, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                                        VK_ACCESS_2_SHADER_READ_BIT,
+                                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+    }
+    device_->submitWait(cmd);
+
+    if (memory_) {
+        vkFreeMemory(device_->get(), memory_, nullptr);
+    }
+    memory_ = memory;
+    dirty_ = false;
+    lastQueue_.clear();
+
+    for (const auto& callback : callbacks_) {
+        callback();
+    }
+
+    dump();
+}
+
+} // namespace guk
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Image2D.h"
+#include "Buffer.h"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace guk {
+
+struct ImageAccess
+{
+    Image2D* image;
+    VkPipelineStageFlags2 stage;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+};
+
+// buffers have no layout, uses within a frame are ordered with memory barriers
+struct BufferAccess
+{
+    const Buffer* buffer;
+    VkPipelineStageFlags2 stage;
+    VkAccessFlags2 access;
+};
+
+struct PassTime
+{
+    std::string name;
+    float ms{};
+    // from the first timestamp of the frame, both queues are assumed to share the device clock
+    float start{};
+    bool async{};
+};
+
+// submissions of a frame with async compute: graphics work, compute work waiting on it, then
+// graphics work waiting on the compute work. without async compute everything is graphics
+enum class Submission
+{
+    Graphics,
+    Compute,
+    Late
+};
+
+// stages the graphics submissions wait on the compute queue at, the graphics one on the previous
+// compute submission and the late one on this frame's
+struct SubmissionWaits
+{
+    VkPipelineStageFlags2 graphics{};
+    VkPipelineStageFlags2 late{};
+    // first submission using the output, it waits on the swapchain image
+    Submission output{};
+};
+
+class RenderGraph
+{
+  public:
+    RenderGraph(std::shared_ptr<Device> device);
+    ~RenderGraph();
+
+    // transient images are declared (Image2D::declareImage) and bound by the graph;
+    // views are subresource views of the same image
+    void transient(const std::string& name, Image2D* image, std::vector<Image2D*> views = {});
+    void onAllocated(std::function<void()> callback);
+
+    void reset();
+    // async passes only dispatch compute work and may run on the compute queue
+    void addPass(const std::string& name, std::vector<ImageAccess> accesses,
+                 std::function<void(VkCommandBuffer)> record, bool async = false);
+    // buffers are not tracked across queues, passes touching them stay on the graphics queue
+    void addPass(const std::string& name, std::vector<ImageAccess> accesses,
+                 std::vector<BufferAccess> buffers, std::function<void(VkCommandBuffer)> record);
+    void output(const ImageAccess& access);
+
+    // the device has to be idle
+    void setAsyncCompute(bool asyncCompute);
+    bool asyncCompute() const;
+
+    void compile();
+    // one command buffer per submission, the same one three times without async compute
+    SubmissionWaits execute(std::array<VkCommandBuffer, 3> cmds, uint32_t frameIdx);
+    void dump() const;
+
+    // gpu time of each live pass, read once the frame's fence has signaled
+    void readTimestamps(uint32_t frameIdx);
+    const std::vector<PassTime>& passTimes() const;
+
+  private:
+    static constexpr uint32_t MAX_TIMED_PASSES{32};
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<ImageAccess> accesses;
+        std::function<void(VkCommandBuffer)> record;
+        bool async{};
+        bool culled{};
+        Submission submission{};
+        std::vector<BufferAccess> buffers;
+    };
+
+    struct Transient
+    {
+        std::string name;
+        Image2D* image;
+        std::vector<Image2D*> views;
+        VkDeviceSize offset{};
+        VkDeviceSize size{};
+        int32_t first{-1};
+        int32_t last{-1};
+        VkPipelineStageFlags2 stages{};
+        VkAccessFlags2 accesses{};
+        uint32_t submissions{};
+        std::vector<size_t> aliases;
+    };
+
+    std::shared_ptr<Device> device_;
+
+    std::vector<Pass> passes_;
+    std::vector<ImageAccess> outputs_;
+
+    std::vector<Transient> transients_;
+    std::vector<std::function<void()>> callbacks_;
+    VkDeviceMemory memory_{};
+    VkDeviceSize memorySize_{};
+    bool dirty_{true};
+
+    bool asyncCompute_{};
+    // queue that last used an image, a use on the other queue waits on it with a semaphore
+    std::unordered_map<const Image2D*, uint32_t> lastQueue_;
+
+    std::array<VkQueryPool, Device::MAX_FRAMES_IN_FLIGHT> queryPools_{};
+    std::array<std::vector<PassTime>, Device::MAX_FRAMES_IN_FLIGHT> timedPasses_;
+    std::vector<PassTime> passTimes_;
+
+    bool isTransient(const Image2D* image, size_t& index) const;
+    void assignSubmissions();
+    bool computeLifetimes();
+    void allocate();
+};
+
+} // namespace guk
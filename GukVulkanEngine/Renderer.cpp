@@ -1,15 +1,58 @@
 #include "Renderer.h"
 #include "Logger.h"
 
+#include <algorithm>
+#include <numeric>
+
 namespace guk {
 
-Renderer::Renderer(std::shared_ptr<Device> device, uint32_t width, uint32_t height)
-    : device_(device), msaaColorAttachment_(std::make_unique<Image2D>(device_)),
+// specialization constants of pbr.frag and material_resolve.comp, HAS_*_MAP in the order of
+// MaterialUniform then SHADOW_FILTER
+struct MaterialSpecialization
+{
+    std::array<VkBool32, Renderer::MATERIAL_FEATURE_BITS> textures{};
+    uint32_t shadowFilter{};
+};
+
+static MaterialSpecialization materialSpecialization(uint32_t key)
+{
+    MaterialSpecialization specialization{};
+    for (uint32_t i = 0; i < Renderer::MATERIAL_FEATURE_BITS; i++) {
+        specialization.textures[i] = (key >> i) & 1 ? VK_TRUE : VK_FALSE;
+    }
+    specialization.shadowFilter = (key >> Renderer::MATERIAL_FEATURE_BITS) & 3;
+    return specialization;
+}
+
+static std::array<VkSpecializationMapEntry, Renderer::MATERIAL_FEATURE_BITS + 1>
+materialSpecializationEntries()
+{
+    std::array<VkSpecializationMapEntry, Renderer::MATERIAL_FEATURE_BITS + 1> entries{};
+    for (uint32_t i = 0; i < Renderer::MATERIAL_FEATURE_BITS; i++) {
+        entries[i].constantID = i;
+        entries[i].offset = static_cast<uint32_t>(sizeof(VkBool32) * i);
+        entries[i].size = sizeof(VkBool32);
+    }
+    entries.back().constantID = Renderer::MATERIAL_FEATURE_BITS;
+    entries.back().offset = offsetof(MaterialSpecialization, shadowFilter);
+    entries.back().size = sizeof(uint32_t);
+    return entries;
+}
+
+Renderer::Renderer(std::shared_ptr<Device> device, std::shared_ptr<RenderGraph> graph,
+                   std::shared_ptr<TextureStreamer> textureStreamer, uint32_t width,
+                   uint32_t height)
+    : device_(device), graph_(graph), textureStreamer_(textureStreamer),
+      msaaColorAttachment_(std::make_unique<Image2D>(device_)),
       colorAttachment_(std::make_unique<Image2D>(device_)),
       msaaDepthStencilAttachment_(std::make_unique<Image2D>(device_)),
+      velocityAttachment_(std::make_unique<Image2D>(device_)),
+      visibilityAttachment_(std::make_unique<Image2D>(device_)),
       dummyTexture_(std::make_shared<Image2D>(device_)),
       shadowAttachment_(std::make_shared<Image2D>(device_))
 {
+    antiAliasing_ = static_cast<AntiAliasing>(device_->smapleCount());
+
     createAttachments(width, height);
     createUniform();
     createTextures();
@@ -19,18 +62,46 @@ Renderer::Renderer(std::shared_ptr<Device> device, uint32_t width, uint32_t heig
     allocateDescriptorSets();
 
     createPipelineLayout();
-    createPipeline();
-    createPipelineSkybox();
-    createPipelineShadow();
+    device_->compilePipeline([this]() { createPipelineSkybox(); });
+    device_->compilePipeline([this]() { createPipelineShadow(); });
+    device_->compilePipeline([this]() { createPipelineDepthPrepass(); });
+    device_->compilePipeline([this]() { createPipelineTaa(); });
+    device_->compilePipeline([this]() { createPipelineLightCluster(); });
+    device_->compilePipeline([this]() { createPipelineVisibility(); });
+    device_->compilePipeline([this]() { createPipelineMaterialClassify(); });
+
+    graph_->onAllocated([this]() {
+        updateShadowDescriptorSet();
+        updateTaaDescriptorSets();
+        updateVisibilityDescriptorSets();
+    });
 }
 
 Renderer::~Renderer()
 {
     vkDestroySampler(device_->get(), shadowSampler_, nullptr);
 
+    for (const auto& [key, permutation] : resolvePipelines_) {
+        vkDestroyPipeline(device_->get(), permutation, nullptr);
+    }
+    vkDestroyPipeline(device_->get(), pipelineMaterialClassify_, nullptr);
+    vkDestroyPipelineLayout(device_->get(), materialPipelineLayout_, nullptr);
+    vkDestroyPipeline(device_->get(), pipelineVisibility_, nullptr);
+    vkDestroyDescriptorSetLayout(device_->get(), visibilitySetLayout_, nullptr);
+
+    vkDestroyPipeline(device_->get(), pipelineLightCluster_, nullptr);
+    vkDestroyPipelineLayout(device_->get(), clusterPipelineLayout_, nullptr);
+
+    vkDestroyPipeline(device_->get(), pipelineTaa_, nullptr);
+    vkDestroyPipelineLayout(device_->get(), taaPipelineLayout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_->get(), taaSetLayout_, nullptr);
+
     vkDestroyPipeline(device_->get(), pipelineShadow_, nullptr);
+    vkDestroyPipeline(device_->get(), pipelineDepthPrepass_, nullptr);
     vkDestroyPipeline(device_->get(), pipelineSkybox_, nullptr);
-    vkDestroyPipeline(device_->get(), pipeline_, nullptr);
+    for (const auto& [key, permutation] : pipelines_) {
+        vkDestroyPipeline(device_->get(), permutation, nullptr);
+    }
     vkDestroyPipelineLayout(device_->get(), pipelineLayout_, nullptr);
 
     for (const auto& descriptorSetLayout : descriptorSetLayouts_) {
@@ -38,29 +109,220 @@ Renderer::~Renderer()
     }
 }
 
-void Renderer::allocateModelDescriptorSets(std::vector<Model>& models)
+void Renderer::allocateModelDescriptorSets(Model& model)
 {
-    for (auto& model : models) {
-        model.allocateMaterialDescriptorSets(descriptorSetLayouts_[2], dummyTexture_);
-    }
+    model.allocateMaterialDescriptorSets(descriptorSetLayouts_[2], dummyTexture_);
 }
 
 void Renderer::createAttachments(uint32_t width, uint32_t height)
 {
-    msaaDepthStencilAttachment_->createImage(device_->depthStencilFormat(), width, height,
-                                             VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
-                                                 VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                                             device_->smapleCount());
-
-    msaaColorAttachment_->createImage(VK_FORMAT_R16G16B16A16_SFLOAT, width, height,
-                                      VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
-                                          VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                                      device_->smapleCount());
+    bool taa = antiAliasing_ == AntiAliasing::Taa;
+
+    // not transient, the depth pre-pass stores depth and the main and skybox passes load it
+    msaaDepthStencilAttachment_->declareImage(device_->depthStencilFormat(), width, height,
+                                              VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                                              samples());
+    graph_->transient("msaaDepthStencil", msaaDepthStencilAttachment_.get());
+
+    // taa renders the jittered frame here at one sample and resolves it from compute
+    msaaColorAttachment_->declareImage(sceneFormat_, width, height,
+                                       VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                           (taa ? VK_IMAGE_USAGE_SAMPLED_BIT
+                                                : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT),
+                                       samples());
+    msaaColorAttachment_->setSampler(device_->samplerLinearClamp());
+    graph_->transient("msaaColor", msaaColorAttachment_.get());
+
+    velocityAttachment_->declareImage(VELOCITY_FORMAT, width, height,
+                                      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                          VK_IMAGE_USAGE_SAMPLED_BIT,
+                                      VK_SAMPLE_COUNT_1_BIT);
+    velocityAttachment_->setSampler(device_->samplerLinearClamp());
+    graph_->transient("velocity", velocityAttachment_.get());
+
+    visibilityAttachment_->declareImage(VISIBILITY_FORMAT, width, height,
+                                        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                            VK_IMAGE_USAGE_STORAGE_BIT,
+                                        VK_SAMPLE_COUNT_1_BIT);
+    graph_->transient("visibility", visibilityAttachment_.get());
+
+    // a list per material slot long enough for every tile
+    VkDeviceSize tileCount = ((width + MATERIAL_TILE_SIZE - 1) / MATERIAL_TILE_SIZE) *
+                             ((height + MATERIAL_TILE_SIZE - 1) / MATERIAL_TILE_SIZE);
+    for (auto& materialTileBuffer : materialTileBuffers_) {
+        materialTileBuffer = std::make_unique<Buffer>(device_);
+        materialTileBuffer->createLocalBuffer(
+            (sizeof(glm::uvec4) + sizeof(uint32_t) * tileCount) * MAX_VISIBILITY_MATERIALS,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    }
 
-    colorAttachment_->createImage(VK_FORMAT_R16G16B16A16_SFLOAT, width, height,
-                                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+    colorAttachment_->createImage(sceneFormat_, width, height,
+                                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
                                   VK_SAMPLE_COUNT_1_BIT);
     colorAttachment_->setSampler(device_->samplerLinearClamp());
+
+    // the history outlives the frame, only allocated while taa is on
+    for (auto& historyTexture : historyTextures_) {
+        historyTexture = std::make_unique<Image2D>(device_);
+        if (taa) {
+            historyTexture->createImage(HISTORY_FORMAT, width, height,
+                                        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                                        VK_SAMPLE_COUNT_1_BIT);
+            historyTexture->setSampler(device_->samplerLinearClamp());
+        }
+    }
+    historyValid_ = false;
+
+    setRenderScale(renderScale_);
+}
+
+void Renderer::setRenderScale(float scale)
+{
+    renderScale_ = glm::clamp(scale, 0.f, 1.f);
+    renderExtent_.width = glm::max(
+        1u, static_cast<uint32_t>(glm::round(colorAttachment_->width() * renderScale_)));
+    renderExtent_.height = glm::max(
+        1u, static_cast<uint32_t>(glm::round(colorAttachment_->height() * renderScale_)));
+}
+
+float Renderer::renderScale() const
+{
+    return renderScale_;
+}
+
+VkExtent2D Renderer::renderExtent() const
+{
+    return renderExtent_;
+}
+
+void Renderer::setAntiAliasing(AntiAliasing antiAliasing)
+{
+    antiAliasing_ = antiAliasing;
+    createAttachments(colorAttachment_->width(), colorAttachment_->height());
+
+    // sample and attachment counts are baked into the scene pipelines, the material permutations
+    // are made again as they are drawn
+    vkDestroyPipeline(device_->get(), pipelineDepthPrepass_, nullptr);
+    vkDestroyPipeline(device_->get(), pipelineSkybox_, nullptr);
+    for (const auto& [key, permutation] : pipelines_) {
+        vkDestroyPipeline(device_->get(), permutation, nullptr);
+    }
+    pipelines_.clear();
+    createPipelineSkybox();
+    createPipelineDepthPrepass();
+}
+
+void Renderer::setSceneFormat(VkFormat format)
+{
+    sceneFormat_ = format;
+    createAttachments(colorAttachment_->width(), colorAttachment_->height());
+
+    // the color format is baked into the scene pipelines
+    vkDestroyPipeline(device_->get(), pipelineSkybox_, nullptr);
+    for (const auto& [key, permutation] : pipelines_) {
+        vkDestroyPipeline(device_->get(), permutation, nullptr);
+    }
+    pipelines_.clear();
+    createPipelineSkybox();
+}
+
+VkFormat Renderer::sceneFormat() const
+{
+    return sceneFormat_;
+}
+
+bool& Renderer::depthPrepass()
+{
+    return depthPrepass_;
+}
+
+ShadowFilter& Renderer::shadowFilter()
+{
+    return shadowFilter_;
+}
+
+uint32_t Renderer::cachedPermutations() const
+{
+    return static_cast<uint32_t>(pipelines_.size() + resolvePipelines_.size());
+}
+
+bool& Renderer::visibilityBuffer()
+{
+    return visibilityBuffer_;
+}
+
+bool Renderer::visibilityBufferSupported() const
+{
+    return antiAliasing_ == AntiAliasing::Msaa1 && device_->geometryShader();
+}
+
+AntiAliasing Renderer::antiAliasing() const
+{
+    return antiAliasing_;
+}
+
+VkDeviceSize Renderer::attachmentMemory() const
+{
+    VkDeviceSize memory = msaaDepthStencilAttachment_->memoryRequirements().size +
+                          colorAttachment_->memoryRequirements().size;
+    if (antiAliasing_ != AntiAliasing::Msaa1) {
+        memory += msaaColorAttachment_->memoryRequirements().size;
+    }
+    if (antiAliasing_ == AntiAliasing::Taa) {
+        memory += velocityAttachment_->memoryRequirements().size;
+        for (const auto& historyTexture : historyTextures_) {
+            memory += historyTexture->memoryRequirements().size;
+        }
+    }
+    if (visibilityBuffer_ && visibilityBufferSupported()) {
+        memory += visibilityAttachment_->memoryRequirements().size;
+    }
+
+    return memory;
+}
+
+VkSampleCountFlagBits Renderer::samples() const
+{
+    if (antiAliasing_ == AntiAliasing::Taa) {
+        return VK_SAMPLE_COUNT_1_BIT;
+    }
+
+    return static_cast<VkSampleCountFlagBits>(antiAliasing_);
+}
+
+float Renderer::projectedPixels(const Mesh& mesh, const glm::mat4& modelMatrix) const
+{
+    // projected bounding sphere
+    glm::vec3 center = modelMatrix * glm::vec4((mesh.boundMin() + mesh.boundMax()) * 0.5f, 1.f);
+    float radius =
+        glm::length(glm::mat3(modelMatrix) * ((mesh.boundMax() - mesh.boundMin()) * 0.5f));
+    float distance = glm::max(glm::distance(center, cameraPos_), radius);
+    return radius / distance * projScale_ * renderExtent_.height;
+}
+
+uint32_t Renderer::permutationKey(uint32_t features) const
+{
+    return features | static_cast<uint32_t>(shadowFilter_) << MATERIAL_FEATURE_BITS;
+}
+
+VkPipeline Renderer::pipeline(uint32_t key)
+{
+    auto [it, inserted] = pipelines_.try_emplace(key);
+    if (inserted) {
+        it->second = createPipeline(key);
+    }
+    return it->second;
+}
+
+VkPipeline Renderer::resolvePipeline(uint32_t key)
+{
+    auto [it, inserted] = resolvePipelines_.try_emplace(key);
+    if (inserted) {
+        it->second = createPipelineMaterialResolve(key);
+    }
+    return it->second;
 }
 
 std::shared_ptr<Image2D> Renderer::colorAttachment() const
@@ -73,44 +335,159 @@ std::shared_ptr<Image2D> Renderer::shadowAttachment() const
     return shadowAttachment_;
 }
 
-void Renderer::update(uint32_t frameIdx, SceneUniform sceneUniform, SkyboxUniform skyboxUniform)
+void Renderer::update(uint32_t frameIdx, SceneUniform sceneUniform, SkyboxUniform skyboxUniform,
+                      const std::vector<Light>& lights)
 {
+    lightCount_ = glm::min(static_cast<uint32_t>(lights.size()), MAX_LIGHTS);
+    memcpy(lightBuffers_[frameIdx]->mapped(), lights.data(), lightCount_ * sizeof(Light));
+    sceneUniform.renderSize = glm::uvec2(renderExtent_.width, renderExtent_.height);
+    sceneUniform.lightCount = lightCount_;
+
     sceneUniformBuffers_[frameIdx]->update(sceneUniform);
     skyboxUniformBuffers_[frameIdx]->update(skyboxUniform);
     viewFrustum_.create(sceneUniform.proj * sceneUniform.view);
+    cameraPos_ = sceneUniform.cameraPos;
+    projScale_ = sceneUniform.proj[1][1];
+}
+
+void Renderer::addPasses(uint32_t frameIdx, const std::vector<Model>& models)
+{
+    graph_->addPass("shadow",
+                    {{shadowAttachment_.get(),
+                      VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+                          VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                      VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                          VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL}},
+                    [this, frameIdx, &models](VkCommandBuffer cmd) {
+                        drawShadow(cmd, frameIdx, models);
+                    });
+
+    // msaa resolves into the color attachment, 1x renders straight into it, taa renders the
+    // jittered frame and velocity and resolves them against the history below
+    bool taa = antiAliasing_ == AntiAliasing::Taa;
+    std::vector<ImageAccess> accesses{
+        {shadowAttachment_.get(), VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+         VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+        {msaaDepthStencilAttachment_.get(),
+         VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+         VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+             VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL}};
+    if (antiAliasing_ != AntiAliasing::Msaa1) {
+        accesses.push_back({msaaColorAttachment_.get(),
+                            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                            VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+    }
+    if (taa) {
+        accesses.push_back({velocityAttachment_.get(),
+                            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                            VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+    } else {
+        accesses.push_back({colorAttachment_.get(),
+                            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                            VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+    }
+
+    if (lightCount_) {
+        graph_->addPass("lightCluster", {},
+                        {{clusterBuffers_[frameIdx].get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                          VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT}},
+                        [this, frameIdx](VkCommandBuffer cmd) { binLights(cmd, frameIdx); });
+    }
+
+    // taa is off here, nothing follows the visibility passes
+    if (visibilityBuffer_ && visibilityBufferSupported() &&
+        buildVisibilityDraws(frameIdx, models)) {
+        addVisibilityPasses(frameIdx);
+        return;
+    }
+
+    if (depthPrepass_) {
+        graph_->addPass("depthPrepass", {accesses[1]},
+                        [this, frameIdx, &models](VkCommandBuffer cmd) {
+                            drawDepthPrepass(cmd, frameIdx, models);
+                        });
+    }
+
+    graph_->addPass("main", accesses,
+                    {{clusterBuffers_[frameIdx].get(), VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_READ_BIT}},
+                    [this, frameIdx, &models](VkCommandBuffer cmd) {
+                        draw(cmd, frameIdx, models);
+                    });
+
+    if (!taa) {
+        return;
+    }
+
+    uint32_t historyIdx = historyIdx_;
+    bool reset = !historyValid_;
+    historyIdx_ = 1 - historyIdx_;
+    historyValid_ = true;
+
+    graph_->addPass(
+        "taa",
+        {{msaaColorAttachment_.get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+          VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+         {velocityAttachment_.get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+          VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+         {historyTextures_[1 - historyIdx].get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+          VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+         {historyTextures_[historyIdx].get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+          VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL},
+         {colorAttachment_.get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+          VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL}},
+        [this, historyIdx, reset](VkCommandBuffer cmd) { resolveTaa(cmd, historyIdx, reset); });
 }
 
 void Renderer::draw(VkCommandBuffer cmd, uint32_t frameIdx, std::vector<Model> models)
 {
-    colorAttachment_->transition(cmd, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
-                                 VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
-                                 VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    bool taa = antiAliasing_ == AntiAliasing::Taa;
 
-    VkRenderingAttachmentInfo colorAttachment{};
+    std::array<VkRenderingAttachmentInfo, 2> colorAttachments{};
+    VkRenderingAttachmentInfo& colorAttachment = colorAttachments[0];
     colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    colorAttachment.imageView = msaaColorAttachment_->view();
     colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.clearValue.color = {0.f, 0.f, 0.f, 1.f};
-    colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
-    colorAttachment.resolveImageView = colorAttachment_->view();
-    colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    if (samples() != VK_SAMPLE_COUNT_1_BIT) {
+        colorAttachment.imageView = msaaColorAttachment_->view();
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+        colorAttachment.resolveImageView = colorAttachment_->view();
+        colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    } else {
+        colorAttachment.imageView = taa ? msaaColorAttachment_->view() : colorAttachment_->view();
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    }
+
+    VkRenderingAttachmentInfo& velocityAttachment = colorAttachments[1];
+    velocityAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    velocityAttachment.imageView = velocityAttachment_->view();
+    velocityAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    velocityAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    velocityAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    velocityAttachment.clearValue.color = {0.f, 0.f, 0.f, 0.f};
 
     VkRenderingAttachmentInfo depthStecnilAttachment{};
     depthStecnilAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
     depthStecnilAttachment.imageView = msaaDepthStencilAttachment_->view();
     depthStecnilAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-    depthStecnilAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthStecnilAttachment.loadOp =
+        depthPrepass_ ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
     depthStecnilAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthStecnilAttachment.clearValue.depthStencil = {1.f, 0};
 
     VkRenderingInfo renderingInfo{};
     renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-    renderingInfo.renderArea = {0, 0, colorAttachment_->width(), colorAttachment_->height()};
+    renderingInfo.renderArea = {0, 0, renderExtent_.width, renderExtent_.height};
     renderingInfo.layerCount = 1;
-    renderingInfo.colorAttachmentCount = 1;
-    renderingInfo.pColorAttachments = &colorAttachment;
+    renderingInfo.colorAttachmentCount = taa ? 2 : 1;
+    renderingInfo.pColorAttachments = colorAttachments.data();
     renderingInfo.pDepthAttachment = &depthStecnilAttachment;
     renderingInfo.pStencilAttachment = &depthStecnilAttachment;
 
@@ -119,33 +496,35 @@ void Renderer::draw(VkCommandBuffer cmd, uint32_t frameIdx, std::vector<Model> m
     VkViewport viewport{};
     viewport.x = 0.f;
     viewport.y = 0.f;
-    viewport.width = static_cast<float>(colorAttachment_->width());
-    viewport.height = static_cast<float>(colorAttachment_->height());
+    viewport.width = static_cast<float>(renderExtent_.width);
+    viewport.height = static_cast<float>(renderExtent_.height);
     viewport.minDepth = 0.f;
     viewport.maxDepth = 1.f;
     vkCmdSetViewport(cmd, 0, 1, &viewport);
 
     VkRect2D scissor{};
     scissor.offset = {0, 0};
-    scissor.extent = {colorAttachment_->width(), colorAttachment_->height()};
+    scissor.extent = renderExtent_;
     vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-    // render models
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
+    // visible meshes grouped by permutation, in model order within a group
+    struct MeshDraw
+    {
+        uint32_t key{};
+        const Model* model{};
+        const Mesh* mesh{};
+    };
+    std::vector<MeshDraw> meshDraws;
 
-    VkDeviceSize offsets[1]{0};
     totalMeshes_ = 0;
     renderedMeshes_ = 0;
     culledMeshes_ = 0;
-    for (Model& model : models) {
+    for (const Model& model : models) {
         if (!model.visible()) {
             continue;
         }
 
         glm::mat4 modelMatrix = model.matrix();
-        vkCmdPushConstants(cmd, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0,
-                           sizeof(ModelPushConstants), &modelMatrix);
-
         for (const Mesh& mesh : model.meshes()) {
             totalMeshes_++;
 
@@ -155,39 +534,123 @@ void Renderer::draw(VkCommandBuffer cmd, uint32_t frameIdx, std::vector<Model> m
             }
             renderedMeshes_++;
 
-            VkBuffer vertexBuffer = mesh.getVertexBuffer();
-            VkBuffer indexBuffer = mesh.getIndexBuffer();
+            model.requestTextures(*textureStreamer_, mesh.getMaterialIndex(),
+                                  projectedPixels(mesh, modelMatrix));
 
-            std::array<VkDescriptorSet, 3> sets{
-                uniformDescriptorSets_[frameIdx], mapDescriptorSet_,
-                model.getMaterialDescriptorSets(mesh.getMaterialIndex())};
-            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0,
-                                    static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
-
-            vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, offsets);
-            vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(cmd, static_cast<uint32_t>(mesh.indicesSize()), 1, 0, 0, 0);
+            uint32_t key = permutationKey(model.materialFeatures(mesh.getMaterialIndex())) |
+                           (depthPrepass_ ? PERMUTATION_DEPTH_EQUAL : 0);
+            meshDraws.push_back({key, &model, &mesh});
         }
     }
+    std::stable_sort(meshDraws.begin(), meshDraws.end(),
+                     [](const MeshDraw& a, const MeshDraw& b) { return a.key < b.key; });
 
-    // render skybox
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineSkybox_);
-
+    // render models
     std::array<VkDescriptorSet, 2> sets{uniformDescriptorSets_[frameIdx], mapDescriptorSet_};
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0,
                             static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
 
+    VkDeviceSize offsets[1]{0};
+    const Model* pushedModel{};
+    drawnPermutations_ = 0;
+    for (size_t i = 0; i < meshDraws.size(); i++) {
+        const MeshDraw& meshDraw = meshDraws[i];
+        if (i == 0 || meshDraw.key != meshDraws[i - 1].key) {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline(meshDraw.key));
+            drawnPermutations_++;
+        }
+
+        if (meshDraw.model != pushedModel) {
+            glm::mat4 modelMatrix = meshDraw.model->matrix();
+            vkCmdPushConstants(cmd, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                               sizeof(ModelPushConstants), &modelMatrix);
+            pushedModel = meshDraw.model;
+        }
+
+        VkDescriptorSet materialSet = meshDraw.model->getMaterialDescriptorSets(
+            frameIdx, meshDraw.mesh->getMaterialIndex());
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 2, 1,
+                                &materialSet, 0, nullptr);
+
+        VkBuffer vertexBuffer = meshDraw.mesh->getVertexBuffer();
+        VkBuffer indexBuffer = meshDraw.mesh->getIndexBuffer();
+        vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, offsets);
+        vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdDrawIndexed(cmd, static_cast<uint32_t>(meshDraw.mesh->indicesSize()), 1, 0, 0, 0);
+    }
+
+    // render skybox
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineSkybox_);
     vkCmdDraw(cmd, 36, 1, 0, 0);
 
     vkCmdEndRendering(cmd);
 }
 
-void Renderer::drawShadow(VkCommandBuffer cmd, uint32_t frameIdx, std::vector<Model> models)
+void Renderer::drawDepthPrepass(VkCommandBuffer cmd, uint32_t frameIdx,
+                                const std::vector<Model>& models)
 {
-    shadowAttachment_->transition(cmd, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT,
-                                  VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-                                  VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    VkRenderingAttachmentInfo depthStecnilAttachment{};
+    depthStecnilAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depthStecnilAttachment.imageView = msaaDepthStencilAttachment_->view();
+    depthStecnilAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthStecnilAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthStecnilAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthStecnilAttachment.clearValue.depthStencil = {1.f, 0};
+
+    VkRenderingInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.renderArea = {0, 0, renderExtent_.width, renderExtent_.height};
+    renderingInfo.layerCount = 1;
+    renderingInfo.pDepthAttachment = &depthStecnilAttachment;
+    renderingInfo.pStencilAttachment = &depthStecnilAttachment;
+    vkCmdBeginRendering(cmd, &renderingInfo);
+
+    VkViewport viewport{};
+    viewport.x = 0.f;
+    viewport.y = 0.f;
+    viewport.width = static_cast<float>(renderExtent_.width);
+    viewport.height = static_cast<float>(renderExtent_.height);
+    viewport.minDepth = 0.f;
+    viewport.maxDepth = 1.f;
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = renderExtent_;
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineDepthPrepass_);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0, 1,
+                            &uniformDescriptorSets_[frameIdx], 0, nullptr);
+
+    // the same meshes as the main pass, anything culled here has no depth to match there
+    VkDeviceSize offsets[1]{0};
+    for (const Model& model : models) {
+        if (!model.visible()) {
+            continue;
+        }
+
+        glm::mat4 modelMatrix = model.matrix();
+        vkCmdPushConstants(cmd, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                           sizeof(ModelPushConstants), &modelMatrix);
+
+        for (const Mesh& mesh : model.meshes()) {
+            if (viewFrustum_.culling(mesh.boundMin(), mesh.boundMax(), modelMatrix)) {
+                continue;
+            }
+
+            VkBuffer vertexBuffer = mesh.getVertexBuffer();
+            vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, offsets);
+            vkCmdBindIndexBuffer(cmd, mesh.getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+            vkCmdDrawIndexed(cmd, static_cast<uint32_t>(mesh.indicesSize()), 1, 0, 0, 0);
+        }
+    }
 
+    vkCmdEndRendering(cmd);
+}
+
+void Renderer::drawShadow(VkCommandBuffer cmd, uint32_t frameIdx, std::vector<Model> models)
+{
     VkRenderingAttachmentInfo shadowAttachment{};
     shadowAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
     shadowAttachment.imageView = shadowAttachment_->view();
@@ -245,22 +708,358 @@ void Renderer::drawShadow(VkCommandBuffer cmd, uint32_t frameIdx, std::vector<Mo
     }
 
     vkCmdEndRendering(cmd);
+}
+
+void Renderer::resolveTaa(VkCommandBuffer cmd, uint32_t historyIdx, bool reset)
+{
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineTaa_);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, taaPipelineLayout_, 0, 1,
+                            &taaDescriptorSets_[historyIdx], 0, nullptr);
+
+    TaaPushConstants pc{};
+    pc.prevSceneScale = prevSceneScale_;
+    pc.renderSize = glm::uvec2(renderExtent_.width, renderExtent_.height);
+    pc.blend = TAA_BLEND;
+    pc.reset = reset ? 1 : 0;
+    vkCmdPushConstants(cmd, taaPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(TaaPushConstants), &pc);
+
+    vkCmdDispatch(cmd, (renderExtent_.width + 7) / 8, (renderExtent_.height + 7) / 8, 1);
+
+    prevSceneScale_ = glm::vec2(renderExtent_.width, renderExtent_.height) /
+                      glm::vec2(colorAttachment_->width(), colorAttachment_->height());
+}
+
+void Renderer::binLights(VkCommandBuffer cmd, uint32_t frameIdx)
+{
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLightCluster_);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, clusterPipelineLayout_, 0, 1,
+                            &uniformDescriptorSets_[frameIdx], 0, nullptr);
+
+    // one group per cluster
+    vkCmdDispatch(cmd, CLUSTER_GRID[0], CLUSTER_GRID[1], CLUSTER_GRID[2]);
+}
+
+bool Renderer::buildVisibilityDraws(uint32_t frameIdx, const std::vector<Model>& models)
+{
+    visibilityMeshes_.clear();
+    visibilityMaterials_.clear();
+    visibilityFeatures_.clear();
+    std::unordered_map<VkDescriptorSet, uint32_t> materialSlots;
+    auto* draws = static_cast<VisibilityDraw*>(visibilityDrawBuffers_[frameIdx]->mapped());
+
+    // no counters or texture requests until the draws fit, the forward path does both otherwise
+    std::vector<const Model*> drawModels;
+    uint32_t total{};
+    uint32_t culled{};
+    for (const Model& model : models) {
+        if (!model.visible()) {
+            continue;
+        }
+
+        glm::mat4 modelMatrix = model.matrix();
+        for (const Mesh& mesh : model.meshes()) {
+            total++;
+
+            if (viewFrustum_.culling(mesh.boundMin(), mesh.boundMax(), modelMatrix)) {
+                culled++;
+                continue;
+            }
+
+            VkDescriptorSet materialSet =
+                model.getMaterialDescriptorSets(frameIdx, mesh.getMaterialIndex());
+            auto [slot, inserted] = materialSlots.try_emplace(
+                materialSet, static_cast<uint32_t>(visibilityMaterials_.size()));
+            if (inserted) {
+                visibilityMaterials_.push_back(materialSet);
+                visibilityFeatures_.push_back(model.materialFeatures(mesh.getMaterialIndex()));
+            }
+            if (visibilityMeshes_.size() == MAX_VISIBILITY_DRAWS ||
+                visibilityMaterials_.size() > MAX_VISIBILITY_MATERIALS) {
+                return false;
+            }
+
+            VisibilityDraw& draw = draws[visibilityMeshes_.size()];
+            draw.model = modelMatrix;
+            draw.vertices = mesh.vertexAddress();
+            draw.indices = mesh.indexAddress();
+            draw.material = slot->second;
+            visibilityMeshes_.emplace_back(&mesh, modelMatrix);
+            drawModels.push_back(&model);
+        }
+    }
+
+    totalMeshes_ = total;
+    renderedMeshes_ = static_cast<uint32_t>(visibilityMeshes_.size());
+    culledMeshes_ = culled;
+    for (size_t i = 0; i < visibilityMeshes_.size(); i++) {
+        const auto& [mesh, modelMatrix] = visibilityMeshes_[i];
+        drawModels[i]->requestTextures(*textureStreamer_, mesh->getMaterialIndex(),
+                                       projectedPixels(*mesh, modelMatrix));
+    }
+
+    return true;
+}
+
+void Renderer::addVisibilityPasses(uint32_t frameIdx)
+{
+    ImageAccess depthAccess{
+        msaaDepthStencilAttachment_.get(),
+        VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+    graph_->addPass("visibility",
+                    {{visibilityAttachment_.get(), VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                      VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+                     depthAccess},
+                    [this, frameIdx](VkCommandBuffer cmd) { drawVisibility(cmd, frameIdx); });
+
+    graph_->addPass("materialClassify",
+                    {{visibilityAttachment_.get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL}},
+                    {{materialTileBuffers_[frameIdx].get(),
+                      VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                          VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT}},
+                    [this, frameIdx](VkCommandBuffer cmd) { classifyMaterials(cmd, frameIdx); });
+
+    graph_->addPass("materialResolve",
+                    {{visibilityAttachment_.get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL},
+                     {shadowAttachment_.get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+                     {colorAttachment_.get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL}},
+                    {{materialTileBuffers_[frameIdx].get(),
+                      VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+                          VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT},
+                     {clusterBuffers_[frameIdx].get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_READ_BIT}},
+                    [this, frameIdx](VkCommandBuffer cmd) { resolveMaterials(cmd, frameIdx); });
+
+    // pixels without a draw are left to the skybox, tested against the visibility depth
+    graph_->addPass("skybox",
+                    {{colorAttachment_.get(), VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                      VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT |
+                          VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+                     {msaaDepthStencilAttachment_.get(),
+                      VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+                          VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                      VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL}},
+                    [this, frameIdx](VkCommandBuffer cmd) { drawSkybox(cmd, frameIdx); });
+}
+
+void Renderer::drawVisibility(VkCommandBuffer cmd, uint32_t frameIdx)
+{
+    VkRenderingAttachmentInfo visibilityAttachment{};
+    visibilityAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    visibilityAttachment.imageView = visibilityAttachment_->view();
+    visibilityAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    visibilityAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    visibilityAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    visibilityAttachment.clearValue.color.uint32[0] = UINT32_MAX;
+    visibilityAttachment.clearValue.color.uint32[1] = UINT32_MAX;
+
+    // kept for the skybox pass
+    VkRenderingAttachmentInfo depthStecnilAttachment{};
+    depthStecnilAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depthStecnilAttachment.imageView = msaaDepthStencilAttachment_->view();
+    depthStecnilAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthStecnilAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthStecnilAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthStecnilAttachment.clearValue.depthStencil = {1.f, 0};
+
+    VkRenderingInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.renderArea = {0, 0, renderExtent_.width, renderExtent_.height};
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &visibilityAttachment;
+    renderingInfo.pDepthAttachment = &depthStecnilAttachment;
+    renderingInfo.pStencilAttachment = &depthStecnilAttachment;
+    vkCmdBeginRendering(cmd, &renderingInfo);
+
+    VkViewport viewport{};
+    viewport.x = 0.f;
+    viewport.y = 0.f;
+    viewport.width = static_cast<float>(renderExtent_.width);
+    viewport.height = static_cast<float>(renderExtent_.height);
+    viewport.minDepth = 0.f;
+    viewport.maxDepth = 1.f;
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = renderExtent_;
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineVisibility_);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0, 1,
+                            &uniformDescriptorSets_[frameIdx], 0, nullptr);
+
+    // the first instance is the index of the draw in the draw buffer
+    VkDeviceSize offsets[1]{0};
+    for (uint32_t i = 0; i < visibilityMeshes_.size(); i++) {
+        const auto& [mesh, modelMatrix] = visibilityMeshes_[i];
+        vkCmdPushConstants(cmd, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                           sizeof(ModelPushConstants), &modelMatrix);
+
+        VkBuffer vertexBuffer = mesh->getVertexBuffer();
+        vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, offsets);
+        vkCmdBindIndexBuffer(cmd, mesh->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+        vkCmdDrawIndexed(cmd, mesh->indicesSize(), 1, 0, 0, i);
+    }
+
+    vkCmdEndRendering(cmd);
+}
 
-    VkImageMemoryBarrier2 barrier = shadowAttachment_->barrier2(
-        VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    barrier.srcStageMask = VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
-    Image2D::transition(cmd, barrier);
+void Renderer::classifyMaterials(VkCommandBuffer cmd, uint32_t frameIdx)
+{
+    // the dispatches start empty, y and z are set to 1 with the first tile of a material
+    vkCmdFillBuffer(cmd, materialTileBuffers_[frameIdx]->get(), 0,
+                    sizeof(glm::uvec4) * MAX_VISIBILITY_MATERIALS, 0);
+
+    VkMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.memoryBarrierCount = 1;
+    dependencyInfo.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineMaterialClassify_);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, materialPipelineLayout_, 0, 1,
+                            &uniformDescriptorSets_[frameIdx], 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, materialPipelineLayout_, 3, 1,
+                            &visibilityDescriptorSets_[frameIdx], 0, nullptr);
+
+    // one group per tile
+    vkCmdDispatch(cmd, (renderExtent_.width + MATERIAL_TILE_SIZE - 1) / MATERIAL_TILE_SIZE,
+                  (renderExtent_.height + MATERIAL_TILE_SIZE - 1) / MATERIAL_TILE_SIZE, 1);
+}
+
+void Renderer::resolveMaterials(VkCommandBuffer cmd, uint32_t frameIdx)
+{
+    std::array<VkDescriptorSet, 2> sets{uniformDescriptorSets_[frameIdx], mapDescriptorSet_};
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, materialPipelineLayout_, 0,
+                            static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, materialPipelineLayout_, 3, 1,
+                            &visibilityDescriptorSets_[frameIdx], 0, nullptr);
+
+    // one dispatch per material over the tiles it covers, grouped by permutation
+    std::vector<uint32_t> slots(visibilityMaterials_.size());
+    std::iota(slots.begin(), slots.end(), 0);
+    std::stable_sort(slots.begin(), slots.end(), [this](uint32_t a, uint32_t b) {
+        return visibilityFeatures_[a] < visibilityFeatures_[b];
+    });
+
+    drawnPermutations_ = 0;
+    for (size_t i = 0; i < slots.size(); i++) {
+        uint32_t slot = slots[i];
+        if (i == 0 || visibilityFeatures_[slot] != visibilityFeatures_[slots[i - 1]]) {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                              resolvePipeline(permutationKey(visibilityFeatures_[slot])));
+            drawnPermutations_++;
+        }
+
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, materialPipelineLayout_, 2,
+                                1, &visibilityMaterials_[slot], 0, nullptr);
+
+        MaterialResolvePushConstants pc{};
+        pc.material = slot;
+        vkCmdPushConstants(cmd, materialPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(MaterialResolvePushConstants), &pc);
+
+        vkCmdDispatchIndirect(cmd, materialTileBuffers_[frameIdx]->get(),
+                              sizeof(glm::uvec4) * slot);
+    }
+}
+
+void Renderer::drawSkybox(VkCommandBuffer cmd, uint32_t frameIdx)
+{
+    VkRenderingAttachmentInfo colorAttachment{};
+    colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    colorAttachment.imageView = colorAttachment_->view();
+    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+    VkRenderingAttachmentInfo depthStecnilAttachment{};
+    depthStecnilAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depthStecnilAttachment.imageView = msaaDepthStencilAttachment_->view();
+    depthStecnilAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthStecnilAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthStecnilAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+    VkRenderingInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.renderArea = {0, 0, renderExtent_.width, renderExtent_.height};
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &colorAttachment;
+    renderingInfo.pDepthAttachment = &depthStecnilAttachment;
+    renderingInfo.pStencilAttachment = &depthStecnilAttachment;
+    vkCmdBeginRendering(cmd, &renderingInfo);
+
+    VkViewport viewport{};
+    viewport.x = 0.f;
+    viewport.y = 0.f;
+    viewport.width = static_cast<float>(renderExtent_.width);
+    viewport.height = static_cast<float>(renderExtent_.height);
+    viewport.minDepth = 0.f;
+    viewport.maxDepth = 1.f;
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = renderExtent_;
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineSkybox_);
+
+    std::array<VkDescriptorSet, 2> sets{uniformDescriptorSets_[frameIdx], mapDescriptorSet_};
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0,
+                            static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+
+    vkCmdDraw(cmd, 36, 1, 0, 0);
+
+    vkCmdEndRendering(cmd);
 }
 
 void Renderer::createUniform()
 {
+    uint32_t clusterCount = CLUSTER_GRID[0] * CLUSTER_GRID[1] * CLUSTER_GRID[2];
+
     for (uint32_t i = 0; i < Device::MAX_FRAMES_IN_FLIGHT; i++) {
         sceneUniformBuffers_[i] = std::make_unique<Buffer>(device_);
         sceneUniformBuffers_[i]->createUniformBuffer(sizeof(SceneUniform));
 
         skyboxUniformBuffers_[i] = std::make_unique<Buffer>(device_);
         skyboxUniformBuffers_[i]->createUniformBuffer(sizeof(SkyboxUniform));
+
+        lightBuffers_[i] = std::make_unique<Buffer>(device_);
+        lightBuffers_[i]->createStorageBuffer(sizeof(Light) * MAX_LIGHTS);
+
+        clusterBuffers_[i] = std::make_unique<Buffer>(device_);
+        clusterBuffers_[i]->createLocalBuffer(sizeof(uint32_t) * clusterCount *
+                                                  (1 + MAX_CLUSTER_LIGHTS),
+                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+        visibilityDrawBuffers_[i] = std::make_unique<Buffer>(device_);
+        visibilityDrawBuffers_[i]->createStorageBuffer(sizeof(VisibilityDraw) *
+                                                       MAX_VISIBILITY_DRAWS);
     }
 }
 
@@ -286,10 +1085,11 @@ void Renderer::createTextures()
 
 void Renderer::createShadowMap()
 {
-    shadowAttachment_->createImage(VK_FORMAT_D16_UNORM, 2048, 2048,
-                                   VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
-                                       VK_IMAGE_USAGE_SAMPLED_BIT,
-                                   VK_SAMPLE_COUNT_1_BIT);
+    shadowAttachment_->declareImage(VK_FORMAT_D16_UNORM, 2048, 2048,
+                                    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                        VK_IMAGE_USAGE_SAMPLED_BIT,
+                                    VK_SAMPLE_COUNT_1_BIT);
+    graph_->transient("shadow", shadowAttachment_.get());
 
     VkSamplerCreateInfo samplerCI{};
     samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -310,16 +1110,32 @@ void Renderer::createShadowMap()
 
 void Renderer::createDescriptorSetLayout()
 {
-    std::array<VkDescriptorSetLayoutBinding, 2> uniformLayoutBindings{};
+    // the light binning reads the scene and lights and writes the clusters, the material resolve
+    // of the visibility buffer shades from compute with the sets of pbr.frag
+    std::array<VkDescriptorSetLayoutBinding, 4> uniformLayoutBindings{};
     uniformLayoutBindings[0].binding = 0;
     uniformLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     uniformLayoutBindings[0].descriptorCount = 1;
-    uniformLayoutBindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    uniformLayoutBindings[0].stageFlags =
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     uniformLayoutBindings[1].binding = 1;
     uniformLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     uniformLayoutBindings[1].descriptorCount = 1;
-    uniformLayoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    uniformLayoutBindings[1].stageFlags =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    uniformLayoutBindings[2].binding = 2;
+    uniformLayoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    uniformLayoutBindings[2].descriptorCount = 1;
+    uniformLayoutBindings[2].stageFlags =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    uniformLayoutBindings[3].binding = 3;
+    uniformLayoutBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    uniformLayoutBindings[3].descriptorCount = 1;
+    uniformLayoutBindings[3].stageFlags =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     VkDescriptorSetLayoutCreateInfo descSetLayoutCI{
         VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
@@ -333,22 +1149,22 @@ void Renderer::createDescriptorSetLayout()
     mapLayoutBindings[0].binding = 0;
     mapLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     mapLayoutBindings[0].descriptorCount = 1;
-    mapLayoutBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    mapLayoutBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     mapLayoutBindings[1].binding = 1;
     mapLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     mapLayoutBindings[1].descriptorCount = 1;
-    mapLayoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    mapLayoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     mapLayoutBindings[2].binding = 2;
     mapLayoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     mapLayoutBindings[2].descriptorCount = 1;
-    mapLayoutBindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    mapLayoutBindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     mapLayoutBindings[3].binding = 3;
     mapLayoutBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     mapLayoutBindings[3].descriptorCount = 1;
-    mapLayoutBindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    mapLayoutBindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     descSetLayoutCI.bindingCount = static_cast<uint32_t>(mapLayoutBindings.size());
     descSetLayoutCI.pBindings = mapLayoutBindings.data();
@@ -360,38 +1176,77 @@ void Renderer::createDescriptorSetLayout()
     materialLayoutBindings[0].binding = 0;
     materialLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     materialLayoutBindings[0].descriptorCount = 1;
-    materialLayoutBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    materialLayoutBindings[0].stageFlags =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     materialLayoutBindings[1].binding = 1;
     materialLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     materialLayoutBindings[1].descriptorCount = 1;
-    materialLayoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    materialLayoutBindings[1].stageFlags =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     materialLayoutBindings[2].binding = 2;
     materialLayoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     materialLayoutBindings[2].descriptorCount = 1;
-    materialLayoutBindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    materialLayoutBindings[2].stageFlags =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     materialLayoutBindings[3].binding = 3;
     materialLayoutBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     materialLayoutBindings[3].descriptorCount = 1;
-    materialLayoutBindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    materialLayoutBindings[3].stageFlags =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     materialLayoutBindings[4].binding = 4;
     materialLayoutBindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     materialLayoutBindings[4].descriptorCount = 1;
-    materialLayoutBindings[4].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    materialLayoutBindings[4].stageFlags =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     materialLayoutBindings[5].binding = 5;
     materialLayoutBindings[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     materialLayoutBindings[5].descriptorCount = 1;
-    materialLayoutBindings[5].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    materialLayoutBindings[5].stageFlags =
+        VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     descSetLayoutCI.bindingCount = static_cast<uint32_t>(materialLayoutBindings.size());
     descSetLayoutCI.pBindings = materialLayoutBindings.data();
 
     VK_CHECK(vkCreateDescriptorSetLayout(device_->get(), &descSetLayoutCI, nullptr,
-                                         &descriptorSetLayouts_[2]));
+                                         &descriptorSetLayouts_[2]));
+
+    // taa resolve: color, velocity and history sampled, history and output written
+    std::array<VkDescriptorSetLayoutBinding, 5> taaLayoutBindings{};
+    for (uint32_t i = 0; i < taaLayoutBindings.size(); i++) {
+        taaLayoutBindings[i].binding = i;
+        taaLayoutBindings[i].descriptorType = i < 3 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                                                    : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        taaLayoutBindings[i].descriptorCount = 1;
+        taaLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    descSetLayoutCI.bindingCount = static_cast<uint32_t>(taaLayoutBindings.size());
+    descSetLayoutCI.pBindings = taaLayoutBindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(device_->get(), &descSetLayoutCI, nullptr,
+                                         &taaSetLayout_));
+
+    // visibility buffer: ids and draws read, material tiles and the scene color written
+    std::array<VkDescriptorSetLayoutBinding, 4> visibilityLayoutBindings{};
+    for (uint32_t i = 0; i < visibilityLayoutBindings.size(); i++) {
+        visibilityLayoutBindings[i].binding = i;
+        visibilityLayoutBindings[i].descriptorType = i == 1 || i == 2
+                                                         ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+                                                         : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        visibilityLayoutBindings[i].descriptorCount = 1;
+        visibilityLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    descSetLayoutCI.bindingCount = static_cast<uint32_t>(visibilityLayoutBindings.size());
+    descSetLayoutCI.pBindings = visibilityLayoutBindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(device_->get(), &descSetLayoutCI, nullptr,
+                                         &visibilitySetLayout_));
 }
 
 void Renderer::allocateDescriptorSets()
@@ -416,7 +1271,15 @@ void Renderer::allocateDescriptorSets()
         skyboxUniformInfo.buffer = skyboxUniformBuffers_[i]->get();
         skyboxUniformInfo.range = sizeof(SkyboxUniform);
 
-        std::array<VkWriteDescriptorSet, 2> writeUniform{};
+        VkDescriptorBufferInfo lightInfo{};
+        lightInfo.buffer = lightBuffers_[i]->get();
+        lightInfo.range = VK_WHOLE_SIZE;
+
+        VkDescriptorBufferInfo clusterInfo{};
+        clusterInfo.buffer = clusterBuffers_[i]->get();
+        clusterInfo.range = VK_WHOLE_SIZE;
+
+        std::array<VkWriteDescriptorSet, 4> writeUniform{};
         writeUniform[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         writeUniform[0].dstSet = uniformDescriptorSets_[i];
         writeUniform[0].dstBinding = 0;
@@ -431,6 +1294,20 @@ void Renderer::allocateDescriptorSets()
         writeUniform[1].descriptorCount = 1;
         writeUniform[1].pBufferInfo = &skyboxUniformInfo;
 
+        writeUniform[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeUniform[2].dstSet = uniformDescriptorSets_[i];
+        writeUniform[2].dstBinding = 2;
+        writeUniform[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writeUniform[2].descriptorCount = 1;
+        writeUniform[2].pBufferInfo = &lightInfo;
+
+        writeUniform[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeUniform[3].dstSet = uniformDescriptorSets_[i];
+        writeUniform[3].dstBinding = 3;
+        writeUniform[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writeUniform[3].descriptorCount = 1;
+        writeUniform[3].pBufferInfo = &clusterInfo;
+
         vkUpdateDescriptorSets(device_->get(), static_cast<uint32_t>(writeUniform.size()),
                                writeUniform.data(), 0, nullptr);
     }
@@ -456,12 +1333,7 @@ void Renderer::allocateDescriptorSets()
     brdfLutInfo.imageView = skyboxTextures_[2]->view();
     brdfLutInfo.sampler = skyboxTextures_[2]->sampler();
 
-    VkDescriptorImageInfo shodowInfo{};
-    shodowInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    shodowInfo.imageView = shadowAttachment_->view();
-    shodowInfo.sampler = shadowAttachment_->sampler();
-
-    std::array<VkWriteDescriptorSet, 4> writeSampler{};
+    std::array<VkWriteDescriptorSet, 3> writeSampler{};
     writeSampler[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     writeSampler[0].dstSet = mapDescriptorSet_;
     writeSampler[0].dstBinding = 0;
@@ -483,15 +1355,129 @@ void Renderer::allocateDescriptorSets()
     writeSampler[2].descriptorCount = 1;
     writeSampler[2].pImageInfo = &brdfLutInfo;
 
-    writeSampler[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeSampler[3].dstSet = mapDescriptorSet_;
-    writeSampler[3].dstBinding = 3;
-    writeSampler[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    writeSampler[3].descriptorCount = 1;
-    writeSampler[3].pImageInfo = &shodowInfo;
-
     vkUpdateDescriptorSets(device_->get(), static_cast<uint32_t>(writeSampler.size()),
                            writeSampler.data(), 0, nullptr);
+
+    // taa, written once the attachments are allocated
+    std::vector<VkDescriptorSetLayout> taaLayouts(taaDescriptorSets_.size(), taaSetLayout_);
+    descSetAI.descriptorSetCount = static_cast<uint32_t>(taaLayouts.size());
+    descSetAI.pSetLayouts = taaLayouts.data();
+
+    VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, taaDescriptorSets_.data()));
+
+    // visibility buffer, also written once the attachments are allocated
+    std::vector<VkDescriptorSetLayout> visibilityLayouts(Device::MAX_FRAMES_IN_FLIGHT,
+                                                         visibilitySetLayout_);
+    descSetAI.descriptorSetCount = static_cast<uint32_t>(visibilityLayouts.size());
+    descSetAI.pSetLayouts = visibilityLayouts.data();
+
+    VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI,
+                                      visibilityDescriptorSets_.data()));
+}
+
+void Renderer::updateShadowDescriptorSet()
+{
+    VkDescriptorImageInfo shodowInfo{};
+    shodowInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    shodowInfo.imageView = shadowAttachment_->view();
+    shodowInfo.sampler = shadowAttachment_->sampler();
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = mapDescriptorSet_;
+    write.dstBinding = 3;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.descriptorCount = 1;
+    write.pImageInfo = &shodowInfo;
+
+    vkUpdateDescriptorSets(device_->get(), 1, &write, 0, nullptr);
+}
+
+void Renderer::updateTaaDescriptorSets()
+{
+    if (antiAliasing_ != AntiAliasing::Taa) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < taaDescriptorSets_.size(); i++) {
+        // set i writes history i and reads the other one
+        const auto& historyRead = historyTextures_[1 - i];
+        const auto& historyWrite = historyTextures_[i];
+
+        std::array<VkDescriptorImageInfo, 5> imageInfos{};
+        imageInfos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfos[0].imageView = msaaColorAttachment_->view();
+        imageInfos[0].sampler = msaaColorAttachment_->sampler();
+
+        imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfos[1].imageView = velocityAttachment_->view();
+        imageInfos[1].sampler = velocityAttachment_->sampler();
+
+        imageInfos[2].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfos[2].imageView = historyRead->view();
+        imageInfos[2].sampler = historyRead->sampler();
+
+        imageInfos[3].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        imageInfos[3].imageView = historyWrite->view();
+
+        imageInfos[4].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        imageInfos[4].imageView = colorAttachment_->view();
+
+        std::array<VkWriteDescriptorSet, 5> writes{};
+        for (uint32_t binding = 0; binding < writes.size(); binding++) {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = taaDescriptorSets_[i];
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorType = binding < 3
+                                                 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                                                 : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[binding].descriptorCount = 1;
+            writes[binding].pImageInfo = &imageInfos[binding];
+        }
+
+        vkUpdateDescriptorSets(device_->get(), static_cast<uint32_t>(writes.size()),
+                               writes.data(), 0, nullptr);
+    }
+}
+
+void Renderer::updateVisibilityDescriptorSets()
+{
+    for (uint32_t i = 0; i < Device::MAX_FRAMES_IN_FLIGHT; i++) {
+        VkDescriptorImageInfo visibilityInfo{};
+        visibilityInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        visibilityInfo.imageView = visibilityAttachment_->view();
+
+        VkDescriptorBufferInfo drawInfo{};
+        drawInfo.buffer = visibilityDrawBuffers_[i]->get();
+        drawInfo.range = VK_WHOLE_SIZE;
+
+        VkDescriptorBufferInfo tileInfo{};
+        tileInfo.buffer = materialTileBuffers_[i]->get();
+        tileInfo.range = VK_WHOLE_SIZE;
+
+        VkDescriptorImageInfo outputInfo{};
+        outputInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        outputInfo.imageView = colorAttachment_->view();
+
+        std::array<VkWriteDescriptorSet, 4> writes{};
+        for (uint32_t binding = 0; binding < writes.size(); binding++) {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = visibilityDescriptorSets_[i];
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+        }
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[0].pImageInfo = &visibilityInfo;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[1].pBufferInfo = &drawInfo;
+        writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[2].pBufferInfo = &tileInfo;
+        writes[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[3].pImageInfo = &outputInfo;
+
+        vkUpdateDescriptorSets(device_->get(), static_cast<uint32_t>(writes.size()),
+                               writes.data(), 0, nullptr);
+    }
 }
 
 void Renderer::createPipelineLayout()
@@ -509,12 +1495,41 @@ void Renderer::createPipelineLayout()
     pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
 
     VK_CHECK(vkCreatePipelineLayout(device_->get(), &pipelineLayoutCI, nullptr, &pipelineLayout_));
+
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.size = sizeof(TaaPushConstants);
+
+    pipelineLayoutCI.setLayoutCount = 1;
+    pipelineLayoutCI.pSetLayouts = &taaSetLayout_;
+
+    VK_CHECK(
+        vkCreatePipelineLayout(device_->get(), &pipelineLayoutCI, nullptr, &taaPipelineLayout_));
+
+    pipelineLayoutCI.pSetLayouts = &descriptorSetLayouts_[0];
+    pipelineLayoutCI.pushConstantRangeCount = 0;
+    pipelineLayoutCI.pPushConstantRanges = nullptr;
+
+    VK_CHECK(vkCreatePipelineLayout(device_->get(), &pipelineLayoutCI, nullptr,
+                                    &clusterPipelineLayout_));
+
+    std::array<VkDescriptorSetLayout, 4> materialSetLayouts{
+        descriptorSetLayouts_[0], descriptorSetLayouts_[1], descriptorSetLayouts_[2],
+        visibilitySetLayout_};
+    pushConstantRange.size = sizeof(MaterialResolvePushConstants);
+
+    pipelineLayoutCI.setLayoutCount = static_cast<uint32_t>(materialSetLayouts.size());
+    pipelineLayoutCI.pSetLayouts = materialSetLayouts.data();
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(device_->get(), &pipelineLayoutCI, nullptr,
+                                    &materialPipelineLayout_));
 }
 
-void Renderer::createPipeline()
+VkPipeline Renderer::createPipeline(uint32_t key)
 {
-    VkShaderModule vertexModule = device_->createShaderModule("./shaders/pbr.vert.spv");
-    VkShaderModule fragmentModule = device_->createShaderModule("./shaders/pbr.frag.spv");
+    VkShaderModule vertexModule = device_->shaderModule("./shaders/pbr.vert.spv");
+    VkShaderModule fragmentModule = device_->shaderModule("./shaders/pbr.frag.spv");
 
     std::array<VkPipelineShaderStageCreateInfo, 2> shaderSCIs{};
     shaderSCIs[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -527,6 +1542,16 @@ void Renderer::createPipeline()
     shaderSCIs[1].module = fragmentModule;
     shaderSCIs[1].pName = "main";
 
+    MaterialSpecialization specialization = materialSpecialization(key);
+    auto specializationEntries = materialSpecializationEntries();
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = sizeof(MaterialSpecialization);
+    specializationInfo.pData = &specialization;
+    shaderSCIs[1].pSpecializationInfo = &specializationInfo;
+
     auto bindingDescription = Vertex::getBindingDescrption();
     auto attributeDescriptions = Vertex::getAttributeDescriptions();
 
@@ -560,14 +1585,16 @@ void Renderer::createPipeline()
 
     VkPipelineMultisampleStateCreateInfo multisampleSCI{};
     multisampleSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampleSCI.rasterizationSamples = device_->smapleCount();
+    multisampleSCI.rasterizationSamples = samples();
     multisampleSCI.sampleShadingEnable = VK_FALSE;
 
+    // the pre-pass laid down the depth, only the surface that won it is shaded
+    bool depthEqual = (key & PERMUTATION_DEPTH_EQUAL) != 0;
     VkPipelineDepthStencilStateCreateInfo depthStencilSCI{};
     depthStencilSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depthStencilSCI.depthTestEnable = VK_TRUE;
-    depthStencilSCI.depthWriteEnable = VK_TRUE;
-    depthStencilSCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    depthStencilSCI.depthWriteEnable = depthEqual ? VK_FALSE : VK_TRUE;
+    depthStencilSCI.depthCompareOp = depthEqual ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS_OR_EQUAL;
     depthStencilSCI.depthBoundsTestEnable = VK_FALSE;
     depthStencilSCI.stencilTestEnable = VK_FALSE;
     depthStencilSCI.front.failOp = VK_STENCIL_OP_KEEP;
@@ -595,8 +1622,14 @@ void Renderer::createPipeline()
     colorBlendSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
     colorBlendSCI.logicOpEnable = VK_FALSE;
     colorBlendSCI.logicOp = VK_LOGIC_OP_COPY;
-    colorBlendSCI.attachmentCount = 1;
-    colorBlendSCI.pAttachments = &colorBlendAttachmentState;
+    // taa adds the velocity attachment
+    std::array<VkPipelineColorBlendAttachmentState, 2> colorBlendAttachmentStates{
+        colorBlendAttachmentState, colorBlendAttachmentState};
+    uint32_t colorAttachmentCount = antiAliasing_ == AntiAliasing::Taa ? 2 : 1;
+    std::array<VkFormat, 2> colorFormats{colorAttachment_->format(), VELOCITY_FORMAT};
+
+    colorBlendSCI.attachmentCount = colorAttachmentCount;
+    colorBlendSCI.pAttachments = colorBlendAttachmentStates.data();
     colorBlendSCI.blendConstants[0] = 0.f;
     colorBlendSCI.blendConstants[1] = 0.f;
     colorBlendSCI.blendConstants[2] = 0.f;
@@ -612,8 +1645,8 @@ void Renderer::createPipeline()
 
     VkPipelineRenderingCreateInfo renderingCI{};
     renderingCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
-    renderingCI.colorAttachmentCount = 1;
-    renderingCI.pColorAttachmentFormats = &colorAttachment_->format();
+    renderingCI.colorAttachmentCount = colorAttachmentCount;
+    renderingCI.pColorAttachmentFormats = colorFormats.data();
     renderingCI.depthAttachmentFormat = device_->depthStencilFormat();
     renderingCI.stencilAttachmentFormat = device_->depthStencilFormat();
 
@@ -636,17 +1669,13 @@ void Renderer::createPipeline()
     pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
     pipelineCI.basePipelineIndex = -1;
 
-    VK_CHECK(vkCreateGraphicsPipelines(device_->get(), device_->cache(), 1, &pipelineCI, nullptr,
-                                       &pipeline_));
-
-    vkDestroyShaderModule(device_->get(), vertexModule, nullptr);
-    vkDestroyShaderModule(device_->get(), fragmentModule, nullptr);
+    return device_->createGraphicsPipeline(pipelineCI);
 }
 
 void Renderer::createPipelineSkybox()
 {
-    VkShaderModule vertexModule = device_->createShaderModule("./shaders/skybox.vert.spv");
-    VkShaderModule fragmentModule = device_->createShaderModule("./shaders/skybox.frag.spv");
+    VkShaderModule vertexModule = device_->shaderModule("./shaders/skybox.vert.spv");
+    VkShaderModule fragmentModule = device_->shaderModule("./shaders/skybox.frag.spv");
 
     std::array<VkPipelineShaderStageCreateInfo, 2> shaderSCIs{};
     shaderSCIs[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -684,7 +1713,7 @@ void Renderer::createPipelineSkybox()
 
     VkPipelineMultisampleStateCreateInfo multisampleSCI{};
     multisampleSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampleSCI.rasterizationSamples = device_->smapleCount();
+    multisampleSCI.rasterizationSamples = samples();
     multisampleSCI.sampleShadingEnable = VK_FALSE;
 
     VkPipelineDepthStencilStateCreateInfo depthStencilSCI{};
@@ -719,8 +1748,14 @@ void Renderer::createPipelineSkybox()
     colorBlendSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
     colorBlendSCI.logicOpEnable = VK_FALSE;
     colorBlendSCI.logicOp = VK_LOGIC_OP_COPY;
-    colorBlendSCI.attachmentCount = 1;
-    colorBlendSCI.pAttachments = &colorBlendAttachmentState;
+    // taa adds the velocity attachment
+    std::array<VkPipelineColorBlendAttachmentState, 2> colorBlendAttachmentStates{
+        colorBlendAttachmentState, colorBlendAttachmentState};
+    uint32_t colorAttachmentCount = antiAliasing_ == AntiAliasing::Taa ? 2 : 1;
+    std::array<VkFormat, 2> colorFormats{colorAttachment_->format(), VELOCITY_FORMAT};
+
+    colorBlendSCI.attachmentCount = colorAttachmentCount;
+    colorBlendSCI.pAttachments = colorBlendAttachmentStates.data();
     colorBlendSCI.blendConstants[0] = 0.f;
     colorBlendSCI.blendConstants[1] = 0.f;
     colorBlendSCI.blendConstants[2] = 0.f;
@@ -736,8 +1771,8 @@ void Renderer::createPipelineSkybox()
 
     VkPipelineRenderingCreateInfo renderingCI{};
     renderingCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
-    renderingCI.colorAttachmentCount = 1;
-    renderingCI.pColorAttachmentFormats = &colorAttachment_->format();
+    renderingCI.colorAttachmentCount = colorAttachmentCount;
+    renderingCI.pColorAttachmentFormats = colorFormats.data();
     renderingCI.depthAttachmentFormat = device_->depthStencilFormat();
     renderingCI.stencilAttachmentFormat = device_->depthStencilFormat();
 
@@ -760,17 +1795,13 @@ void Renderer::createPipelineSkybox()
     pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
     pipelineCI.basePipelineIndex = -1;
 
-    VK_CHECK(vkCreateGraphicsPipelines(device_->get(), device_->cache(), 1, &pipelineCI, nullptr,
-                                       &pipelineSkybox_));
-
-    vkDestroyShaderModule(device_->get(), vertexModule, nullptr);
-    vkDestroyShaderModule(device_->get(), fragmentModule, nullptr);
+    pipelineSkybox_ = device_->createGraphicsPipeline(pipelineCI);
 }
 
 void Renderer::createPipelineShadow()
 {
-    VkShaderModule vertexModule = device_->createShaderModule("./shaders/shadow.vert.spv");
-    VkShaderModule fragmentModule = device_->createShaderModule("./shaders/shadow.frag.spv");
+    VkShaderModule vertexModule = device_->shaderModule("./shaders/shadow.vert.spv");
+    VkShaderModule fragmentModule = device_->shaderModule("./shaders/shadow.frag.spv");
 
     std::array<VkPipelineShaderStageCreateInfo, 2> shaderSCIs{};
     shaderSCIs[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -885,11 +1916,277 @@ void Renderer::createPipelineShadow()
     pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
     pipelineCI.basePipelineIndex = -1;
 
-    VK_CHECK(vkCreateGraphicsPipelines(device_->get(), device_->cache(), 1, &pipelineCI, nullptr,
-                                       &pipelineShadow_));
+    pipelineShadow_ = device_->createGraphicsPipeline(pipelineCI);
+}
+
+void Renderer::createPipelineDepthPrepass()
+{
+    // no fragment stage, every material is opaque so depth is all the pass writes
+    VkPipelineShaderStageCreateInfo shaderSCI{};
+    shaderSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderSCI.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderSCI.module = device_->shaderModule("./shaders/depth_prepass.vert.spv");
+    shaderSCI.pName = "main";
+
+    auto bindingDescription = Vertex::getBindingDescrption();
+    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+
+    VkPipelineVertexInputStateCreateInfo vertexInputSCI{};
+    vertexInputSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputSCI.vertexBindingDescriptionCount = 1;
+    vertexInputSCI.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputSCI.vertexAttributeDescriptionCount = 1;
+    vertexInputSCI.pVertexAttributeDescriptions = &attributeDescriptions[0];
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblySCI{};
+    inputAssemblySCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblySCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblySCI.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineViewportStateCreateInfo viewportSCI{};
+    viewportSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportSCI.viewportCount = 1;
+    viewportSCI.scissorCount = 1;
+
+    // same rasterization as the main pipeline so the equal test passes
+    VkPipelineRasterizationStateCreateInfo rasterizationSCI{};
+    rasterizationSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationSCI.depthClampEnable = VK_FALSE;
+    rasterizationSCI.rasterizerDiscardEnable = VK_FALSE;
+    rasterizationSCI.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizationSCI.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizationSCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizationSCI.depthBiasEnable = VK_FALSE;
+    rasterizationSCI.lineWidth = 1.f;
+
+    VkPipelineMultisampleStateCreateInfo multisampleSCI{};
+    multisampleSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleSCI.rasterizationSamples = samples();
+    multisampleSCI.sampleShadingEnable = VK_FALSE;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilSCI{};
+    depthStencilSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilSCI.depthTestEnable = VK_TRUE;
+    depthStencilSCI.depthWriteEnable = VK_TRUE;
+    depthStencilSCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    depthStencilSCI.depthBoundsTestEnable = VK_FALSE;
+    depthStencilSCI.stencilTestEnable = VK_FALSE;
+    depthStencilSCI.minDepthBounds = 0.f;
+    depthStencilSCI.maxDepthBounds = 1.f;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendSCI{};
+    colorBlendSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendSCI.logicOpEnable = VK_FALSE;
+    colorBlendSCI.attachmentCount = 0;
+    colorBlendSCI.pAttachments = nullptr;
+
+    std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
+                                                 VK_DYNAMIC_STATE_SCISSOR};
+
+    VkPipelineDynamicStateCreateInfo dynamicSCI{};
+    dynamicSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicSCI.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicSCI.pDynamicStates = dynamicStates.data();
+
+    VkPipelineRenderingCreateInfo renderingCI{};
+    renderingCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    renderingCI.colorAttachmentCount = 0;
+    renderingCI.pColorAttachmentFormats = nullptr;
+    renderingCI.depthAttachmentFormat = device_->depthStencilFormat();
+    renderingCI.stencilAttachmentFormat = device_->depthStencilFormat();
+
+    VkGraphicsPipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCI.pNext = &renderingCI;
+    pipelineCI.stageCount = 1;
+    pipelineCI.pStages = &shaderSCI;
+    pipelineCI.pVertexInputState = &vertexInputSCI;
+    pipelineCI.pInputAssemblyState = &inputAssemblySCI;
+    pipelineCI.pViewportState = &viewportSCI;
+    pipelineCI.pRasterizationState = &rasterizationSCI;
+    pipelineCI.pMultisampleState = &multisampleSCI;
+    pipelineCI.pDepthStencilState = &depthStencilSCI;
+    pipelineCI.pColorBlendState = &colorBlendSCI;
+    pipelineCI.pDynamicState = &dynamicSCI;
+    pipelineCI.layout = pipelineLayout_;
+    pipelineCI.renderPass = VK_NULL_HANDLE;
+    pipelineCI.subpass = 0;
+    pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineCI.basePipelineIndex = -1;
+
+    pipelineDepthPrepass_ = device_->createGraphicsPipeline(pipelineCI);
+}
+
+void Renderer::createPipelineTaa()
+{
+    VkComputePipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCI.stage.module = device_->hdrShaderModule("taa");
+    pipelineCI.stage.pName = "main";
+    pipelineCI.layout = taaPipelineLayout_;
+
+    pipelineTaa_ = device_->createComputePipeline(pipelineCI);
+}
+
+void Renderer::createPipelineLightCluster()
+{
+    VkComputePipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCI.stage.module = device_->shaderModule("./shaders/light_cluster.comp.spv");
+    pipelineCI.stage.pName = "main";
+    pipelineCI.layout = clusterPipelineLayout_;
+
+    pipelineLightCluster_ = device_->createComputePipeline(pipelineCI);
+}
+
+void Renderer::createPipelineVisibility()
+{
+    VkShaderModule vertexModule = device_->shaderModule("./shaders/visibility.vert.spv");
+    VkShaderModule fragmentModule = device_->shaderModule("./shaders/visibility.frag.spv");
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderSCIs{};
+    shaderSCIs[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderSCIs[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderSCIs[0].module = vertexModule;
+    shaderSCIs[0].pName = "main";
+
+    shaderSCIs[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderSCIs[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderSCIs[1].module = fragmentModule;
+    shaderSCIs[1].pName = "main";
+
+    // position only, the resolve fetches the other attributes itself
+    auto bindingDescription = Vertex::getBindingDescrption();
+    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+
+    VkPipelineVertexInputStateCreateInfo vertexInputSCI{};
+    vertexInputSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputSCI.vertexBindingDescriptionCount = 1;
+    vertexInputSCI.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputSCI.vertexAttributeDescriptionCount = 1;
+    vertexInputSCI.pVertexAttributeDescriptions = &attributeDescriptions[0];
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblySCI{};
+    inputAssemblySCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblySCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblySCI.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineViewportStateCreateInfo viewportSCI{};
+    viewportSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportSCI.viewportCount = 1;
+    viewportSCI.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizationSCI{};
+    rasterizationSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationSCI.depthClampEnable = VK_FALSE;
+    rasterizationSCI.rasterizerDiscardEnable = VK_FALSE;
+    rasterizationSCI.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizationSCI.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizationSCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizationSCI.depthBiasEnable = VK_FALSE;
+    rasterizationSCI.lineWidth = 1.f;
+
+    VkPipelineMultisampleStateCreateInfo multisampleSCI{};
+    multisampleSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleSCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampleSCI.sampleShadingEnable = VK_FALSE;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilSCI{};
+    depthStencilSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilSCI.depthTestEnable = VK_TRUE;
+    depthStencilSCI.depthWriteEnable = VK_TRUE;
+    depthStencilSCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    depthStencilSCI.depthBoundsTestEnable = VK_FALSE;
+    depthStencilSCI.stencilTestEnable = VK_FALSE;
+    depthStencilSCI.minDepthBounds = 0.f;
+    depthStencilSCI.maxDepthBounds = 1.f;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachmentState{};
+    colorBlendAttachmentState.blendEnable = VK_FALSE;
+    colorBlendAttachmentState.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendSCI{};
+    colorBlendSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendSCI.logicOpEnable = VK_FALSE;
+    colorBlendSCI.attachmentCount = 1;
+    colorBlendSCI.pAttachments = &colorBlendAttachmentState;
+
+    std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
+                                                 VK_DYNAMIC_STATE_SCISSOR};
+
+    VkPipelineDynamicStateCreateInfo dynamicSCI{};
+    dynamicSCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicSCI.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicSCI.pDynamicStates = dynamicStates.data();
+
+    VkPipelineRenderingCreateInfo renderingCI{};
+    renderingCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    renderingCI.colorAttachmentCount = 1;
+    renderingCI.pColorAttachmentFormats = &VISIBILITY_FORMAT;
+    renderingCI.depthAttachmentFormat = device_->depthStencilFormat();
+    renderingCI.stencilAttachmentFormat = device_->depthStencilFormat();
+
+    VkGraphicsPipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCI.pNext = &renderingCI;
+    pipelineCI.stageCount = static_cast<uint32_t>(shaderSCIs.size());
+    pipelineCI.pStages = shaderSCIs.data();
+    pipelineCI.pVertexInputState = &vertexInputSCI;
+    pipelineCI.pInputAssemblyState = &inputAssemblySCI;
+    pipelineCI.pViewportState = &viewportSCI;
+    pipelineCI.pRasterizationState = &rasterizationSCI;
+    pipelineCI.pMultisampleState = &multisampleSCI;
+    pipelineCI.pDepthStencilState = &depthStencilSCI;
+    pipelineCI.pColorBlendState = &colorBlendSCI;
+    pipelineCI.pDynamicState = &dynamicSCI;
+    pipelineCI.layout = pipelineLayout_;
+    pipelineCI.renderPass = VK_NULL_HANDLE;
+    pipelineCI.subpass = 0;
+    pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineCI.basePipelineIndex = -1;
+
+    pipelineVisibility_ = device_->createGraphicsPipeline(pipelineCI);
+}
+
+void Renderer::createPipelineMaterialClassify()
+{
+    VkComputePipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCI.stage.module = device_->shaderModule("./shaders/material_classify.comp.spv");
+    pipelineCI.stage.pName = "main";
+    pipelineCI.layout = materialPipelineLayout_;
+
+    pipelineMaterialClassify_ = device_->createComputePipeline(pipelineCI);
+}
 
-    vkDestroyShaderModule(device_->get(), vertexModule, nullptr);
-    vkDestroyShaderModule(device_->get(), fragmentModule, nullptr);
+VkPipeline Renderer::createPipelineMaterialResolve(uint32_t key)
+{
+    MaterialSpecialization specialization = materialSpecialization(key);
+    auto specializationEntries = materialSpecializationEntries();
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = sizeof(MaterialSpecialization);
+    specializationInfo.pData = &specialization;
+
+    VkComputePipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCI.stage.module = device_->hdrShaderModule("material_resolve");
+    pipelineCI.stage.pName = "main";
+    pipelineCI.stage.pSpecializationInfo = &specializationInfo;
+    pipelineCI.layout = materialPipelineLayout_;
+
+    return device_->createComputePipeline(pipelineCI);
 }
 
 } // namespace guk
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "Image2D.h"
 #include "Buffer.h"
+#include "RenderGraph.h"
 #include "DataStructures.h"
 #include "Model.h"
 #include "ViewFrustum.h"
@@ -11,29 +12,96 @@ namespace guk {
 class Renderer
 {
   public:
-    Renderer(std::shared_ptr<Device> device, uint32_t width, uint32_t height);
+    static constexpr uint32_t MAX_LIGHTS{4096};
+    // froxels the lights are binned into, matches light_cluster.comp and pbr.frag
+    static constexpr std::array<uint32_t, 3> CLUSTER_GRID{16, 9, 24};
+    static constexpr uint32_t MAX_CLUSTER_LIGHTS{128};
+    // meshes and distinct materials of a visibility buffer frame, past them it renders forward
+    static constexpr uint32_t MAX_VISIBILITY_DRAWS{16384};
+    // matches material_classify.comp and material_resolve.comp
+    static constexpr uint32_t MAX_VISIBILITY_MATERIALS{64};
+    // permutation key of the material pipelines: the texture bits of Model::materialFeatures,
+    // the shadow filter above them and the equal depth test of the pre-pass on top
+    static constexpr uint32_t MATERIAL_FEATURE_BITS{5};
+    static constexpr uint32_t PERMUTATION_DEPTH_EQUAL{1u << (MATERIAL_FEATURE_BITS + 2)};
+
+    Renderer(std::shared_ptr<Device> device, std::shared_ptr<RenderGraph> graph,
+             std::shared_ptr<TextureStreamer> textureStreamer, uint32_t width, uint32_t height);
     ~Renderer();
 
-    void allocateModelDescriptorSets(std::vector<Model>& models);
+    void allocateModelDescriptorSets(Model& model);
+    // attachments are allocated at width x height, the scene renders into the top left
+    // renderExtent so the render scale changes without reallocation
     void createAttachments(uint32_t width, uint32_t height);
+    void setRenderScale(float scale);
+    float renderScale() const;
+    VkExtent2D renderExtent() const;
+
+    // recreates the scene attachments and pipelines, the caller waits for the queue
+    void setAntiAliasing(AntiAliasing antiAliasing);
+    AntiAliasing antiAliasing() const;
+    // recreates the scene attachments and pipelines, the caller waits for the queue
+    void setSceneFormat(VkFormat format);
+    // depth only pass before the main pass, which then shades each pixel once with an equal test
+    bool& depthPrepass();
+    // draw and triangle ids only in the main pass, shaded per material from compute. single
+    // sample scenes without taa only, fragment shaders need gl_PrimitiveID
+    bool& visibilityBuffer();
+    bool visibilityBufferSupported() const;
+    // part of the permutation key, switching only picks other pipelines
+    ShadowFilter& shadowFilter();
+    // material pipelines created so far, they are made on first use
+    uint32_t cachedPermutations() const;
+    VkFormat sceneFormat() const;
+    // scene images of the current mode, without render graph aliasing
+    VkDeviceSize attachmentMemory() const;
     std::shared_ptr<Image2D> colorAttachment() const;
     std::shared_ptr<Image2D> shadowAttachment() const;
 
-    void update(uint32_t frameIdx, SceneUniform sceneUniform, SkyboxUniform skyboxUniform);
-    void draw(VkCommandBuffer cmd, uint32_t frameIdx, std::vector<Model> models);
-    void drawShadow(VkCommandBuffer cmd, uint32_t frameIdx, std::vector<Model> models);
+    // lights past MAX_LIGHTS are dropped
+    void update(uint32_t frameIdx, SceneUniform sceneUniform, SkyboxUniform skyboxUniform,
+                const std::vector<Light>& lights);
+    void addPasses(uint32_t frameIdx, const std::vector<Model>& models);
 
     uint32_t totalMeshes_{};
     uint32_t renderedMeshes_{};
     uint32_t culledMeshes_{};
+    uint32_t drawnPermutations_{};
 
   private:
     std::shared_ptr<Device> device_;
+    std::shared_ptr<RenderGraph> graph_;
+    std::shared_ptr<TextureStreamer> textureStreamer_;
     ViewFrustum viewFrustum_{};
+    glm::vec3 cameraPos_{};
+    float projScale_{};
+    float renderScale_{1.f};
+    VkExtent2D renderExtent_{};
+
+    // weight of the current frame in the taa history
+    static constexpr float TAA_BLEND{0.1f};
+    static constexpr VkFormat VELOCITY_FORMAT{VK_FORMAT_R16G16_SFLOAT};
+    AntiAliasing antiAliasing_{};
+    bool depthPrepass_{};
+    static constexpr VkFormat VISIBILITY_FORMAT{VK_FORMAT_R32G32_UINT};
+    // square tiles material_classify.comp sorts by material
+    static constexpr uint32_t MATERIAL_TILE_SIZE{16};
+    bool visibilityBuffer_{};
+    ShadowFilter shadowFilter_{ShadowFilter::Pcf3x3};
+    // hdr scene color, the taa history keeps its own 16 bit float format
+    VkFormat sceneFormat_{VK_FORMAT_R16G16B16A16_SFLOAT};
+    static constexpr VkFormat HISTORY_FORMAT{VK_FORMAT_R16G16B16A16_SFLOAT};
+    uint32_t historyIdx_{};
+    bool historyValid_{};
+    glm::vec2 prevSceneScale_{1.f};
+    uint32_t lightCount_{};
 
     std::unique_ptr<Image2D> msaaColorAttachment_;
     std::shared_ptr<Image2D> colorAttachment_;
     std::unique_ptr<Image2D> msaaDepthStencilAttachment_;
+    std::unique_ptr<Image2D> velocityAttachment_;
+    std::unique_ptr<Image2D> visibilityAttachment_;
+    std::array<std::unique_ptr<Image2D>, 2> historyTextures_;
     std::array<std::unique_ptr<Image2D>, 3> skyboxTextures_;
     std::shared_ptr<Image2D> dummyTexture_{};
     std::shared_ptr<Image2D> shadowAttachment_;
@@ -41,15 +109,52 @@ class Renderer
 
     std::array<std::unique_ptr<Buffer>, Device::MAX_FRAMES_IN_FLIGHT> sceneUniformBuffers_;
     std::array<std::unique_ptr<Buffer>, Device::MAX_FRAMES_IN_FLIGHT> skyboxUniformBuffers_;
+    std::array<std::unique_ptr<Buffer>, Device::MAX_FRAMES_IN_FLIGHT> lightBuffers_;
+    // light count of each cluster followed by MAX_CLUSTER_LIGHTS indices per cluster
+    std::array<std::unique_ptr<Buffer>, Device::MAX_FRAMES_IN_FLIGHT> clusterBuffers_;
+    std::array<std::unique_ptr<Buffer>, Device::MAX_FRAMES_IN_FLIGHT> visibilityDrawBuffers_;
+    // indirect dispatch of each material slot, then a list of tiles per slot as long as the
+    // tile count of the attachments
+    std::array<std::unique_ptr<Buffer>, Device::MAX_FRAMES_IN_FLIGHT> materialTileBuffers_;
+
+    // meshes of the visibility draw buffer in order and the material set of each slot
+    std::vector<std::pair<const Mesh*, glm::mat4>> visibilityMeshes_;
+    std::vector<VkDescriptorSet> visibilityMaterials_;
+    std::vector<uint32_t> visibilityFeatures_;
 
     std::array<VkDescriptorSetLayout, 3> descriptorSetLayouts_{};
     std::array<VkDescriptorSet, Device::MAX_FRAMES_IN_FLIGHT> uniformDescriptorSets_{};
     VkDescriptorSet mapDescriptorSet_{};
+    VkDescriptorSetLayout taaSetLayout_{};
+    // one per history image written
+    std::array<VkDescriptorSet, 2> taaDescriptorSets_{};
+    VkDescriptorSetLayout visibilitySetLayout_{};
+    std::array<VkDescriptorSet, Device::MAX_FRAMES_IN_FLIGHT> visibilityDescriptorSets_{};
 
     VkPipelineLayout pipelineLayout_{};
-    VkPipeline pipeline_{};
+    // pbr pipelines by permutation key
+    std::unordered_map<uint32_t, VkPipeline> pipelines_;
+    VkPipeline pipelineDepthPrepass_{};
     VkPipeline pipelineSkybox_{};
     VkPipeline pipelineShadow_{};
+    VkPipelineLayout taaPipelineLayout_{};
+    VkPipeline pipelineTaa_{};
+    VkPipelineLayout clusterPipelineLayout_{};
+    VkPipeline pipelineLightCluster_{};
+    VkPipeline pipelineVisibility_{};
+    // sets 0 to 2 of pipelineLayout_ and the visibility set
+    VkPipelineLayout materialPipelineLayout_{};
+    VkPipeline pipelineMaterialClassify_{};
+    // material_resolve.comp pipelines by permutation key, never with the depth bit
+    std::unordered_map<uint32_t, VkPipeline> resolvePipelines_;
+
+    VkSampleCountFlagBits samples() const;
+    // projected size of the mesh bounds, feedback for texture streaming
+    float projectedPixels(const Mesh& mesh, const glm::mat4& modelMatrix) const;
+    uint32_t permutationKey(uint32_t features) const;
+    // cached pipeline of the key, created on a miss
+    VkPipeline pipeline(uint32_t key);
+    VkPipeline resolvePipeline(uint32_t key);
 
     void createUniform();
     void createTextures();
@@ -57,11 +162,35 @@ class Renderer
 
     void createDescriptorSetLayout();
     void allocateDescriptorSets();
+    void updateShadowDescriptorSet();
+    void updateTaaDescriptorSets();
+    void updateVisibilityDescriptorSets();
 
     void createPipelineLayout();
-    void createPipeline();
+    VkPipeline createPipeline(uint32_t key);
     void createPipelineSkybox();
     void createPipelineShadow();
+    void createPipelineDepthPrepass();
+    void createPipelineTaa();
+    void createPipelineLightCluster();
+    void createPipelineVisibility();
+    void createPipelineMaterialClassify();
+    VkPipeline createPipelineMaterialResolve(uint32_t key);
+
+    // culls the meshes into the draw buffer, false when they exceed the visibility limits
+    bool buildVisibilityDraws(uint32_t frameIdx, const std::vector<Model>& models);
+    void addVisibilityPasses(uint32_t frameIdx);
+
+    void draw(VkCommandBuffer cmd, uint32_t frameIdx, std::vector<Model> models);
+    void drawShadow(VkCommandBuffer cmd, uint32_t frameIdx, std::vector<Model> models);
+    void drawDepthPrepass(VkCommandBuffer cmd, uint32_t frameIdx,
+                          const std::vector<Model>& models);
+    void resolveTaa(VkCommandBuffer cmd, uint32_t historyIdx, bool reset);
+    void binLights(VkCommandBuffer cmd, uint32_t frameIdx);
+    void drawVisibility(VkCommandBuffer cmd, uint32_t frameIdx);
+    void classifyMaterials(VkCommandBuffer cmd, uint32_t frameIdx);
+    void resolveMaterials(VkCommandBuffer cmd, uint32_t frameIdx);
+    void drawSkybox(VkCommandBuffer cmd, uint32_t frameIdx);
 };
 
 } // namespace guk
\ No newline at end of file
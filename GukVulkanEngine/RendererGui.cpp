@@ -13,7 +13,7 @@ RendererGui::RendererGui(std::shared_ptr<Device> device, VkFormat colorFormat)
     createDescriptorSetLayout();
     allocateDescriptorSets();
     createPipelineLayout();
-    createPipeline(colorFormat);
+    device_->compilePipeline([this, colorFormat]() { createPipeline(colorFormat); });
 }
 
 RendererGui::~RendererGui()
@@ -264,8 +264,8 @@ void RendererGui::createPipelineLayout()
 
 void RendererGui::createPipeline(VkFormat colorFormat)
 {
-    VkShaderModule vertexModule = device_->createShaderModule("shaders/imgui.vert.spv");
-    VkShaderModule fragmentModule = device_->createShaderModule("shaders/imgui.frag.spv");
+    VkShaderModule vertexModule = device_->shaderModule("shaders/imgui.vert.spv");
+    VkShaderModule fragmentModule = device_->shaderModule("shaders/imgui.frag.spv");
 
     std::array<VkPipelineShaderStageCreateInfo, 2> shaderSCIs{};
     shaderSCIs[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -396,11 +396,7 @@ void RendererGui::createPipeline(VkFormat colorFormat)
     pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
     pipelineCI.basePipelineIndex = -1;
 
-    VK_CHECK(vkCreateGraphicsPipelines(device_->get(), device_->cache(), 1, &pipelineCI, nullptr,
-                                       &pipeline_));
-
-    vkDestroyShaderModule(device_->get(), vertexModule, nullptr);
-    vkDestroyShaderModule(device_->get(), fragmentModule, nullptr);
+    pipeline_ = device_->createGraphicsPipeline(pipelineCI);
 }
 
 void RendererGui::createBuffer(uint32_t frameIdx, VkBufferUsageFlagBits usage, VkDeviceSize size)
@@ -1,36 +1,82 @@
 #include "RendererPost.h"
 #include "Logger.h"
 
+#include <algorithm>
+
 namespace guk {
 
-RendererPost::RendererPost(std::shared_ptr<Device> device, VkFormat colorFormat, uint32_t width,
+RendererPost::RendererPost(std::shared_ptr<Device> device, std::shared_ptr<RenderGraph> graph,
+                           VkFormat colorFormat, bool storageTarget, uint32_t width,
                            uint32_t height, std::shared_ptr<Image2D> sceneTexture,
                            std::shared_ptr<Image2D> shadowTexture)
-    : device_(device), sceneTexture_(sceneTexture), shadowTexture_(shadowTexture),
+    : device_(device), graph_(graph), sceneTexture_(sceneTexture), shadowTexture_(shadowTexture),
+      storageTarget_(storageTarget), fusedPost_(storageTarget),
       bloomImage_(std::make_unique<Image2D>(device_)),
-      uniformBuffers_(std::make_unique<Buffer>(device_))
+      uniformBuffers_(std::make_unique<Buffer>(device_)),
+      bloomCounter_(std::make_unique<Buffer>(device_)),
+      aaImage_(std::make_unique<Image2D>(device_)),
+      smaaEdges_(std::make_unique<Image2D>(device_)),
+      smaaWeights_(std::make_unique<Image2D>(device_))
 {
+    for (auto& bloomTexture : bloomTextures_) {
+        bloomTexture = std::make_unique<Image2D>(device_);
+    }
+
+    uint32_t groups{};
+    bloomCounter_->createLocalBuffer(&groups, sizeof(groups), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
     createBloomImage(width, height);
+    createAntiAliasingImages(width, height);
     createUniform();
 
     createDescriptorSetLayout();
     allocateDescriptorSets();
-    updateSampelrDescriptorSet();
 
     createPipelineLayout();
-    createPipeline(colorFormat);
-    createPipelineBloomDown();
-    createPipelineBloomUp();
+    device_->compilePipeline([this, colorFormat]() { createPipeline(colorFormat); });
+    device_->compilePipeline([this]() { createPipelineBloomDown(); });
+    device_->compilePipeline([this]() { createPipelineBloomUp(); });
+    device_->compilePipeline([this]() { createPipelineBloomCompute(); });
+    device_->compilePipeline([this]() { createPipelineAntiAliasing(); });
+    if (storageTarget_) {
+        for (uint32_t i = 0; i < TONEMAPPERS; i++) {
+            device_->compilePipeline(
+                [this, i]() { createPipelinePostCompute(static_cast<Tonemapper>(i)); });
+        }
+    }
+
+    graph_->onAllocated([this]() {
+        createBloomViews();
+        updateSampelrDescriptorSet();
+    });
 }
 
 RendererPost::~RendererPost()
 {
+    vkDestroyPipeline(device_->get(), pipelineSmaaBlend_, nullptr);
+    vkDestroyPipeline(device_->get(), pipelineSmaaWeights_, nullptr);
+    vkDestroyPipeline(device_->get(), pipelineSmaaEdges_, nullptr);
+    vkDestroyPipeline(device_->get(), pipelineFxaa_, nullptr);
+    vkDestroyPipelineLayout(device_->get(), aaPipelineLayout_, nullptr);
+
+    for (const auto& pipeline : pipelinesPostCompute_) {
+        vkDestroyPipeline(device_->get(), pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(device_->get(), postPipelineLayout_, nullptr);
+
+    vkDestroyPipeline(device_->get(), pipelineBloomUpCompute_, nullptr);
+    vkDestroyPipeline(device_->get(), pipelineBloomDownCompute_, nullptr);
+    vkDestroyPipelineLayout(device_->get(), bloomPipelineLayout_, nullptr);
+
     vkDestroyPipeline(device_->get(), pipelineBloomUp_, nullptr);
     vkDestroyPipeline(device_->get(), pipelineBloomDown_, nullptr);
     vkDestroyPipeline(device_->get(), pipeline_, nullptr);
 
     vkDestroyPipelineLayout(device_->get(), pipelineLayout_, nullptr);
 
+    vkDestroyDescriptorSetLayout(device_->get(), aaSetLayout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_->get(), postSetLayout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_->get(), bloomSetLayout_, nullptr);
     vkDestroyDescriptorSetLayout(device_->get(), textureSetLayout_, nullptr);
     vkDestroyDescriptorSetLayout(device_->get(), uniformSetLayout_, nullptr);
 }
@@ -38,28 +84,244 @@ RendererPost::~RendererPost()
 void RendererPost::resized(uint32_t width, uint32_t height)
 {
     createBloomImage(width, height);
-    updateSampelrDescriptorSet();
+    createAntiAliasingImages(width, height);
+}
+
+void RendererPost::sceneFormatChanged()
+{
+    createBloomImage(bloomImage_->width(), bloomImage_->height());
+    createAntiAliasingImages(aaImage_->width(), aaImage_->height());
+
+    // the fragment bloom passes render in the scene format
+    vkDestroyPipeline(device_->get(), pipelineBloomUp_, nullptr);
+    vkDestroyPipeline(device_->get(), pipelineBloomDown_, nullptr);
+    createPipelineBloomDown();
+    createPipelineBloomUp();
 }
 
 void RendererPost::update(uint32_t frameIdx, PostUniform postUniform)
 {
     uniformBuffers_[frameIdx]->update(postUniform);
+    shadowDepthView_ = postUniform.shadowDepthView != 0;
+    sceneScale_ = postUniform.sceneScale;
 }
 
-void RendererPost::draw(VkCommandBuffer cmd, uint32_t frameIdx,
-                        std::shared_ptr<Image2D> renderTarget)
+uint32_t RendererPost::bloomLevels() const
 {
-    sceneTexture_->transition(cmd, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
-                              VK_ACCESS_2_SHADER_READ_BIT,
-                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    return bloomLevels_;
+}
 
-    bloomDown(cmd);
-    bloomUp(cmd);
+void RendererPost::setBloomLevels(uint32_t levels)
+{
+    bloomLevels_ = std::clamp(levels, 2u, MAX_BLOOM_LEVELS);
+    createBloomImage(bloomImage_->width(), bloomImage_->height());
+}
 
-    bloomTextures_[0]->transition(cmd, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
-                                  VK_ACCESS_2_SHADER_READ_BIT,
-                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+bool& RendererPost::computeBloom()
+{
+    return computeBloom_;
+}
 
+bool RendererPost::storageTarget() const
+{
+    return storageTarget_;
+}
+
+bool& RendererPost::fusedPost()
+{
+    return fusedPost_;
+}
+
+Tonemapper& RendererPost::tonemapper()
+{
+    return tonemapper_;
+}
+
+PostAntiAliasing RendererPost::postAntiAliasing() const
+{
+    return postAntiAliasing_;
+}
+
+void RendererPost::setPostAntiAliasing(PostAntiAliasing postAntiAliasing)
+{
+    postAntiAliasing_ = postAntiAliasing;
+
+    // redeclared so the graph reallocates and the sets switch post to the new input
+    createAntiAliasingImages(aaImage_->width(), aaImage_->height());
+}
+
+VkDeviceSize RendererPost::antiAliasingMemory() const
+{
+    switch (postAntiAliasing_) {
+    case PostAntiAliasing::Fxaa:
+        return aaImage_->memoryRequirements().size;
+    case PostAntiAliasing::Smaa:
+        return aaImage_->memoryRequirements().size + smaaEdges_->memoryRequirements().size +
+               smaaWeights_->memoryRequirements().size;
+    default:
+        return 0;
+    }
+}
+
+VkDeviceSize RendererPost::bloomMemory() const
+{
+    return bloomImage_->memoryRequirements().size;
+}
+
+Image2D* RendererPost::postInput() const
+{
+    return postAntiAliasing_ == PostAntiAliasing::None ? sceneTexture_.get() : aaImage_.get();
+}
+
+uint32_t RendererPost::bloomOutputLevel() const
+{
+    return storageTarget_ && fusedPost_ ? 1 : 0;
+}
+
+void RendererPost::addPasses(uint32_t frameIdx, std::shared_ptr<Image2D> renderTarget)
+{
+    if (computeBloom_) {
+        addBloomComputePasses();
+    } else {
+        addBloomPasses();
+    }
+    addAntiAliasingPasses();
+
+    // the fused pass writes the target from compute, one read of the scene and one write
+    bool fused = bloomOutputLevel() > 0;
+    VkPipelineStageFlags2 stage =
+        fused ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+
+    // the depth view only samples the shadow map, scene and bloom passes get culled
+    std::vector<ImageAccess> accesses;
+    if (fused) {
+        accesses.push_back({renderTarget.get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL});
+    } else {
+        accesses.push_back({renderTarget.get(), VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                            VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+    }
+    if (shadowDepthView_) {
+        accesses.push_back({shadowTexture_.get(), stage, VK_ACCESS_2_SHADER_READ_BIT,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
+    } else {
+        accesses.push_back({postInput(), stage, VK_ACCESS_2_SHADER_READ_BIT,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
+        accesses.push_back({bloomTextures_[bloomOutputLevel()].get(), stage,
+                            VK_ACCESS_2_SHADER_READ_BIT,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
+    }
+
+    graph_->addPass(
+        "post", accesses,
+        [this, fused, frameIdx, renderTarget](VkCommandBuffer cmd) {
+            if (fused) {
+                drawCompute(cmd, frameIdx, renderTarget);
+            } else {
+                draw(cmd, frameIdx, renderTarget);
+            }
+        },
+        fused);
+}
+
+void RendererPost::addBloomPasses()
+{
+    for (uint32_t i = 1; i < bloomLevels_; i++) {
+        Image2D* source = i == 1 ? sceneTexture_.get() : bloomTextures_[i - 1].get();
+        graph_->addPass(std::format("bloomDown{}", i),
+                        {{source, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                          VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+                         {bloomTextures_[i].get(), VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                          VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}},
+                        [this, i](VkCommandBuffer cmd) { bloomDown(cmd, i); });
+    }
+
+    for (int32_t l = bloomLevels_ - 2; l >= static_cast<int32_t>(bloomOutputLevel()); l--) {
+        graph_->addPass(std::format("bloomUp{}", l),
+                        {{bloomTextures_[l + 1].get(), VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                          VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+                         {bloomTextures_[l].get(), VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                          VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}},
+                        [this, l](VkCommandBuffer cmd) { bloomUp(cmd, l); });
+    }
+}
+
+void RendererPost::addBloomComputePasses()
+{
+    // one dispatch writes the whole chain, the upsample dispatches share one pass
+    std::vector<ImageAccess> downAccesses{{sceneTexture_.get(),
+                                           VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                           VK_ACCESS_2_SHADER_READ_BIT,
+                                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}};
+    std::vector<ImageAccess> upAccesses;
+    for (uint32_t i = bloomOutputLevel(); i < bloomLevels_; i++) {
+        VkAccessFlags2 upAccess{};
+        if (i > 0) {
+            downAccesses.push_back({bloomTextures_[i].get(),
+                                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                    VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                                        VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                                    VK_IMAGE_LAYOUT_GENERAL});
+            upAccess |= VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+        }
+        if (i < bloomLevels_ - 1) {
+            upAccess |= VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+        }
+        upAccesses.push_back({bloomTextures_[i].get(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                              upAccess, VK_IMAGE_LAYOUT_GENERAL});
+    }
+
+    graph_->addPass(
+        "bloomDown", downAccesses, [this](VkCommandBuffer cmd) { bloomDownCompute(cmd); }, true);
+    graph_->addPass(
+        "bloomUp", upAccesses, [this](VkCommandBuffer cmd) { bloomUpCompute(cmd); }, true);
+}
+
+void RendererPost::addAntiAliasingPasses()
+{
+    auto read = [](Image2D* image) {
+        return ImageAccess{image, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                           VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    };
+    auto write = [](Image2D* image) {
+        return ImageAccess{image, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                           VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL};
+    };
+
+    if (postAntiAliasing_ == PostAntiAliasing::Fxaa) {
+        graph_->addPass(
+            "fxaa", {read(sceneTexture_.get()), write(aaImage_.get())},
+            [this](VkCommandBuffer cmd) { dispatchAntiAliasing(cmd, pipelineFxaa_, fxaaSet_); },
+            true);
+    } else if (postAntiAliasing_ == PostAntiAliasing::Smaa) {
+        graph_->addPass(
+            "smaaEdges", {read(sceneTexture_.get()), write(smaaEdges_.get())},
+            [this](VkCommandBuffer cmd) {
+                dispatchAntiAliasing(cmd, pipelineSmaaEdges_, smaaEdgesSet_);
+            },
+            true);
+        graph_->addPass(
+            "smaaWeights", {read(smaaEdges_.get()), write(smaaWeights_.get())},
+            [this](VkCommandBuffer cmd) {
+                dispatchAntiAliasing(cmd, pipelineSmaaWeights_, smaaWeightsSet_);
+            },
+            true);
+        graph_->addPass(
+            "smaaBlend",
+            {read(sceneTexture_.get()), read(smaaWeights_.get()), write(aaImage_.get())},
+            [this](VkCommandBuffer cmd) {
+                dispatchAntiAliasing(cmd, pipelineSmaaBlend_, smaaBlendSet_);
+            },
+            true);
+    }
+}
+
+void RendererPost::draw(VkCommandBuffer cmd, uint32_t frameIdx,
+                        std::shared_ptr<Image2D> renderTarget)
+{
     VkRenderingAttachmentInfo colorAttachment{};
     colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
     colorAttachment.imageView = renderTarget->view();
@@ -93,8 +355,10 @@ void RendererPost::draw(VkCommandBuffer cmd, uint32_t frameIdx,
     scissor.extent = {renderTarget->width(), renderTarget->height()};
     vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-    std::array<VkDescriptorSet, 4> sets{uniformSets_[frameIdx], bloomTextureSets_[0],
-                                        sceneTextureSet_, shadowTextureSet_};
+    VkDescriptorSet inputSet =
+        postAntiAliasing_ == PostAntiAliasing::None ? sceneTextureSet_ : aaTextureSet_;
+    std::array<VkDescriptorSet, 4> sets{uniformSets_[frameIdx], bloomTextureSets_[0], inputSet,
+                                        shadowTextureSet_};
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0,
                             static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
 
@@ -103,141 +367,266 @@ void RendererPost::draw(VkCommandBuffer cmd, uint32_t frameIdx,
     vkCmdEndRendering(cmd);
 }
 
-void RendererPost::bloomDown(VkCommandBuffer cmd)
+void RendererPost::bloomDown(VkCommandBuffer cmd, uint32_t level)
 {
-    for (size_t i = 1; i < BLOOM_LEVELS; i++) {
-        bloomTextures_[i - 1]->transition(cmd, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
-                                          VK_ACCESS_2_SHADER_READ_BIT,
-                                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-        bloomTextures_[i]->transition(cmd, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
-                                      VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
-                                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    const auto& target = bloomTextures_[level];
 
-        VkRenderingAttachmentInfo colorAttachment{};
-        colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-        colorAttachment.imageView = bloomTextures_[i]->view();
-        colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        colorAttachment.clearValue.color = {0.f, 0.f, 0.f, 1.f};
+    VkRenderingAttachmentInfo colorAttachment{};
+    colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    colorAttachment.imageView = target->view();
+    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.clearValue.color = {0.f, 0.f, 0.f, 1.f};
 
-        VkRenderingInfo renderingInfo{};
-        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-        renderingInfo.renderArea = {0, 0, bloomTextures_[i]->width(), bloomTextures_[i]->height()};
-        renderingInfo.layerCount = 1;
-        renderingInfo.colorAttachmentCount = 1;
-        renderingInfo.pColorAttachments = &colorAttachment;
+    VkRenderingInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.renderArea = {0, 0, target->width(), target->height()};
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &colorAttachment;
 
-        vkCmdBeginRendering(cmd, &renderingInfo);
+    vkCmdBeginRendering(cmd, &renderingInfo);
 
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineBloomDown_);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineBloomDown_);
 
-        VkViewport viewport{};
-        viewport.x = 0.f;
-        viewport.y = 0.f;
-        viewport.width = static_cast<float>(bloomTextures_[i]->width());
-        viewport.height = static_cast<float>(bloomTextures_[i]->height());
-        viewport.minDepth = 0.f;
-        viewport.maxDepth = 1.f;
-        vkCmdSetViewport(cmd, 0, 1, &viewport);
+    VkViewport viewport{};
+    viewport.x = 0.f;
+    viewport.y = 0.f;
+    viewport.width = static_cast<float>(target->width());
+    viewport.height = static_cast<float>(target->height());
+    viewport.minDepth = 0.f;
+    viewport.maxDepth = 1.f;
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
 
-        VkRect2D scissor{};
-        scissor.offset = {0, 0};
-        scissor.extent = {bloomTextures_[i]->width(), bloomTextures_[i]->height()};
-        vkCmdSetScissor(cmd, 0, 1, &scissor);
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = {target->width(), target->height()};
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-        VkDescriptorSet set = i == 1 ? sceneTextureSet_ : bloomTextureSets_[i - 1];
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 1, 1, &set,
-                                0, nullptr);
+    VkDescriptorSet set = level == 1 ? sceneTextureSet_ : bloomTextureSets_[level - 1];
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 1, 1, &set, 0,
+                            nullptr);
 
-        BloomPushConstants pc{};
-        pc.width = static_cast<float>(bloomTextures_[i]->width());
-        pc.height = static_cast<float>(bloomTextures_[i]->height());
-        vkCmdPushConstants(cmd, pipelineLayout_, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-                           sizeof(BloomPushConstants), &pc);
+    BloomPushConstants pc{};
+    pc.width = static_cast<float>(target->width());
+    pc.height = static_cast<float>(target->height());
+    pc.uvScale = level == 1 ? sceneScale_ : glm::vec2(1.f);
+    vkCmdPushConstants(cmd, pipelineLayout_, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                       sizeof(BloomPushConstants), &pc);
 
-        vkCmdDraw(cmd, 6, 1, 0, 0);
+    vkCmdDraw(cmd, 6, 1, 0, 0);
 
-        vkCmdEndRendering(cmd);
-    }
+    vkCmdEndRendering(cmd);
 }
 
-void RendererPost::bloomUp(VkCommandBuffer cmd)
+void RendererPost::bloomUp(VkCommandBuffer cmd, uint32_t level)
 {
-    for (uint32_t i = 0; i < BLOOM_LEVELS - 1; i++) {
-        size_t l = static_cast<size_t>(BLOOM_LEVELS) - 2 - i;
+    const auto& target = bloomTextures_[level];
 
-        bloomTextures_[l + 1]->transition(cmd, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
-                                          VK_ACCESS_2_SHADER_READ_BIT,
-                                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    VkRenderingAttachmentInfo colorAttachment{};
+    colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    colorAttachment.imageView = target->view();
+    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.clearValue.color = {0.f, 0.f, 0.f, 1.f};
 
-        bloomTextures_[l]->transition(cmd, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
-                                      VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
-                                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    VkRenderingInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.renderArea = {0, 0, target->width(), target->height()};
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &colorAttachment;
 
-        VkRenderingAttachmentInfo colorAttachment{};
-        colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-        colorAttachment.imageView = bloomTextures_[l]->view();
-        colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        colorAttachment.clearValue.color = {0.f, 0.f, 0.f, 1.f};
+    vkCmdBeginRendering(cmd, &renderingInfo);
 
-        VkRenderingInfo renderingInfo{};
-        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-        renderingInfo.renderArea = {0, 0, bloomTextures_[l]->width(), bloomTextures_[l]->height()};
-        renderingInfo.layerCount = 1;
-        renderingInfo.colorAttachmentCount = 1;
-        renderingInfo.pColorAttachments = &colorAttachment;
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineBloomUp_);
 
-        vkCmdBeginRendering(cmd, &renderingInfo);
+    VkViewport viewport{};
+    viewport.x = 0.f;
+    viewport.y = 0.f;
+    viewport.width = static_cast<float>(target->width());
+    viewport.height = static_cast<float>(target->height());
+    viewport.minDepth = 0.f;
+    viewport.maxDepth = 1.f;
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
 
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineBloomUp_);
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = {target->width(), target->height()};
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-        VkViewport viewport{};
-        viewport.x = 0.f;
-        viewport.y = 0.f;
-        viewport.width = static_cast<float>(bloomTextures_[l]->width());
-        viewport.height = static_cast<float>(bloomTextures_[l]->height());
-        viewport.minDepth = 0.f;
-        viewport.maxDepth = 1.f;
-        vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 1, 1,
+                            &bloomTextureSets_[level + 1], 0, nullptr);
 
-        VkRect2D scissor{};
-        scissor.offset = {0, 0};
-        scissor.extent = {bloomTextures_[l]->width(), bloomTextures_[l]->height()};
-        vkCmdSetScissor(cmd, 0, 1, &scissor);
+    BloomPushConstants pc{};
+    pc.width = static_cast<float>(target->width());
+    pc.height = static_cast<float>(target->height());
+    vkCmdPushConstants(cmd, pipelineLayout_, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                       sizeof(BloomPushConstants), &pc);
 
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 1, 1,
-                                &bloomTextureSets_[l + 1], 0, nullptr);
+    vkCmdDraw(cmd, 6, 1, 0, 0);
 
-        BloomPushConstants pc{};
-        pc.width = static_cast<float>(bloomTextures_[l]->width());
-        pc.height = static_cast<float>(bloomTextures_[l]->height());
-        vkCmdPushConstants(cmd, pipelineLayout_, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-                           sizeof(BloomPushConstants), &pc);
+    vkCmdEndRendering(cmd);
+}
 
-        vkCmdDraw(cmd, 6, 1, 0, 0);
+void RendererPost::bloomDownCompute(VkCommandBuffer cmd)
+{
+    // the last group of the previous frame resets the counter
+    VkMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.memoryBarrierCount = 1;
+    dependencyInfo.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineBloomDownCompute_);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, bloomPipelineLayout_, 0, 1,
+                            &bloomSet_, 0, nullptr);
+
+    BloomComputePushConstants pc{};
+    pc.levels = bloomLevels_;
+    pc.sceneScale = sceneScale_;
+    vkCmdPushConstants(cmd, bloomPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(BloomComputePushConstants), &pc);
+
+    const auto& level1 = bloomTextures_[1];
+    vkCmdDispatch(cmd, (level1->width() + BLOOM_GROUP_TILE - 1) / BLOOM_GROUP_TILE,
+                  (level1->height() + BLOOM_GROUP_TILE - 1) / BLOOM_GROUP_TILE, 1);
+}
 
-        vkCmdEndRendering(cmd);
+void RendererPost::bloomUpCompute(VkCommandBuffer cmd)
+{
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineBloomUpCompute_);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, bloomPipelineLayout_, 0, 1,
+                            &bloomSet_, 0, nullptr);
+
+    // each level reads the one below it, written by the previous dispatch
+    VkMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.memoryBarrierCount = 1;
+    dependencyInfo.pMemoryBarriers = &barrier;
+
+    for (int32_t l = bloomLevels_ - 2; l >= static_cast<int32_t>(bloomOutputLevel()); l--) {
+        if (l < static_cast<int32_t>(bloomLevels_) - 2) {
+            vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+        }
+
+        BloomComputePushConstants pc{};
+        pc.levels = bloomLevels_;
+        pc.level = l;
+        vkCmdPushConstants(cmd, bloomPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(BloomComputePushConstants), &pc);
+
+        const auto& target = bloomTextures_[l];
+        vkCmdDispatch(cmd, (target->width() + 7) / 8, (target->height() + 7) / 8, 1);
     }
 }
 
+void RendererPost::drawCompute(VkCommandBuffer cmd, uint32_t frameIdx,
+                               std::shared_ptr<Image2D> renderTarget)
+{
+    // the swapchain image changes every frame, the set is not in flight after the fence wait
+    VkDescriptorImageInfo outputInfo{};
+    outputInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    outputInfo.imageView = renderTarget->view();
+
+    VkWriteDescriptorSet outputWrite{};
+    outputWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    outputWrite.dstSet = postSets_[frameIdx];
+    outputWrite.dstBinding = 4;
+    outputWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    outputWrite.descriptorCount = 1;
+    outputWrite.pImageInfo = &outputInfo;
+    vkUpdateDescriptorSets(device_->get(), 1, &outputWrite, 0, nullptr);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipelinesPostCompute_[static_cast<uint32_t>(tonemapper_)]);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, postPipelineLayout_, 0, 1,
+                            &postSets_[frameIdx], 0, nullptr);
+
+    vkCmdDispatch(cmd, (renderTarget->width() + 7) / 8, (renderTarget->height() + 7) / 8, 1);
+}
+
+void RendererPost::dispatchAntiAliasing(VkCommandBuffer cmd, VkPipeline pipeline,
+                                        VkDescriptorSet set)
+{
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, aaPipelineLayout_, 0, 1, &set, 0,
+                            nullptr);
+
+    // only the dynamic resolution render area of the scene
+    PostAaPushConstants pc{};
+    pc.renderSize = glm::max(
+        glm::uvec2(glm::round(sceneScale_ *
+                              glm::vec2(sceneTexture_->width(), sceneTexture_->height()))),
+        glm::uvec2(1));
+    vkCmdPushConstants(cmd, aaPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(PostAaPushConstants), &pc);
+
+    vkCmdDispatch(cmd, (pc.renderSize.x + 7) / 8, (pc.renderSize.y + 7) / 8, 1);
+}
+
 void RendererPost::createBloomImage(uint32_t width, uint32_t height)
 {
-    bloomImage_->createImage(sceneTexture_->format(), width, height,
-                             VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                             VK_SAMPLE_COUNT_1_BIT, 0, BLOOM_LEVELS);
+    bloomImage_->declareImage(sceneTexture_->format(), width, height,
+                              VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                  VK_IMAGE_USAGE_STORAGE_BIT,
+                              VK_SAMPLE_COUNT_1_BIT, bloomLevels_);
+
+    std::vector<Image2D*> views;
+    for (uint32_t i = 0; i < bloomLevels_; i++) {
+        views.push_back(bloomTextures_[i].get());
+    }
+    graph_->transient("bloom", bloomImage_.get(), views);
+}
 
-    for (uint32_t i = 0; i < BLOOM_LEVELS; i++) {
-        bloomTextures_[i] = std::make_unique<Image2D>(device_);
-        bloomTextures_[i]->createView(bloomImage_->get(), bloomImage_->format(), width >> i,
-                                      height >> i, i, 1);
+void RendererPost::createBloomViews()
+{
+    for (uint32_t i = 0; i < bloomLevels_; i++) {
+        bloomTextures_[i]->createView(bloomImage_->get(), bloomImage_->format(),
+                                      bloomImage_->width() >> i, bloomImage_->height() >> i, i,
+                                      1);
         bloomTextures_[i]->setSampler(device_->samplerLinearClamp());
     }
 }
 
+void RendererPost::createAntiAliasingImages(uint32_t width, uint32_t height)
+{
+    aaImage_->declareImage(sceneTexture_->format(), width, height,
+                           VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                           VK_SAMPLE_COUNT_1_BIT);
+    aaImage_->setSampler(device_->samplerLinearClamp());
+    graph_->transient("postAa", aaImage_.get());
+
+    smaaEdges_->declareImage(VK_FORMAT_R8G8B8A8_UNORM, width, height,
+                             VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                             VK_SAMPLE_COUNT_1_BIT);
+    smaaEdges_->setSampler(device_->samplerLinearClamp());
+    graph_->transient("smaaEdges", smaaEdges_.get());
+
+    smaaWeights_->declareImage(VK_FORMAT_R8G8B8A8_UNORM, width, height,
+                               VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                               VK_SAMPLE_COUNT_1_BIT);
+    smaaWeights_->setSampler(device_->samplerLinearClamp());
+    graph_->transient("smaaWeights", smaaWeights_.get());
+}
+
 void RendererPost::createUniform()
 {
     for (uint32_t i = 0; i < Device::MAX_FRAMES_IN_FLIGHT; i++) {
@@ -273,6 +662,67 @@ void RendererPost::createDescriptorSetLayout()
 
     VK_CHECK(
         vkCreateDescriptorSetLayout(device_->get(), &descSetLayoutCI, nullptr, &textureSetLayout_));
+
+    // scene, bloom levels sampled and as storage, downsampler group counter
+    std::array<VkDescriptorSetLayoutBinding, 4> bloomLayoutBindings{};
+    bloomLayoutBindings[0].binding = 0;
+    bloomLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bloomLayoutBindings[0].descriptorCount = 1;
+    bloomLayoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    bloomLayoutBindings[1].binding = 1;
+    bloomLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bloomLayoutBindings[1].descriptorCount = MAX_BLOOM_LEVELS;
+    bloomLayoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    bloomLayoutBindings[2].binding = 2;
+    bloomLayoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bloomLayoutBindings[2].descriptorCount = MAX_BLOOM_LEVELS;
+    bloomLayoutBindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    bloomLayoutBindings[3].binding = 3;
+    bloomLayoutBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bloomLayoutBindings[3].descriptorCount = 1;
+    bloomLayoutBindings[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    descSetLayoutCI.bindingCount = static_cast<uint32_t>(bloomLayoutBindings.size());
+    descSetLayoutCI.pBindings = bloomLayoutBindings.data();
+
+    VK_CHECK(
+        vkCreateDescriptorSetLayout(device_->get(), &descSetLayoutCI, nullptr, &bloomSetLayout_));
+
+    // fused post: uniform, bloom level 1, scene, shadow and the output image
+    std::array<VkDescriptorSetLayoutBinding, 5> postLayoutBindings{};
+    for (uint32_t i = 0; i < postLayoutBindings.size(); i++) {
+        postLayoutBindings[i].binding = i;
+        postLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        postLayoutBindings[i].descriptorCount = 1;
+        postLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    postLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    postLayoutBindings[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+    descSetLayoutCI.bindingCount = static_cast<uint32_t>(postLayoutBindings.size());
+    descSetLayoutCI.pBindings = postLayoutBindings.data();
+
+    VK_CHECK(
+        vkCreateDescriptorSetLayout(device_->get(), &descSetLayoutCI, nullptr, &postSetLayout_));
+
+    // post anti-aliasing passes: input, second input and the output image
+    std::array<VkDescriptorSetLayoutBinding, 3> aaLayoutBindings{};
+    for (uint32_t i = 0; i < aaLayoutBindings.size(); i++) {
+        aaLayoutBindings[i].binding = i;
+        aaLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        aaLayoutBindings[i].descriptorCount = 1;
+        aaLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    aaLayoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+    descSetLayoutCI.bindingCount = static_cast<uint32_t>(aaLayoutBindings.size());
+    descSetLayoutCI.pBindings = aaLayoutBindings.data();
+
+    VK_CHECK(
+        vkCreateDescriptorSetLayout(device_->get(), &descSetLayoutCI, nullptr, &aaSetLayout_));
 }
 
 void RendererPost::allocateDescriptorSets()
@@ -306,32 +756,77 @@ void RendererPost::allocateDescriptorSets()
     descSetAI.descriptorSetCount = 1;
     descSetAI.pSetLayouts = &textureSetLayout_;
     VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, &shadowTextureSet_));
-
-    // shadow sampler texture
-    VkDescriptorImageInfo shadowTextureInfo{};
-    shadowTextureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    shadowTextureInfo.imageView = shadowTexture_->view();
-    shadowTextureInfo.sampler = shadowTexture_->sampler();
-
-    VkWriteDescriptorSet write{};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.dstSet = shadowTextureSet_;
-    write.dstBinding = 0;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    write.descriptorCount = 1;
-    write.pImageInfo = &shadowTextureInfo;
-    vkUpdateDescriptorSets(device_->get(), 1, &write, 0, nullptr);
-
     VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, &sceneTextureSet_));
+    VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, &aaTextureSet_));
 
-    std::vector<VkDescriptorSetLayout> bloomTextureLayouts(BLOOM_LEVELS, textureSetLayout_);
+    std::vector<VkDescriptorSetLayout> bloomTextureLayouts(MAX_BLOOM_LEVELS, textureSetLayout_);
     descSetAI.descriptorSetCount = static_cast<uint32_t>(bloomTextureLayouts.size());
     descSetAI.pSetLayouts = bloomTextureLayouts.data();
     VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, bloomTextureSets_.data()));
+
+    descSetAI.descriptorSetCount = 1;
+    descSetAI.pSetLayouts = &bloomSetLayout_;
+    VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, &bloomSet_));
+
+    VkDescriptorBufferInfo counterInfo{};
+    counterInfo.buffer = bloomCounter_->get();
+    counterInfo.range = sizeof(uint32_t);
+
+    VkWriteDescriptorSet counterWrite{};
+    counterWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    counterWrite.dstSet = bloomSet_;
+    counterWrite.dstBinding = 3;
+    counterWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    counterWrite.descriptorCount = 1;
+    counterWrite.pBufferInfo = &counterInfo;
+    vkUpdateDescriptorSets(device_->get(), 1, &counterWrite, 0, nullptr);
+
+    std::vector<VkDescriptorSetLayout> postLayouts(Device::MAX_FRAMES_IN_FLIGHT, postSetLayout_);
+    descSetAI.descriptorSetCount = static_cast<uint32_t>(postLayouts.size());
+    descSetAI.pSetLayouts = postLayouts.data();
+    VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, postSets_.data()));
+
+    descSetAI.descriptorSetCount = 1;
+    descSetAI.pSetLayouts = &aaSetLayout_;
+    VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, &fxaaSet_));
+    VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, &smaaEdgesSet_));
+    VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, &smaaWeightsSet_));
+    VK_CHECK(vkAllocateDescriptorSets(device_->get(), &descSetAI, &smaaBlendSet_));
+
+    for (size_t i = 0; i < Device::MAX_FRAMES_IN_FLIGHT; i++) {
+        VkDescriptorBufferInfo postUniformInfo{};
+        postUniformInfo.buffer = uniformBuffers_[i]->get();
+        postUniformInfo.range = sizeof(PostUniform);
+
+        VkWriteDescriptorSet writeUniform{};
+        writeUniform.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeUniform.dstSet = postSets_[i];
+        writeUniform.dstBinding = 0;
+        writeUniform.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writeUniform.descriptorCount = 1;
+        writeUniform.pBufferInfo = &postUniformInfo;
+
+        vkUpdateDescriptorSets(device_->get(), 1, &writeUniform, 0, nullptr);
+    }
 }
 
 void RendererPost::updateSampelrDescriptorSet()
 {
+    // shadow sampler texture
+    VkDescriptorImageInfo shadowTextureInfo{};
+    shadowTextureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    shadowTextureInfo.imageView = shadowTexture_->view();
+    shadowTextureInfo.sampler = shadowTexture_->sampler();
+
+    VkWriteDescriptorSet shadowWrite{};
+    shadowWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    shadowWrite.dstSet = shadowTextureSet_;
+    shadowWrite.dstBinding = 0;
+    shadowWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    shadowWrite.descriptorCount = 1;
+    shadowWrite.pImageInfo = &shadowTextureInfo;
+    vkUpdateDescriptorSets(device_->get(), 1, &shadowWrite, 0, nullptr);
+
     // scene sampler texture
     VkDescriptorImageInfo sceneTextureInfo{};
     sceneTextureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -347,12 +842,14 @@ void RendererPost::updateSampelrDescriptorSet()
     write.pImageInfo = &sceneTextureInfo;
     vkUpdateDescriptorSets(device_->get(), 1, &write, 0, nullptr);
 
-    // bloom sampler texture
-    for (size_t i = 0; i < BLOOM_LEVELS; i++) {
+    // bloom sampler texture, levels past bloomLevels_ repeat the last one
+    for (uint32_t i = 0; i < MAX_BLOOM_LEVELS; i++) {
+        const auto& bloomTexture = bloomTextures_[std::min(i, bloomLevels_ - 1)];
+
         VkDescriptorImageInfo bloomTextureInfo{};
         bloomTextureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        bloomTextureInfo.imageView = bloomTextures_[i]->view();
-        bloomTextureInfo.sampler = bloomTextures_[i]->sampler();
+        bloomTextureInfo.imageView = bloomTexture->view();
+        bloomTextureInfo.sampler = bloomTexture->sampler();
 
         VkWriteDescriptorSet write{};
         write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -364,6 +861,118 @@ void RendererPost::updateSampelrDescriptorSet()
 
         vkUpdateDescriptorSets(device_->get(), 1, &write, 0, nullptr);
     }
+
+    // compute bloom, the chain stays in the general layout
+    std::array<VkDescriptorImageInfo, MAX_BLOOM_LEVELS> bloomSampledInfos{};
+    std::array<VkDescriptorImageInfo, MAX_BLOOM_LEVELS> bloomStorageInfos{};
+    for (uint32_t i = 0; i < MAX_BLOOM_LEVELS; i++) {
+        const auto& bloomTexture = bloomTextures_[std::min(i, bloomLevels_ - 1)];
+
+        bloomSampledInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        bloomSampledInfos[i].imageView = bloomTexture->view();
+        bloomSampledInfos[i].sampler = bloomTexture->sampler();
+
+        bloomStorageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        bloomStorageInfos[i].imageView = bloomTexture->view();
+    }
+
+    std::array<VkWriteDescriptorSet, 3> bloomWrites{};
+    for (auto& bloomWrite : bloomWrites) {
+        bloomWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        bloomWrite.dstSet = bloomSet_;
+    }
+
+    bloomWrites[0].dstBinding = 0;
+    bloomWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bloomWrites[0].descriptorCount = 1;
+    bloomWrites[0].pImageInfo = &sceneTextureInfo;
+
+    bloomWrites[1].dstBinding = 1;
+    bloomWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bloomWrites[1].descriptorCount = MAX_BLOOM_LEVELS;
+    bloomWrites[1].pImageInfo = bloomSampledInfos.data();
+
+    bloomWrites[2].dstBinding = 2;
+    bloomWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bloomWrites[2].descriptorCount = MAX_BLOOM_LEVELS;
+    bloomWrites[2].pImageInfo = bloomStorageInfos.data();
+
+    vkUpdateDescriptorSets(device_->get(), static_cast<uint32_t>(bloomWrites.size()),
+                           bloomWrites.data(), 0, nullptr);
+
+    // anti-aliased scene
+    VkDescriptorImageInfo aaTextureInfo{};
+    aaTextureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    aaTextureInfo.imageView = aaImage_->view();
+    aaTextureInfo.sampler = aaImage_->sampler();
+
+    VkWriteDescriptorSet aaTextureWrite{};
+    aaTextureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    aaTextureWrite.dstSet = aaTextureSet_;
+    aaTextureWrite.dstBinding = 0;
+    aaTextureWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    aaTextureWrite.descriptorCount = 1;
+    aaTextureWrite.pImageInfo = &aaTextureInfo;
+    vkUpdateDescriptorSets(device_->get(), 1, &aaTextureWrite, 0, nullptr);
+
+    // post anti-aliasing passes, two sampled inputs and the written image
+    std::array<VkDescriptorSet, 4> aaSets{fxaaSet_, smaaEdgesSet_, smaaWeightsSet_, smaaBlendSet_};
+    std::array<std::array<const Image2D*, 3>, 4> aaImages{{
+        {sceneTexture_.get(), sceneTexture_.get(), aaImage_.get()},
+        {sceneTexture_.get(), sceneTexture_.get(), smaaEdges_.get()},
+        {smaaEdges_.get(), smaaEdges_.get(), smaaWeights_.get()},
+        {sceneTexture_.get(), smaaWeights_.get(), aaImage_.get()},
+    }};
+    for (size_t i = 0; i < aaSets.size(); i++) {
+        std::array<VkDescriptorImageInfo, 3> aaInfos{};
+        std::array<VkWriteDescriptorSet, 3> aaWrites{};
+        for (uint32_t binding = 0; binding < aaWrites.size(); binding++) {
+            const Image2D* image = aaImages[i][binding];
+            bool storage = binding == 2;
+
+            aaInfos[binding].imageLayout =
+                storage ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            aaInfos[binding].imageView = image->view();
+            aaInfos[binding].sampler = storage ? VK_NULL_HANDLE : image->sampler();
+
+            aaWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            aaWrites[binding].dstSet = aaSets[i];
+            aaWrites[binding].dstBinding = binding;
+            aaWrites[binding].descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+                                                       : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            aaWrites[binding].descriptorCount = 1;
+            aaWrites[binding].pImageInfo = &aaInfos[binding];
+        }
+
+        vkUpdateDescriptorSets(device_->get(), static_cast<uint32_t>(aaWrites.size()),
+                               aaWrites.data(), 0, nullptr);
+    }
+
+    // fused post, the output image is written per frame in drawCompute
+    const auto& bloomLevel1 = bloomTextures_[std::min(1u, bloomLevels_ - 1)];
+    VkDescriptorImageInfo bloomLevel1Info{};
+    bloomLevel1Info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    bloomLevel1Info.imageView = bloomLevel1->view();
+    bloomLevel1Info.sampler = bloomLevel1->sampler();
+
+    for (const auto& postSet : postSets_) {
+        std::array<VkWriteDescriptorSet, 3> postWrites{};
+        const VkDescriptorImageInfo* inputInfo =
+            postAntiAliasing_ == PostAntiAliasing::None ? &sceneTextureInfo : &aaTextureInfo;
+        std::array<const VkDescriptorImageInfo*, 3> postInfos{&bloomLevel1Info, inputInfo,
+                                                              &shadowTextureInfo};
+        for (uint32_t i = 0; i < postWrites.size(); i++) {
+            postWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            postWrites[i].dstSet = postSet;
+            postWrites[i].dstBinding = i + 1;
+            postWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            postWrites[i].descriptorCount = 1;
+            postWrites[i].pImageInfo = postInfos[i];
+        }
+
+        vkUpdateDescriptorSets(device_->get(), static_cast<uint32_t>(postWrites.size()),
+                               postWrites.data(), 0, nullptr);
+    }
 }
 
 void RendererPost::createPipelineLayout()
@@ -384,12 +993,37 @@ void RendererPost::createPipelineLayout()
     pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
 
     VK_CHECK(vkCreatePipelineLayout(device_->get(), &pipelineLayoutCI, nullptr, &pipelineLayout_));
+
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.size = sizeof(BloomComputePushConstants);
+
+    pipelineLayoutCI.setLayoutCount = 1;
+    pipelineLayoutCI.pSetLayouts = &bloomSetLayout_;
+
+    VK_CHECK(
+        vkCreatePipelineLayout(device_->get(), &pipelineLayoutCI, nullptr, &bloomPipelineLayout_));
+
+    pipelineLayoutCI.pSetLayouts = &postSetLayout_;
+    pipelineLayoutCI.pushConstantRangeCount = 0;
+    pipelineLayoutCI.pPushConstantRanges = nullptr;
+
+    VK_CHECK(
+        vkCreatePipelineLayout(device_->get(), &pipelineLayoutCI, nullptr, &postPipelineLayout_));
+
+    pushConstantRange.size = sizeof(PostAaPushConstants);
+
+    pipelineLayoutCI.pSetLayouts = &aaSetLayout_;
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(
+        vkCreatePipelineLayout(device_->get(), &pipelineLayoutCI, nullptr, &aaPipelineLayout_));
 }
 
 void RendererPost::createPipelineBloomDown()
 {
-    VkShaderModule vertexModule = device_->createShaderModule("./shaders/post_process.vert.spv");
-    VkShaderModule fragmentModule = device_->createShaderModule("./shaders/bloom_down.frag.spv");
+    VkShaderModule vertexModule = device_->shaderModule("./shaders/post_process.vert.spv");
+    VkShaderModule fragmentModule = device_->shaderModule("./shaders/bloom_down.frag.spv");
 
     std::array<VkPipelineShaderStageCreateInfo, 2> shaderSCIs{};
     shaderSCIs[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -503,17 +1137,13 @@ void RendererPost::createPipelineBloomDown()
     pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
     pipelineCI.basePipelineIndex = -1;
 
-    VK_CHECK(vkCreateGraphicsPipelines(device_->get(), device_->cache(), 1, &pipelineCI, nullptr,
-                                       &pipelineBloomDown_));
-
-    vkDestroyShaderModule(device_->get(), vertexModule, nullptr);
-    vkDestroyShaderModule(device_->get(), fragmentModule, nullptr);
+    pipelineBloomDown_ = device_->createGraphicsPipeline(pipelineCI);
 }
 
 void RendererPost::createPipelineBloomUp()
 {
-    VkShaderModule vertexModule = device_->createShaderModule("./shaders/post_process.vert.spv");
-    VkShaderModule fragmentModule = device_->createShaderModule("./shaders/bloom_up.frag.spv");
+    VkShaderModule vertexModule = device_->shaderModule("./shaders/post_process.vert.spv");
+    VkShaderModule fragmentModule = device_->shaderModule("./shaders/bloom_up.frag.spv");
 
     std::array<VkPipelineShaderStageCreateInfo, 2> shaderSCIs{};
     shaderSCIs[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -627,17 +1257,78 @@ void RendererPost::createPipelineBloomUp()
     pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
     pipelineCI.basePipelineIndex = -1;
 
-    VK_CHECK(vkCreateGraphicsPipelines(device_->get(), device_->cache(), 1, &pipelineCI, nullptr,
-                                       &pipelineBloomUp_));
+    pipelineBloomUp_ = device_->createGraphicsPipeline(pipelineCI);
+}
+
+void RendererPost::createPipelineBloomCompute()
+{
+    VkComputePipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCI.stage.pName = "main";
+    pipelineCI.layout = bloomPipelineLayout_;
+
+    pipelineCI.stage.module = device_->hdrShaderModule("bloom_down");
+    pipelineBloomDownCompute_ = device_->createComputePipeline(pipelineCI);
+
+    pipelineCI.stage.module = device_->hdrShaderModule("bloom_up");
+    pipelineBloomUpCompute_ = device_->createComputePipeline(pipelineCI);
+}
+
+void RendererPost::createPipelineAntiAliasing()
+{
+    VkComputePipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCI.stage.pName = "main";
+    pipelineCI.layout = aaPipelineLayout_;
+
+    pipelineCI.stage.module = device_->hdrShaderModule("fxaa");
+    pipelineFxaa_ = device_->createComputePipeline(pipelineCI);
+
+    pipelineCI.stage.module = device_->shaderModule("./shaders/smaa_edges.comp.spv");
+    pipelineSmaaEdges_ = device_->createComputePipeline(pipelineCI);
 
-    vkDestroyShaderModule(device_->get(), vertexModule, nullptr);
-    vkDestroyShaderModule(device_->get(), fragmentModule, nullptr);
+    pipelineCI.stage.module = device_->shaderModule("./shaders/smaa_weights.comp.spv");
+    pipelineSmaaWeights_ = device_->createComputePipeline(pipelineCI);
+
+    pipelineCI.stage.module = device_->hdrShaderModule("smaa_blend");
+    pipelineSmaaBlend_ = device_->createComputePipeline(pipelineCI);
+}
+
+void RendererPost::createPipelinePostCompute(Tonemapper tonemapper)
+{
+    uint32_t tonemapperId = static_cast<uint32_t>(tonemapper);
+
+    VkSpecializationMapEntry specializationEntry{};
+    specializationEntry.constantID = 0;
+    specializationEntry.offset = 0;
+    specializationEntry.size = sizeof(uint32_t);
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = 1;
+    specializationInfo.pMapEntries = &specializationEntry;
+    specializationInfo.dataSize = sizeof(uint32_t);
+    specializationInfo.pData = &tonemapperId;
+
+    VkComputePipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCI.stage.module = device_->shaderModule("./shaders/post_process.comp.spv");
+    pipelineCI.stage.pName = "main";
+    pipelineCI.stage.pSpecializationInfo = &specializationInfo;
+    pipelineCI.layout = postPipelineLayout_;
+
+    pipelinesPostCompute_[tonemapperId] = device_->createComputePipeline(pipelineCI);
 }
 
 void RendererPost::createPipeline(VkFormat colorFormat)
 {
-    VkShaderModule vertexModule = device_->createShaderModule("./shaders/post_process.vert.spv");
-    VkShaderModule fragmentModule = device_->createShaderModule("./shaders/post_process.frag.spv");
+    VkShaderModule vertexModule = device_->shaderModule("./shaders/post_process.vert.spv");
+    VkShaderModule fragmentModule = device_->shaderModule("./shaders/post_process.frag.spv");
 
     std::array<VkPipelineShaderStageCreateInfo, 2> shaderSCIs{};
     shaderSCIs[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -751,11 +1442,7 @@ void RendererPost::createPipeline(VkFormat colorFormat)
     pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
     pipelineCI.basePipelineIndex = -1;
 
-    VK_CHECK(vkCreateGraphicsPipelines(device_->get(), device_->cache(), 1, &pipelineCI, nullptr,
-                                       &pipeline_));
-
-    vkDestroyShaderModule(device_->get(), vertexModule, nullptr);
-    vkDestroyShaderModule(device_->get(), fragmentModule, nullptr);
+    pipeline_ = device_->createGraphicsPipeline(pipelineCI);
 }
 
 } // namespace guk
\ No newline at end of file
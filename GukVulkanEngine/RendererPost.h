@@ -2,48 +2,121 @@
 
 #include "Image2D.h"
 #include "Buffer.h"
+#include "RenderGraph.h"
 #include "DataStructures.h"
 
 namespace guk {
 class RendererPost
 {
   public:
-    RendererPost(std::shared_ptr<Device> device, VkFormat colorFormat, uint32_t width,
-                 uint32_t height, std::shared_ptr<Image2D> sceneTexture,
-                 std::shared_ptr<Image2D> shadowTexture);
+    // storageTarget when render targets can be written from compute (fused post pass)
+    RendererPost(std::shared_ptr<Device> device, std::shared_ptr<RenderGraph> graph,
+                 VkFormat colorFormat, bool storageTarget, uint32_t width, uint32_t height,
+                 std::shared_ptr<Image2D> sceneTexture, std::shared_ptr<Image2D> shadowTexture);
     ~RendererPost();
 
     void resized(uint32_t width, uint32_t height);
+    // recreates the bloom chain and anti-aliased copy in the format of the scene texture, the
+    // caller waits for the queue
+    void sceneFormatChanged();
     void update(uint32_t frameIdx, PostUniform postUniform);
-    void draw(VkCommandBuffer cmd, uint32_t frameIdx, std::shared_ptr<Image2D> renderTarget);
+    void addPasses(uint32_t frameIdx, std::shared_ptr<Image2D> renderTarget);
+
+    static constexpr uint32_t MAX_BLOOM_LEVELS{8};
+    uint32_t bloomLevels() const;
+    // recreates the bloom chain, the caller waits for the frames using it first
+    void setBloomLevels(uint32_t levels);
+    bool& computeBloom();
+
+    bool storageTarget() const;
+    bool& fusedPost();
+    Tonemapper& tonemapper();
+
+    PostAntiAliasing postAntiAliasing() const;
+    // the caller waits for the frames using the previous mode first
+    void setPostAntiAliasing(PostAntiAliasing postAntiAliasing);
+    VkDeviceSize antiAliasingMemory() const;
+    VkDeviceSize bloomMemory() const;
 
   private:
     std::shared_ptr<Device> device_;
-    static constexpr uint32_t BLOOM_LEVELS{4};
+    std::shared_ptr<RenderGraph> graph_;
+    // level 1 texels per side filtered by one group of bloom_down.comp
+    static constexpr uint32_t BLOOM_GROUP_TILE{32};
+
+    uint32_t bloomLevels_{4};
+    bool computeBloom_{true};
+    bool storageTarget_{};
+    bool fusedPost_{};
+    Tonemapper tonemapper_{Tonemapper::Reinhard};
+    PostAntiAliasing postAntiAliasing_{PostAntiAliasing::None};
 
     std::array<std::unique_ptr<Buffer>, Device::MAX_FRAMES_IN_FLIGHT> uniformBuffers_;
     std::unique_ptr<Image2D> bloomImage_;
-    std::array<std::unique_ptr<Image2D>, BLOOM_LEVELS> bloomTextures_;
+    std::array<std::unique_ptr<Image2D>, MAX_BLOOM_LEVELS> bloomTextures_;
+    std::unique_ptr<Buffer> bloomCounter_;
     std::shared_ptr<Image2D> sceneTexture_;
     std::shared_ptr<Image2D> shadowTexture_;
+    // anti-aliased scene read by post in place of sceneTexture_, smaa edges and weights
+    std::unique_ptr<Image2D> aaImage_;
+    std::unique_ptr<Image2D> smaaEdges_;
+    std::unique_ptr<Image2D> smaaWeights_;
+    bool shadowDepthView_{};
+    glm::vec2 sceneScale_{1.f};
 
     VkDescriptorSetLayout uniformSetLayout_{};
     VkDescriptorSetLayout textureSetLayout_{};
+    VkDescriptorSetLayout bloomSetLayout_{};
+    VkDescriptorSetLayout postSetLayout_{};
+    VkDescriptorSetLayout aaSetLayout_{};
 
     std::array<VkDescriptorSet, Device::MAX_FRAMES_IN_FLIGHT> uniformSets_{};
-    std::array<VkDescriptorSet, BLOOM_LEVELS> bloomTextureSets_{};
+    std::array<VkDescriptorSet, MAX_BLOOM_LEVELS> bloomTextureSets_{};
+    VkDescriptorSet bloomSet_{};
+    std::array<VkDescriptorSet, Device::MAX_FRAMES_IN_FLIGHT> postSets_{};
     VkDescriptorSet sceneTextureSet_{};
     VkDescriptorSet shadowTextureSet_{};
+    VkDescriptorSet aaTextureSet_{};
+    VkDescriptorSet fxaaSet_{};
+    VkDescriptorSet smaaEdgesSet_{};
+    VkDescriptorSet smaaWeightsSet_{};
+    VkDescriptorSet smaaBlendSet_{};
 
     VkPipelineLayout pipelineLayout_{};
     VkPipeline pipeline_{};
     VkPipeline pipelineBloomDown_{};
     VkPipeline pipelineBloomUp_{};
+    VkPipelineLayout bloomPipelineLayout_{};
+    VkPipeline pipelineBloomDownCompute_{};
+    VkPipeline pipelineBloomUpCompute_{};
+    VkPipelineLayout postPipelineLayout_{};
+    static constexpr uint32_t TONEMAPPERS{3};
+    std::array<VkPipeline, TONEMAPPERS> pipelinesPostCompute_{};
+    VkPipelineLayout aaPipelineLayout_{};
+    VkPipeline pipelineFxaa_{};
+    VkPipeline pipelineSmaaEdges_{};
+    VkPipeline pipelineSmaaWeights_{};
+    VkPipeline pipelineSmaaBlend_{};
 
-    void bloomDown(VkCommandBuffer cmd);
-    void bloomUp(VkCommandBuffer cmd);
+    void draw(VkCommandBuffer cmd, uint32_t frameIdx, std::shared_ptr<Image2D> renderTarget);
+    void drawCompute(VkCommandBuffer cmd, uint32_t frameIdx,
+                     std::shared_ptr<Image2D> renderTarget);
+    // the fused post pass upsamples the last bloom level itself
+    uint32_t bloomOutputLevel() const;
+    void bloomDown(VkCommandBuffer cmd, uint32_t level);
+    void bloomUp(VkCommandBuffer cmd, uint32_t level);
+    void bloomDownCompute(VkCommandBuffer cmd);
+    void bloomUpCompute(VkCommandBuffer cmd);
+    void addBloomPasses();
+    void addBloomComputePasses();
+    // image post reads the scene from, the anti-aliased copy when post anti-aliasing is on
+    Image2D* postInput() const;
+    void addAntiAliasingPasses();
+    void dispatchAntiAliasing(VkCommandBuffer cmd, VkPipeline pipeline, VkDescriptorSet set);
 
     void createBloomImage(uint32_t width, uint32_t height);
+    void createBloomViews();
+    void createAntiAliasingImages(uint32_t width, uint32_t height);
     void createUniform();
 
     void createDescriptorSetLayout();
@@ -55,5 +128,8 @@ class RendererPost
 
     void createPipelineBloomDown();
     void createPipelineBloomUp();
+    void createPipelineBloomCompute();
+    void createPipelinePostCompute(Tonemapper tonemapper);
+    void createPipelineAntiAliasing();
 };
 } // namespace guk
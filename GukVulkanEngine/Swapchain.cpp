@@ -69,6 +69,11 @@ void Swapchain::create(std::unique_ptr<Window>& window)
         imageCount = capabiliteis.maxImageCount;
     }
 
+    VkFormatProperties formatProperties{};
+    vkGetPhysicalDeviceFormatProperties(device_->physical(), format, &formatProperties);
+    storage_ = (capabiliteis.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) &&
+               (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+
     VkSwapchainCreateInfoKHR swapchainCI{};
     swapchainCI.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
     swapchainCI.surface = surface_;
@@ -77,8 +82,15 @@ void Swapchain::create(std::unique_ptr<Window>& window)
     swapchainCI.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
     swapchainCI.imageExtent = extent;
     swapchainCI.imageArrayLayers = 1;
-    swapchainCI.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    swapchainCI.imageUsage =
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (storage_ ? VK_IMAGE_USAGE_STORAGE_BIT : 0);
     swapchainCI.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    const auto& queueFamilies = device_->queueFamilies();
+    if (queueFamilies.size() > 1) {
+        swapchainCI.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        swapchainCI.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        swapchainCI.pQueueFamilyIndices = queueFamilies.data();
+    }
     swapchainCI.preTransform = capabiliteis.currentTransform;
     swapchainCI.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapchainCI.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
@@ -132,4 +144,9 @@ const VkFormat& Swapchain::format() const
     return images_[0]->format();
 }
 
+bool Swapchain::storage() const
+{
+    return storage_;
+}
+
 } // namespace guk
\ No newline at end of file
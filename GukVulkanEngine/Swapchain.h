@@ -19,11 +19,14 @@ class Swapchain
     uint32_t width() const;
     uint32_t height() const;
     const VkFormat& format() const;
+    // images can be written from compute
+    bool storage() const;
 
   private:
     std::shared_ptr<Device> device_;
     VkSurfaceKHR surface_{};
     VkSwapchainKHR swapchain_{};
     std::vector<std::shared_ptr<Image2D>> images_{};
+    bool storage_{};
 };
 } // namespace guk
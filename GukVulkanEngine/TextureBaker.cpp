@@ -0,0 +1,249 @@
+#include "TextureBaker.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <thread>
+#include <vector>
+#include <assimp\Importer.hpp>
+#include <assimp\scene.h>
+#include <stb_image.h>
+
+namespace guk {
+
+static float srgbToLinear(unsigned char value)
+{
+    float c = value / 255.f;
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static unsigned char linearToSrgb(float value)
+{
+    float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+    return static_cast<unsigned char>(std::clamp(c, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+// 2x2 box filter, color channels are averaged in linear space
+static std::vector<unsigned char> downsample(const std::vector<unsigned char>& src, uint32_t width,
+                                             uint32_t height, bool srgb)
+{
+    uint32_t dstWidth = std::max(width / 2, 1u);
+    uint32_t dstHeight = std::max(height / 2, 1u);
+    std::vector<unsigned char> dst(static_cast<size_t>(dstWidth) * dstHeight * 4);
+
+    for (uint32_t y = 0; y < dstHeight; y++) {
+        for (uint32_t x = 0; x < dstWidth; x++) {
+            uint32_t x0 = std::min(x * 2, width - 1);
+            uint32_t x1 = std::min(x * 2 + 1, width - 1);
+            uint32_t y0 = std::min(y * 2, height - 1);
+            uint32_t y1 = std::min(y * 2 + 1, height - 1);
+            std::array<size_t, 4> texels{(y0 * width + x0) * 4, (y0 * width + x1) * 4,
+                                         (y1 * width + x0) * 4, (y1 * width + x1) * 4};
+
+            for (uint32_t c = 0; c < 4; c++) {
+                float sum{};
+                for (size_t texel : texels) {
+                    sum += srgb && c < 3 ? srgbToLinear(src[texel + c]) : src[texel + c] / 255.f;
+                }
+
+                size_t i = (static_cast<size_t>(y) * dstWidth + x) * 4 + c;
+                dst[i] = srgb && c < 3 ? linearToSrgb(sum / 4.f)
+                                       : static_cast<unsigned char>(sum / 4.f * 255.f + 0.5f);
+            }
+        }
+    }
+
+    return dst;
+}
+
+void TextureBaker::bake(const std::string& modelFile)
+{
+    std::filesystem::path path(modelFile);
+    std::string directory = path.parent_path().string() + "\\";
+    std::string name = path.stem().string();
+
+    Assimp::Importer aiImporter;
+    const aiScene* scene = aiImporter.ReadFile(modelFile, 0);
+    if (!scene) {
+        exitLog("failed to load model: {}", modelFile);
+    }
+
+    // same classification as Model::processMaterial
+    const std::array<std::pair<aiTextureType, TextureKind>, 5> slots{{
+        {aiTextureType_DIFFUSE, TextureKind::Color},
+        {aiTextureType_EMISSIVE, TextureKind::Color},
+        {aiTextureType_NORMALS, TextureKind::Normal},
+        {aiTextureType_GLTF_METALLIC_ROUGHNESS, TextureKind::MetallicRoughness},
+        {aiTextureType_LIGHTMAP, TextureKind::Occlusion},
+    }};
+
+    std::vector<std::pair<std::string, TextureKind>> textures;
+    for (uint32_t i = 0; i < scene->mNumMaterials; i++) {
+        for (const auto& [type, kind] : slots) {
+            aiString texturePath;
+            if (scene->mMaterials[i]->GetTexture(type, 0, &texturePath) != AI_SUCCESS) {
+                continue;
+            }
+
+            auto it = std::find_if(textures.begin(), textures.end(),
+                                   [&texturePath](const auto& texture) {
+                                       return texture.first == texturePath.C_Str();
+                                   });
+            if (it == textures.end()) {
+                textures.emplace_back(texturePath.C_Str(), kind);
+            } else if (it->second != kind) {
+                it->second = TextureKind::Linear;
+            }
+        }
+    }
+
+    for (const auto& [file, kind] : textures) {
+        int width{}, height{}, ch{};
+        unsigned char* data{};
+
+        if (file[0] == '*') {
+            const aiTexture* aiTex = scene->mTextures[std::stoi(file.substr(1))];
+            if (aiTex->mHeight != 0) {
+                log("skipping uncompressed embedded texture {}", file);
+                continue;
+            }
+            data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(aiTex->pcData),
+                                         aiTex->mWidth, &width, &height, &ch, STBI_rgb_alpha);
+        } else {
+            data = stbi_load((directory + file).c_str(), &width, &height, &ch, STBI_rgb_alpha);
+        }
+
+        if (!data) {
+            exitLog("failed to load image: {}", file);
+        }
+
+        std::vector<unsigned char> level(data, data + static_cast<size_t>(width) * height * 4);
+        stbi_image_free(data);
+
+        // metallic/roughness live in green/blue, BC5 keeps red/green
+        if (kind == TextureKind::MetallicRoughness) {
+            for (size_t i = 0; i < level.size(); i += 4) {
+                level[i + 0] = level[i + 1];
+                level[i + 1] = level[i + 2];
+                level[i + 2] = 0;
+                level[i + 3] = 255;
+            }
+        }
+
+        uint32_t levels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+
+        ktxTextureCreateInfo createInfo{};
+        createInfo.vkFormat =
+            kind == TextureKind::Color ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        createInfo.baseWidth = width;
+        createInfo.baseHeight = height;
+        createInfo.baseDepth = 1;
+        createInfo.numDimensions = 2;
+        createInfo.numLevels = levels;
+        createInfo.numLayers = 1;
+        createInfo.numFaces = 1;
+        createInfo.isArray = KTX_FALSE;
+        createInfo.generateMipmaps = KTX_FALSE;
+
+        ktxTexture2* texture;
+        if (ktxTexture2_Create(&createInfo, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture) !=
+            KTX_SUCCESS) {
+            exitLog("failed to create ktx2 texture for {}", file);
+        }
+
+        uint32_t levelWidth = width;
+        uint32_t levelHeight = height;
+        for (uint32_t i = 0; i < levels; i++) {
+            ktxTexture_SetImageFromMemory(ktxTexture(texture), i, 0, 0, level.data(), level.size());
+
+            if (i + 1 < levels) {
+                level = downsample(level, levelWidth, levelHeight, kind == TextureKind::Color);
+                levelWidth = std::max(levelWidth / 2, 1u);
+                levelHeight = std::max(levelHeight / 2, 1u);
+            }
+        }
+
+        ktxBasisParams params{};
+        params.structSize = sizeof(params);
+        params.uastc = KTX_TRUE;
+        params.uastcFlags = KTX_PACK_UASTC_LEVEL_DEFAULT;
+        params.threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+        if (ktxTexture2_CompressBasisEx(texture, &params) != KTX_SUCCESS ||
+            ktxTexture2_DeflateZstd(texture, 18) != KTX_SUCCESS) {
+            exitLog("failed to compress {}", file);
+        }
+
+        std::string baked = bakedPath(directory, name, file);
+        if (ktxTexture_WriteToNamedFile(ktxTexture(texture), baked.c_str()) != KTX_SUCCESS) {
+            exitLog("failed to write {}", baked);
+        }
+        ktxTexture_Destroy(ktxTexture(texture));
+
+        log("baked {} ({}x{}, {} levels) -> {}", file, width, height, levels, baked);
+    }
+}
+
+std::string TextureBaker::bakedPath(const std::string& directory, const std::string& modelName,
+                                    const std::string& textureFile)
+{
+    if (textureFile[0] == '*') {
+        return directory + modelName + "_" + textureFile.substr(1) + ".ktx2";
+    }
+
+    return directory + std::filesystem::path(textureFile).replace_extension(".ktx2").string();
+}
+
+ktx_transcode_fmt_e TextureBaker::transcodeTarget(TextureKind kind, bool bc)
+{
+    if (!bc) {
+        return KTX_TTF_RGBA32;
+    }
+
+    switch (kind) {
+    case TextureKind::Normal:
+    case TextureKind::MetallicRoughness:
+        return KTX_TTF_BC5_RG;
+    case TextureKind::Occlusion:
+        return KTX_TTF_BC4_R;
+    default:
+        return KTX_TTF_BC7_RGBA;
+    }
+}
+
+VkFormat TextureBaker::transcodeFormat(TextureKind kind, bool bc)
+{
+    bool srgb = kind == TextureKind::Color;
+
+    switch (transcodeTarget(kind, bc)) {
+    case KTX_TTF_BC5_RG:
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+    case KTX_TTF_BC4_R:
+        return VK_FORMAT_BC4_UNORM_BLOCK;
+    case KTX_TTF_BC7_RGBA:
+        return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    default:
+        return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+VkDeviceSize TextureBaker::levelSize(VkFormat format, uint32_t width, uint32_t height)
+{
+    VkDeviceSize blocksX = (std::max(width, 1u) + 3) / 4;
+    VkDeviceSize blocksY = (std::max(height, 1u) + 3) / 4;
+
+    switch (format) {
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+        return blocksX * blocksY * 8;
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return blocksX * blocksY * 16;
+    default:
+        return static_cast<VkDeviceSize>(std::max(width, 1u)) * std::max(height, 1u) * 4;
+    }
+}
+
+} // namespace guk
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "DataStructures.h"
+
+#include <ktx.h>
+#include <string>
+
+namespace guk {
+
+// offline conversion of model textures to UASTC .ktx2 files with full mip chains, transcoded
+// on load to BC7 (color), BC5 (normal, metallic/roughness) and BC4 (occlusion)
+class TextureBaker
+{
+  public:
+    static void bake(const std::string& modelFile);
+
+    static std::string bakedPath(const std::string& directory, const std::string& modelName,
+                                 const std::string& textureFile);
+    static ktx_transcode_fmt_e transcodeTarget(TextureKind kind, bool bc);
+    static VkFormat transcodeFormat(TextureKind kind, bool bc);
+    static VkDeviceSize levelSize(VkFormat format, uint32_t width, uint32_t height);
+};
+
+} // namespace guk
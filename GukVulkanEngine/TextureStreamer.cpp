@@ -0,0 +1,403 @@
+#include "TextureStreamer.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+
+namespace guk {
+
+static constexpr char LEVELS_MAGIC[4]{'G', 'U', 'K', 'T'};
+
+TextureStreamer::TextureStreamer(std::shared_ptr<Device> device, VkDeviceSize budget)
+    : device_(device), budget_(budget)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    for (Upload& upload : pendingUploads_) {
+        VK_CHECK(vkWaitForFences(device_->get(), 1, &upload.fence, VK_TRUE, UINT64_MAX));
+        device_->submitDone(upload.cmd, upload.fence);
+    }
+}
+
+void TextureStreamer::add(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset,
+                          std::shared_ptr<Image2D> texture, const std::string& baked,
+                          const unsigned char* texels, VkFormat format, uint32_t width,
+                          uint32_t height, const std::vector<VkDeviceSize>& levelSizes,
+                          VkComponentMapping components)
+{
+    Entry entry{};
+    entry.texture = texture;
+    entry.format = format;
+    entry.width = width;
+    entry.height = height;
+    entry.levelSizes = levelSizes;
+    entry.components = components;
+    entry.levels = readLevels(baked, format, size(entry, 0));
+    if (!entry.levels) {
+        log("{}: no transcoded levels file, keeping the mip chain in memory", baked);
+        entry.texels.assign(texels, texels + size(entry, 0));
+    }
+
+    entry.tailLevel = static_cast<uint32_t>(levelSizes.size() - 1);
+    for (uint32_t level = 0; level < levelSizes.size(); level++) {
+        if (std::max(width >> level, height >> level) <= TAIL_SIZE) {
+            entry.tailLevel = level;
+            break;
+        }
+    }
+    entry.residentLevel = entry.tailLevel;
+
+    uint32_t tail = entry.tailLevel;
+    texture->createTexture(cmd, buffer, offset + this->offset(entry, tail), format,
+                           std::max(1u, width >> tail), std::max(1u, height >> tail),
+                           {levelSizes.begin() + tail, levelSizes.end()}, components);
+
+    entries_[texture.get()] = std::move(entry);
+}
+
+void TextureStreamer::request(const Image2D* texture, float pixels)
+{
+    auto it = entries_.find(texture);
+    if (it == entries_.end()) {
+        return;
+    }
+
+    Entry& entry = it->second;
+    entry.pixels = entry.lastRequest == frame_ ? std::max(entry.pixels, pixels) : pixels;
+    entry.lastRequest = frame_;
+}
+
+bool TextureStreamer::update()
+{
+    frame_++;
+    uploads_ = 0;
+    evictions_ = 0;
+
+    std::erase_if(entries_, [](const auto& entry) { return entry.second.texture.expired(); });
+
+    // the frames in flight when an image was swapped out have finished and each frame index has
+    // had its descriptor sets pointed at the new image since
+    std::erase_if(retired_, [this](const Retired& retired) {
+        return frame_ - retired.frame >= Device::MAX_FRAMES_IN_FLIGHT;
+    });
+    bool swapped = finishUploads();
+
+    std::vector<Entry*> wanting;
+    std::vector<Entry*> unwanted;
+    for (auto& [image, entry] : entries_) {
+        if (entry.pending) {
+            continue;
+        }
+
+        uint32_t wanted = wantedLevel(entry);
+        if (wanted < entry.residentLevel) {
+            wanting.push_back(&entry);
+        } else if (wanted > entry.residentLevel) {
+            unwanted.push_back(&entry);
+        }
+    }
+
+    // largest on screen first, least recently used evicted first
+    std::sort(wanting.begin(), wanting.end(),
+              [](const Entry* a, const Entry* b) { return a->pixels > b->pixels; });
+    std::sort(unwanted.begin(), unwanted.end(),
+              [](const Entry* a, const Entry* b) { return a->lastRequest < b->lastRequest; });
+
+    std::vector<std::pair<Entry*, uint32_t>> changes;
+    VkDeviceSize resident = residentSize();
+    VkDeviceSize uploadSize{};
+    size_t evicted{};
+
+    auto evict = [&](Entry* entry, uint32_t level) {
+        resident -= size(*entry, entry->residentLevel) - size(*entry, level);
+        uploadSize += size(*entry, level);
+        changes.push_back({entry, level});
+    };
+
+    for (Entry* entry : wanting) {
+        uint32_t level = wantedLevel(*entry);
+        VkDeviceSize grow = size(*entry, level) - size(*entry, entry->residentLevel);
+        while (resident + grow > budget_ && evicted < unwanted.size()) {
+            Entry* victim = unwanted[evicted++];
+            evict(victim, wantedLevel(*victim));
+        }
+
+        // settle for a coarser level when the budget is still short
+        while (level < entry->residentLevel &&
+               resident + size(*entry, level) - size(*entry, entry->residentLevel) > budget_) {
+            level++;
+        }
+        if (level == entry->residentLevel) {
+            continue;
+        }
+
+        // the whole chain goes up again, the image is recreated with more levels
+        if (uploadSize > 0 && uploadSize + size(*entry, level) > UPLOAD_BYTES_PER_FRAME) {
+            break;
+        }
+        resident += size(*entry, level) - size(*entry, entry->residentLevel);
+        uploadSize += size(*entry, level);
+        changes.push_back({entry, level});
+    }
+
+    // a lowered budget drops the finest level of the smallest textures on screen
+    if (resident > budget_) {
+        std::vector<Entry*> entries;
+        for (auto& [image, entry] : entries_) {
+            bool changed = std::any_of(changes.begin(), changes.end(),
+                                       [&entry](const auto& change) {
+                                           return change.first == &entry;
+                                       });
+            if (!changed && !entry.pending && entry.residentLevel < entry.tailLevel) {
+                entries.push_back(&entry);
+            }
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry* a, const Entry* b) { return a->pixels < b->pixels; });
+
+        for (size_t i = 0; i < entries.size() && resident > budget_; i++) {
+            evict(entries[i], entries[i]->residentLevel + 1);
+        }
+    }
+
+    if (changes.empty()) {
+        return swapped;
+    }
+
+    std::vector<VkDeviceSize> offsets;
+    VkDeviceSize stagingSize{};
+    for (const auto& [entry, level] : changes) {
+        offsets.push_back((stagingSize + 15) / 16 * 16);
+        stagingSize = offsets.back() + size(*entry, level);
+    }
+
+    Upload upload{};
+    upload.staging = std::make_unique<Buffer>(device_);
+    upload.staging->createStagingBuffer(stagingSize);
+    unsigned char* dst = static_cast<unsigned char*>(upload.staging->mapped());
+    for (size_t i = 0; i < changes.size(); i++) {
+        const auto& [entry, level] = changes[i];
+        memcpy(dst + offsets[i], levelData(*entry) + offset(*entry, level),
+               static_cast<size_t>(size(*entry, level)));
+    }
+
+    // the textures keep their images, frames in flight may still read them
+    upload.cmd = device_->beginCmd();
+    for (size_t i = 0; i < changes.size(); i++) {
+        const auto& [entry, level] = changes[i];
+        auto image = std::make_shared<Image2D>(device_);
+        image->createTexture(upload.cmd, upload.staging->get(), offsets[i], entry->format,
+                             std::max(1u, entry->width >> level),
+                             std::max(1u, entry->height >> level),
+                             {entry->levelSizes.begin() + level, entry->levelSizes.end()},
+                             entry->components);
+
+        entry->pending = true;
+        upload.replacements.push_back({entry->texture.lock().get(), image, level});
+    }
+    upload.fence = device_->submit(upload.cmd);
+    pendingUploads_.push_back(std::move(upload));
+
+    return swapped;
+}
+
+std::shared_ptr<MappedFile> TextureStreamer::readLevels(const std::string& baked,
+                                                        VkFormat format, VkDeviceSize size)
+{
+    std::string path = levelsPath(baked);
+    LevelsHeader expected{};
+    if (!std::filesystem::exists(path) || !levelsHeader(baked, format, size, expected)) {
+        return nullptr;
+    }
+
+    auto file = std::make_shared<MappedFile>(path);
+    if (file->size() != sizeof(LevelsHeader) + size) {
+        return nullptr;
+    }
+
+    LevelsHeader header{};
+    memcpy(&header, file->data(), sizeof(LevelsHeader));
+    if (memcmp(header.magic, LEVELS_MAGIC, sizeof(LEVELS_MAGIC)) != 0 ||
+        header.version != LEVELS_VERSION || header.format != expected.format ||
+        header.size != expected.size || header.bakedSize != expected.bakedSize ||
+        header.bakedTime != expected.bakedTime) {
+        return nullptr;
+    }
+
+    return file;
+}
+
+void TextureStreamer::writeLevels(const std::string& baked, VkFormat format,
+                                  const unsigned char* texels, VkDeviceSize size)
+{
+    std::string path = levelsPath(baked);
+    LevelsHeader header{};
+    if (!levelsHeader(baked, format, size, header)) {
+        log("failed to write transcoded levels: {}", path);
+        return;
+    }
+
+    // written aside and renamed as the mesh cache is
+    std::string temp = path + ".tmp";
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(LevelsHeader));
+    out.write(reinterpret_cast<const char*>(texels), static_cast<std::streamsize>(size));
+
+    out.close();
+    std::error_code error;
+    if (out.fail()) {
+        log("failed to write transcoded levels: {}", path);
+        std::filesystem::remove(temp, error);
+        return;
+    }
+
+    std::filesystem::rename(temp, path, error);
+    if (error) {
+        log("failed to write transcoded levels: {}", path);
+        std::filesystem::remove(temp, error);
+    }
+}
+
+bool TextureStreamer::finishUploads()
+{
+    bool swapped{};
+    std::erase_if(pendingUploads_, [this, &swapped](Upload& upload) {
+        if (!device_->submitDone(upload.cmd, upload.fence)) {
+            return false;
+        }
+
+        for (Replacement& replacement : upload.replacements) {
+            auto it = entries_.find(replacement.texture);
+            std::shared_ptr<Image2D> texture =
+                it == entries_.end() ? nullptr : it->second.texture.lock();
+            if (texture) {
+                Entry& entry = it->second;
+                replacement.image->setSampler(texture->sampler());
+                texture->swap(*replacement.image);
+
+                if (replacement.level < entry.residentLevel) {
+                    uploads_++;
+                } else {
+                    evictions_++;
+                }
+                entry.residentLevel = replacement.level;
+                entry.pending = false;
+                swapped = true;
+            }
+
+            // holds the old image after the swap
+            retired_.push_back({replacement.image, frame_});
+        }
+        return true;
+    });
+
+    return swapped;
+}
+
+VkDeviceSize TextureStreamer::budget() const
+{
+    return budget_;
+}
+
+void TextureStreamer::setBudget(VkDeviceSize budget)
+{
+    budget_ = budget;
+}
+
+VkDeviceSize TextureStreamer::residentSize() const
+{
+    VkDeviceSize resident{};
+    for (const auto& [image, entry] : entries_) {
+        resident += size(entry, entry.residentLevel);
+    }
+
+    return resident;
+}
+
+VkDeviceSize TextureStreamer::fullSize() const
+{
+    VkDeviceSize full{};
+    for (const auto& [image, entry] : entries_) {
+        full += size(entry, 0);
+    }
+
+    return full;
+}
+
+uint32_t TextureStreamer::textureCount() const
+{
+    return static_cast<uint32_t>(entries_.size());
+}
+
+uint32_t TextureStreamer::uploads() const
+{
+    return uploads_;
+}
+
+uint32_t TextureStreamer::evictions() const
+{
+    return evictions_;
+}
+
+uint32_t TextureStreamer::wantedLevel(const Entry& entry) const
+{
+    if (entry.pixels <= 0.f || frame_ - entry.lastRequest > UNUSED_FRAMES) {
+        return entry.tailLevel;
+    }
+
+    // one texel per pixel, assuming the uv range covers the texture about once
+    float level = std::floor(std::log2(std::max(entry.width, entry.height) / entry.pixels));
+    return std::min(static_cast<uint32_t>(std::max(level, 0.f)), entry.tailLevel);
+}
+
+VkDeviceSize TextureStreamer::size(const Entry& entry, uint32_t level)
+{
+    return std::accumulate(entry.levelSizes.begin() + level, entry.levelSizes.end(),
+                           VkDeviceSize{0});
+}
+
+VkDeviceSize TextureStreamer::offset(const Entry& entry, uint32_t level)
+{
+    return std::accumulate(entry.levelSizes.begin(), entry.levelSizes.begin() + level,
+                           VkDeviceSize{0});
+}
+
+std::string TextureStreamer::levelsPath(const std::string& baked)
+{
+    return std::filesystem::path(baked).replace_extension(".gukmips").string();
+}
+
+bool TextureStreamer::levelsHeader(const std::string& baked, VkFormat format, VkDeviceSize size,
+                                   LevelsHeader& header)
+{
+    std::error_code error;
+    uint64_t bakedSize = std::filesystem::file_size(baked, error);
+    if (error) {
+        return false;
+    }
+    auto bakedTime = std::filesystem::last_write_time(baked, error);
+    if (error) {
+        return false;
+    }
+
+    memcpy(header.magic, LEVELS_MAGIC, sizeof(LEVELS_MAGIC));
+    header.version = LEVELS_VERSION;
+    header.format = format;
+    header.size = size;
+    header.bakedSize = bakedSize;
+    header.bakedTime = bakedTime.time_since_epoch().count();
+    return true;
+}
+
+const unsigned char* TextureStreamer::levelData(const Entry& entry)
+{
+    return entry.levels ? entry.levels->data() + sizeof(LevelsHeader) : entry.texels.data();
+}
+
+} // namespace guk
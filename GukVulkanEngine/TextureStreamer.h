@@ -0,0 +1,139 @@
+#pragma once
+
+#include "Image2D.h"
+#include "Buffer.h"
+#include "MappedFile.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace guk {
+
+// reads the mip chains of baked textures through a mapping of their transcoded levels file and
+// makes only the levels the renderer asks for resident, coarsest levels first, evicting finer
+// levels to stay under a vram budget
+class TextureStreamer
+{
+  public:
+    TextureStreamer(std::shared_ptr<Device> device, VkDeviceSize budget);
+    ~TextureStreamer();
+
+    // records the upload of the mip tail of texture from buffer at offset (the whole chain packed
+    // one level after another). the finer levels are read from the levels file of baked later,
+    // texels is only copied when that file is missing
+    void add(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset,
+             std::shared_ptr<Image2D> texture, const std::string& baked,
+             const unsigned char* texels, VkFormat format, uint32_t width, uint32_t height,
+             const std::vector<VkDeviceSize>& levelSizes, VkComponentMapping components);
+
+    // the transcoded chain of a baked texture, written next to it on import. nullptr when the
+    // file is missing or was written for another format or another version of baked
+    static std::shared_ptr<MappedFile> readLevels(const std::string& baked, VkFormat format,
+                                                  VkDeviceSize size);
+    static void writeLevels(const std::string& baked, VkFormat format,
+                            const unsigned char* texels, VkDeviceSize size);
+
+    // renderer feedback, texture is drawn about pixels wide on screen this frame
+    void request(const Image2D* texture, float pixels);
+
+    // changes residency within the budget and the per frame upload limit. the new mip ranges are
+    // copied into separate images without waiting, true once some copies finished and their
+    // images were swapped in, the descriptor sets of each frame then need updating
+    bool update();
+
+    VkDeviceSize budget() const;
+    void setBudget(VkDeviceSize budget);
+    VkDeviceSize residentSize() const;
+    VkDeviceSize fullSize() const;
+    uint32_t textureCount() const;
+    uint32_t uploads() const;
+    uint32_t evictions() const;
+
+  private:
+    // levels up to this size are uploaded on load and never evicted
+    static constexpr uint32_t TAIL_SIZE{64};
+    static constexpr VkDeviceSize UPLOAD_BYTES_PER_FRAME{16 * 1024 * 1024};
+    // frames without a request before a texture only wants its tail
+    static constexpr uint32_t UNUSED_FRAMES{120};
+
+    static constexpr uint32_t LEVELS_VERSION{1};
+
+    struct LevelsHeader
+    {
+        char magic[4];
+        uint32_t version;
+        VkFormat format;
+        uint64_t size;
+        // size and write time of the baked file the levels were transcoded from
+        uint64_t bakedSize;
+        int64_t bakedTime;
+    };
+
+    struct Entry
+    {
+        std::weak_ptr<Image2D> texture;
+        // the whole chain after a LevelsHeader, texels holds it instead without the file
+        std::shared_ptr<MappedFile> levels;
+        std::vector<unsigned char> texels;
+        VkFormat format{};
+        uint32_t width{};
+        uint32_t height{};
+        std::vector<VkDeviceSize> levelSizes;
+        VkComponentMapping components{};
+
+        uint32_t tailLevel{};
+        uint32_t residentLevel{};
+        // a copy into a replacement image is in flight
+        bool pending{};
+        float pixels{};
+        uint64_t lastRequest{};
+    };
+
+    // image with the mip range of level, swapped into the texture once its copy finished
+    struct Replacement
+    {
+        const Image2D* texture{};
+        std::shared_ptr<Image2D> image;
+        uint32_t level{};
+    };
+
+    // the copies of one update, the staging buffer lives until the fence signaled
+    struct Upload
+    {
+        VkCommandBuffer cmd{};
+        VkFence fence{};
+        std::unique_ptr<Buffer> staging;
+        std::vector<Replacement> replacements;
+    };
+
+    // swapped out images, kept until no frame in flight reads them through its descriptor sets
+    struct Retired
+    {
+        std::shared_ptr<Image2D> image;
+        uint64_t frame{};
+    };
+
+    std::shared_ptr<Device> device_;
+    VkDeviceSize budget_{};
+    std::vector<Upload> pendingUploads_;
+    std::vector<Retired> retired_;
+
+    std::unordered_map<const Image2D*, Entry> entries_;
+    uint64_t frame_{};
+    uint32_t uploads_{};
+    uint32_t evictions_{};
+
+    // true when images were swapped in
+    bool finishUploads();
+    uint32_t wantedLevel(const Entry& entry) const;
+    static std::string levelsPath(const std::string& baked);
+    // false when baked can not be stat'ed
+    static bool levelsHeader(const std::string& baked, VkFormat format, VkDeviceSize size,
+                             LevelsHeader& header);
+    static const unsigned char* levelData(const Entry& entry);
+    static VkDeviceSize size(const Entry& entry, uint32_t level);
+    static VkDeviceSize offset(const Entry& entry, uint32_t level);
+};
+
+} // namespace guk
@@ -0,0 +1,66 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace guk {
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    for (uint32_t i = 0; i < std::max(threadCount, 1u); i++) {
+        threads_.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+uint32_t ThreadPool::size() const
+{
+    return static_cast<uint32_t>(threads_.size());
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+    std::packaged_task<void()> packagedTask(task);
+    std::future<void> future = packagedTask.get_future();
+
+    {
+        std::lock_guard lock(mutex_);
+        tasks_.push(std::move(packagedTask));
+    }
+    condition_.notify_one();
+
+    return future;
+}
+
+void ThreadPool::work()
+{
+    while (true) {
+        std::packaged_task<void()> task;
+
+        {
+            std::unique_lock lock(mutex_);
+            condition_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (stop_ && tasks_.empty()) {
+                return;
+            }
+
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+
+        task();
+    }
+}
+
+} // namespace guk
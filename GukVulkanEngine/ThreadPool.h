@@ -0,0 +1,32 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace guk {
+
+class ThreadPool
+{
+  public:
+    ThreadPool(uint32_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    uint32_t size() const;
+    std::future<void> submit(std::function<void()> task);
+
+  private:
+    std::vector<std::thread> threads_;
+    std::queue<std::packaged_task<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stop_{};
+
+    void work();
+};
+
+} // namespace guk
@@ -6,18 +6,26 @@ layout(push_constant) uniform BloomPushConstants
 {
     float width;
     float height;
+    vec2 uvScale;
 } bloom;
 
 layout(set = 1, binding = 0) uniform sampler2D bloomTexture;
 
 layout(location = 0) out vec4 outColor;
 
+// the scene is rendered into the top left uvScale of its attachment, taps stay inside it
+vec3 tap(vec2 uv)
+{
+    vec2 uvMax = bloom.uvScale - 0.5 / vec2(textureSize(bloomTexture, 0));
+    return texture(bloomTexture, min(uv, uvMax)).rgb;
+}
+
 void main()
 {
-    float x = inUV.x;
-    float y = inUV.y;
-    float dx = 1.0 / bloom.width;
-    float dy = 1.0 / bloom.height;
+    float x = inUV.x * bloom.uvScale.x;
+    float y = inUV.y * bloom.uvScale.y;
+    float dx = bloom.uvScale.x / bloom.width;
+    float dy = bloom.uvScale.y / bloom.height;
 
     // Take 13 samples around current texel:
     // a - b - c
@@ -26,22 +34,22 @@ void main()
     // - l - m -
     // g - h - i
     // === ('e' is the current texel) ===
-    vec3 a = texture(bloomTexture, vec2(x - 2 * dx, y - 2 * dy)).rgb;
-    vec3 b = texture(bloomTexture, vec2(x,          y - 2 * dy)).rgb;
-    vec3 c = texture(bloomTexture, vec2(x + 2 * dx, y - 2 * dy)).rgb;
+    vec3 a = tap(vec2(x - 2 * dx, y - 2 * dy));
+    vec3 b = tap(vec2(x,          y - 2 * dy));
+    vec3 c = tap(vec2(x + 2 * dx, y - 2 * dy));
 
-    vec3 d = texture(bloomTexture, vec2(x - 2 * dx, y)).rgb;
-    vec3 e = texture(bloomTexture, vec2(x,          y)).rgb;
-    vec3 f = texture(bloomTexture, vec2(x + 2 * dx, y)).rgb;
+    vec3 d = tap(vec2(x - 2 * dx, y));
+    vec3 e = tap(vec2(x,          y));
+    vec3 f = tap(vec2(x + 2 * dx, y));
 
-    vec3 g = texture(bloomTexture, vec2(x - 2 * dx, y + 2 * dy)).rgb;
-    vec3 h = texture(bloomTexture, vec2(x,          y + 2 * dy)).rgb;
-    vec3 i = texture(bloomTexture, vec2(x + 2 * dx, y + 2 * dy)).rgb;
+    vec3 g = tap(vec2(x - 2 * dx, y + 2 * dy));
+    vec3 h = tap(vec2(x,          y + 2 * dy));
+    vec3 i = tap(vec2(x + 2 * dx, y + 2 * dy));
 
-    vec3 j = texture(bloomTexture, vec2(x - dx, y - dy)).rgb;
-    vec3 k = texture(bloomTexture, vec2(x + dx, y - dy)).rgb;
-    vec3 l = texture(bloomTexture, vec2(x - dx, y + dy)).rgb;
-    vec3 m = texture(bloomTexture, vec2(x + dx, y + dy)).rgb;
+    vec3 j = tap(vec2(x - dx, y - dy));
+    vec3 k = tap(vec2(x + dx, y - dy));
+    vec3 l = tap(vec2(x - dx, y + dy));
+    vec3 m = tap(vec2(x + dx, y + dy));
 
     // Apply weighted distribution:
     // 0.5 + 0.125 + 0.125 + 0.125 + 0.125 = 1
@@ -0,0 +1,23 @@
+#version 450
+
+// Position only pbr.vert for the depth pre-pass. The main pass tests against this depth with an
+// equal compare, so gl_Position is computed the same way and declared invariant in both.
+
+layout(location = 0) in vec3 inPosition;
+
+layout(push_constant) uniform ModelPushConstants
+{
+    mat4 model;
+} modelPc;
+
+layout(set = 0, binding = 0) uniform SceneUniform{
+	mat4 view;
+	mat4 proj;
+} scene;
+
+invariant gl_Position;
+
+void main() {
+	vec3 position = vec3(modelPc.model * vec4(inPosition, 1.0));
+	gl_Position = scene.proj * scene.view * vec4(position, 1.0);
+}
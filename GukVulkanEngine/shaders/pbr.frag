@@ -3,8 +3,20 @@
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexcoord;
-layout(location = 3) in vec3 inTangent;
+layout(location = 3) in vec4 inTangent;
 layout(location = 4) in vec4 inLightSpacePos;
+layout(location = 5) in vec4 inClipPos;
+layout(location = 6) in vec4 inPrevClipPos;
+
+// permutation of the material, set per pipeline by Renderer. the textures in the order of
+// MaterialUniform, materials without one read its factor alone
+layout(constant_id = 0) const bool HAS_BASE_COLOR_MAP = true;
+layout(constant_id = 1) const bool HAS_EMISSIVE_MAP = true;
+layout(constant_id = 2) const bool HAS_NORMAL_MAP = true;
+layout(constant_id = 3) const bool HAS_METALLIC_ROUGHNESS_MAP = true;
+layout(constant_id = 4) const bool HAS_OCCLUSION_MAP = true;
+// 0 single tap, 1 PCF 3x3, 2 PCF 5x5
+layout(constant_id = 5) const uint SHADOW_FILTER = 1;
 
 layout(set = 0, binding = 0) uniform SceneUniform{
 	mat4 view;
@@ -13,6 +25,10 @@ layout(set = 0, binding = 0) uniform SceneUniform{
 	vec3 directionalLightDir;  // sruface-to-light
 	vec3 directionalLightColor; // radiance
 	mat4 directionalLightMatrix;
+	mat4 viewProj;
+	mat4 prevViewProj;
+	uvec2 renderSize;
+	uint lightCount;
 } scene;
 
 layout(set = 0, binding = 1) uniform SkyboxUniform {
@@ -21,6 +37,32 @@ layout(set = 0, binding = 1) uniform SkyboxUniform {
     uint useIrradianceMap;
 } skybox;
 
+// matches Renderer::CLUSTER_GRID and MAX_CLUSTER_LIGHTS, binned by light_cluster.comp
+const uvec3 CLUSTER_GRID = uvec3(16, 9, 24);
+const uint CLUSTER_COUNT = CLUSTER_GRID.x * CLUSTER_GRID.y * CLUSTER_GRID.z;
+const uint MAX_CLUSTER_LIGHTS = 128;
+
+struct Light
+{
+    vec3 position;
+    float range;
+    vec3 color;
+    float spotInnerCos;
+    vec3 direction;
+    float spotOuterCos;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer LightBuffer
+{
+    Light lights[];
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer ClusterBuffer
+{
+    uint clusterCounts[CLUSTER_COUNT];
+    uint clusterLights[];
+};
+
 layout(set = 1, binding = 0) uniform samplerCube prefilteredMap;
 layout(set = 1, binding = 1) uniform samplerCube irradianceMap;
 layout(set = 1, binding = 2) uniform sampler2D brdfLUT;
@@ -45,6 +87,8 @@ layout(set = 2, binding = 4) uniform sampler2D metallicRoughnessTexture;
 layout(set = 2, binding = 5) uniform sampler2D occlusionTexture;
 
 layout(location = 0) out vec4 outColor;
+// taa only, dropped when the pass has a single attachment
+layout(location = 1) out vec2 outVelocity;
 
 const float PI = 3.1415926535897932384626433832795;
 
@@ -68,6 +112,69 @@ float geometrySchlickGGX(float roughness, float NdotL, float NdotV) {
     return g1l * g1v;
 }
 
+// brdf times the cosine for light arriving from L
+vec3 directLighting(vec3 N, vec3 V, vec3 L, vec3 baseColor, vec3 f0, float roughness, float metallic) {
+    vec3 H = normalize(V + L);
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotL = max(dot(N, L), 0.0);
+    float NdotH = max(dot(N, H), 0.0);
+    float HdotV = max(dot(V, H), 0.0);
+
+    vec3 F = fresnelSchlick(f0, HdotV);
+    vec3 kd = mix(1.0 - F, vec3(0.0), metallic);
+    vec3 diffuseBRDF = kd * (baseColor / PI);
+
+    float D = ndfGGX(roughness, NdotH);
+    float G = geometrySchlickGGX(roughness, NdotL, NdotV);
+    vec3 specularBRDF = (F * D * G) / max(4.0 * NdotL * NdotV, 1e-5);
+
+    return (diffuseBRDF + specularBRDF) * NdotL;
+}
+
+// point and spot lights of the cluster the fragment falls in
+vec3 clusteredLighting(vec3 N, vec3 V, vec3 baseColor, vec3 f0, float roughness, float metallic) {
+    if (scene.lightCount == 0) {
+        return vec3(0.0);
+    }
+
+    float near = scene.proj[3][2] / scene.proj[2][2];
+    float far = scene.proj[3][2] / (scene.proj[2][2] + 1.0);
+    float depth = scene.proj[3][2] / (gl_FragCoord.z + scene.proj[2][2]);
+    float slice = log(depth / near) / log(far / near) * float(CLUSTER_GRID.z);
+
+    uvec3 cluster;
+    cluster.xy = uvec2(gl_FragCoord.xy / vec2(scene.renderSize) * vec2(CLUSTER_GRID.xy));
+    cluster.z = uint(max(slice, 0.0));
+    cluster = min(cluster, CLUSTER_GRID - 1u);
+    uint clusterIdx = cluster.x + (cluster.y + cluster.z * CLUSTER_GRID.y) * CLUSTER_GRID.x;
+
+    vec3 lighting = vec3(0.0);
+    uint count = clusterCounts[clusterIdx];
+    for (uint i = 0; i < count; i++) {
+        Light light = lights[clusterLights[clusterIdx * MAX_CLUSTER_LIGHTS + i]];
+
+        // inverse square, windowed to reach zero at the range
+        vec3 toLight = light.position - inPosition;
+        float distanceSq = max(dot(toLight, toLight), 1e-4);
+        float window = clamp(1.0 - pow(distanceSq / (light.range * light.range), 2.0), 0.0, 1.0);
+        float attenuation = window * window / distanceSq;
+
+        vec3 L = toLight * inversesqrt(distanceSq);
+        if (light.spotOuterCos > -1.0) {
+            attenuation *= smoothstep(light.spotOuterCos, light.spotInnerCos,
+                                      dot(-L, light.direction));
+        }
+        if (attenuation <= 0.0) {
+            continue;
+        }
+
+        lighting += directLighting(N, V, L, baseColor, f0, roughness, metallic) * light.color *
+                    attenuation;
+    }
+
+    return lighting;
+}
+
 float calculateShadow(vec4 lightSpacePos) {
     vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
 
@@ -75,56 +182,56 @@ float calculateShadow(vec4 lightSpacePos) {
         return 1.0;
     }
 
+    // every filter covers the same 2 texel radius, the larger ones with more taps
+    int radius = int(SHADOW_FILTER);
+    if (radius == 0) {
+        return texture(shadowMap, projCoords);
+    }
+
     float shadow = 0.0;
-    float filterRadius = 2.0;
     vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    const vec2 offsets[9] =
-    {
-        vec2(-1, -1), vec2(0, -1), vec2(1, -1),
-        vec2(-1, 0), vec2(0, 0), vec2(1, 0),
-        vec2(-1, +1), vec2(0, +1), vec2(1, +1)
-    };
-
-    for(int i = 0; i < 9; ++i) {    
-        vec2 offset = offsets[i] * texelSize * filterRadius;
-        shadow += texture(shadowMap, vec3(projCoords.xy + offset, projCoords.z));
+    float spacing = 2.0 / float(radius);
+    for (int y = -radius; y <= radius; y++) {
+        for (int x = -radius; x <= radius; x++) {
+            vec2 offset = vec2(x, y) * texelSize * spacing;
+            shadow += texture(shadowMap, vec3(projCoords.xy + offset, projCoords.z));
+        }
     }
 
-    return shadow / 9.0;
+    return shadow / float((2 * radius + 1) * (2 * radius + 1));
 }
 
 void main() {
-    vec4 baseColorTex = material.baseColorTextureIndex >= 0 ? texture(baseColorTexture, inTexcoord) : vec4(1.0);
-    vec4 emissiveTex = material.emissiveTextureIndex >= 0 ? texture(emissiveTexture, inTexcoord) : vec4(1.0);
-    vec4 metallicRoughnessTex = material.metallicRoughnessTextureIndex >= 0 ? texture(metallicRoughnessTexture, inTexcoord) : vec4(1.0);
-    vec4 occlusionTex = material.occlusionTextureIndex >= 0 ? texture(occlusionTexture, inTexcoord) : vec4(1.0);
+    vec4 baseColorTex = HAS_BASE_COLOR_MAP ? texture(baseColorTexture, inTexcoord) : vec4(1.0);
+    vec4 emissiveTex = HAS_EMISSIVE_MAP ? texture(emissiveTexture, inTexcoord) : vec4(1.0);
+    vec4 metallicRoughnessTex = HAS_METALLIC_ROUGHNESS_MAP ? texture(metallicRoughnessTexture, inTexcoord) : vec4(1.0);
+    vec4 occlusionTex = HAS_OCCLUSION_MAP ? texture(occlusionTexture, inTexcoord) : vec4(1.0);
 
-	vec3 baseColor = baseColorTex.rgb * material.baseColorFactor.rgb;
-	vec3 emissive = emissiveTex.rgb * material.emissiveFactor.rgb;
-	float roughness = clamp(metallicRoughnessTex.g * material.roughnessFactor, 0.0, 1.0);
-	float metallic = clamp(metallicRoughnessTex.b * material.metallicFactor, 0.0, 1.0);
-	float occlusion = occlusionTex.r;
+    vec3 baseColor = baseColorTex.rgb * material.baseColorFactor.rgb;
+    vec3 emissive = emissiveTex.rgb * material.emissiveFactor.rgb;
+    float roughness = clamp(metallicRoughnessTex.g * material.roughnessFactor, 0.0, 1.0);
+    float metallic = clamp(metallicRoughnessTex.b * material.metallicFactor, 0.0, 1.0);
+    float occlusion = occlusionTex.r;
 
     vec3 V = normalize(scene.cameraPos - inPosition);
     vec3 L = normalize(scene.directionalLightDir);
-    vec3 H = normalize(V + L);
 
+    // MikkTSpace: bitangent from the interpolated vectors as they are, normalized after mapping
     vec3 N = normalize(inNormal);
-    vec3 T = normalize(inTangent - (dot(inTangent, N) * N));
-    vec3 B = normalize(cross(N, T));
-    mat3 TBN = mat3(T, B, N);
-
-    if(material.normalTextureIndex >= 0) {
-	    vec3 normalTS  = texture(normalTexture, inTexcoord).rgb * 2.0 - 1.0;
+    vec3 B = inTangent.w * cross(inNormal, inTangent.xyz);
+    mat3 TBN = mat3(inTangent.xyz, B, inNormal);
+
+    if(HAS_NORMAL_MAP) {
+        // z is rebuilt so two channel (BC5) normal maps work too
+        vec3 normalTS;
+        normalTS.xy = texture(normalTexture, inTexcoord).rg * 2.0 - 1.0;
+        normalTS.z = sqrt(max(1.0 - dot(normalTS.xy, normalTS.xy), 0.0));
         if(dot(normalTS, normalTS) > 1e-4){
             N = normalize(TBN * normalTS);
         }
     }
 
     float NdotV = max(dot(N, V), 0.0);
-    float NdotL = max(dot(N, L), 0.0);
-    float NdotH = max(dot(N, H), 0.0);
-    float HdotV = max(dot(V, H), 0.0);
 
     vec3 f0_dielectric = vec3(0.04);
     vec3 f0 = mix(f0_dielectric, baseColor, metallic);
@@ -143,20 +250,17 @@ void main() {
     vec3 ambientLighting = (diffuseIbl + specualrIbl) * envIntensity * occlusion;
 
     // directional lighting
-    vec3 F = fresnelSchlick(f0, HdotV);
-    vec3 l_kd = mix(1.0 - F, vec3(0.0), metallic);
-    vec3 l_diffuseBRDF = l_kd * (baseColor / PI);
-
-    float D = ndfGGX(roughness, NdotH);
-    float G = geometrySchlickGGX(roughness, NdotL, NdotV);
-    vec3 l_specularBRDF = (F * D * G) / max(4.0 * NdotL * NdotV, 1e-5);
-
-    vec3 l_radiance = scene.directionalLightColor;
-    vec3 directionalLighting = (l_diffuseBRDF + l_specularBRDF) * l_radiance * NdotL;
+    vec3 directionalLighting = directLighting(N, V, L, baseColor, f0, roughness, metallic) *
+                               scene.directionalLightColor;
 
     // shadowing
     directionalLighting *= calculateShadow(inLightSpacePos);
 
-    vec4 color = vec4(ambientLighting + directionalLighting + emissive, 1.0);
+    vec3 localLighting = clusteredLighting(N, V, baseColor, f0, roughness, metallic);
+
+    vec4 color = vec4(ambientLighting + directionalLighting + localLighting + emissive, 1.0);
     outColor = clamp(color, 0.0, 1000.0);
+
+    // screen uv offset from where this surface was in the previous frame
+    outVelocity = (inClipPos.xy / inClipPos.w - inPrevClipPos.xy / inPrevClipPos.w) * 0.5;
 }
\ No newline at end of file
@@ -3,7 +3,7 @@
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexcoord;
-layout(location = 3) in vec3 inTangent;
+layout(location = 3) in vec4 inTangent;
 
 layout(push_constant) uniform ModelPushConstants
 {
@@ -17,18 +17,25 @@ layout(set = 0, binding = 0) uniform SceneUniform{
 	vec3 directionalLightDir;
 	vec3 directionalLightColor;
 	mat4 directionalLightMatrix;
+	mat4 viewProj;
+	mat4 prevViewProj;
 } scene;
 
 layout(location = 0) out vec3 outPosition;
 layout(location = 1) out vec3 outNormal;
 layout(location = 2) out vec2 outTexcoord;
-layout(location = 3) out vec3 outTangent;
+layout(location = 3) out vec4 outTangent;
 layout(location = 4) out vec4 outLightSpacePos;
+layout(location = 5) out vec4 outClipPos;
+layout(location = 6) out vec4 outPrevClipPos;
+
+// matches the depth pre-pass
+invariant gl_Position;
 
 void main() {
 	outPosition = vec3(modelPc.model * vec4(inPosition, 1.0));
 	outNormal = normalize(transpose(inverse(mat3(modelPc.model))) * inNormal);
-	outTangent = normalize(mat3(modelPc.model) * inTangent);
+	outTangent = vec4(mat3(modelPc.model) * inTangent.xyz, inTangent.w);
 	outTexcoord = inTexcoord;
 
 	const mat4 scaleBias = mat4(
@@ -39,5 +46,9 @@ void main() {
 	);
 	outLightSpacePos = scaleBias * scene.directionalLightMatrix * vec4(outPosition, 1.0);
 
+	// models are static between frames, only the camera moves
+	outClipPos = scene.viewProj * vec4(outPosition, 1.0);
+	outPrevClipPos = scene.prevViewProj * vec4(outPosition, 1.0);
+
 	gl_Position = scene.proj * scene.view * vec4(outPosition, 1.0);
 }
\ No newline at end of file
@@ -9,6 +9,7 @@ layout(set = 0, binding = 0) uniform PostUniform {
     float bloomStrength;
     float exposure;
     float gamma;
+    vec2 sceneScale;
 } post;
 
 layout(set = 1, binding = 0) uniform sampler2D bloomTexture;
@@ -17,12 +18,50 @@ layout(set = 3, binding = 0) uniform sampler2D shadowTexture;
 
 layout(location = 0) out vec4 outColor;
 
+// 9 tap Catmull-Rom through bilinear taps, upscales the dynamic resolution render area of the
+// scene (the top left sceneScale of the attachment) without the blur of a bilinear stretch
+vec3 sampleScene(vec2 uv)
+{
+    vec2 size = vec2(textureSize(sceneTexture, 0));
+    vec2 uvMax = post.sceneScale - 0.5 / size;
+
+    vec2 samplePos = uv * post.sceneScale * size;
+    vec2 texPos1 = floor(samplePos - 0.5) + 0.5;
+    vec2 f = samplePos - texPos1;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+    vec2 w12 = w1 + w2;
+    vec2 texPos0 = min((texPos1 - 1.0) / size, uvMax);
+    vec2 texPos3 = min((texPos1 + 2.0) / size, uvMax);
+    vec2 texPos12 = min((texPos1 + w2 / w12) / size, uvMax);
+
+    vec3 color = vec3(0.0);
+    color += texture(sceneTexture, vec2(texPos0.x, texPos0.y)).rgb * w0.x * w0.y;
+    color += texture(sceneTexture, vec2(texPos12.x, texPos0.y)).rgb * w12.x * w0.y;
+    color += texture(sceneTexture, vec2(texPos3.x, texPos0.y)).rgb * w3.x * w0.y;
+
+    color += texture(sceneTexture, vec2(texPos0.x, texPos12.y)).rgb * w0.x * w12.y;
+    color += texture(sceneTexture, vec2(texPos12.x, texPos12.y)).rgb * w12.x * w12.y;
+    color += texture(sceneTexture, vec2(texPos3.x, texPos12.y)).rgb * w3.x * w12.y;
+
+    color += texture(sceneTexture, vec2(texPos0.x, texPos3.y)).rgb * w0.x * w3.y;
+    color += texture(sceneTexture, vec2(texPos12.x, texPos3.y)).rgb * w12.x * w3.y;
+    color += texture(sceneTexture, vec2(texPos3.x, texPos3.y)).rgb * w3.x * w3.y;
+
+    // the negative lobes ring around very bright texels
+    return max(color, vec3(0.0));
+}
+
 void main()
 {
     vec3 color;
 
     if(post.shadowDepthView == 0){
-        vec3 color0 = texture(sceneTexture, inUV).rgb;
+        vec3 color0 = sampleScene(inUV);
         vec3 color1 = texture(bloomTexture, inUV).rgb;
 
         color = mix(color0, color1, post.bloomStrength);
@@ -1,6 +1,8 @@
 #version 450
 
 layout(location = 0) in vec3 inPos;
+layout(location = 1) in vec4 inClipPos;
+layout(location = 2) in vec4 inPrevClipPos;
 
 layout(set = 0, binding = 1) uniform SkyboxUniform {
     float environmentIntensity;
@@ -13,6 +15,7 @@ layout(set = 1, binding = 1) uniform samplerCube irradianceMap;
 layout(set = 1, binding = 2) uniform sampler2D brdfLUT;
 
 layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec2 outVelocity;
 
 void main() {
     vec3 envColor;
@@ -26,4 +29,5 @@ void main() {
     envColor *= skybox.environmentIntensity;
 
     outColor = vec4(envColor, 1.0);
+    outVelocity = (inClipPos.xy / inClipPos.w - inPrevClipPos.xy / inPrevClipPos.w) * 0.5;
 }
\ No newline at end of file
@@ -7,9 +7,13 @@ layout(set = 0, binding = 0) uniform SceneUniform{
 	vec3 directionalLightDir;
 	vec3 directionalLightColor;
 	mat4 directionalLightMatrix;
+	mat4 viewProj;
+	mat4 prevViewProj;
 } scene;
 
 layout(location = 0) out vec3 outPos;
+layout(location = 1) out vec4 outClipPos;
+layout(location = 2) out vec4 outPrevClipPos;
 
 const vec3 positions[8] = vec3[8](
 	vec3(-1.0,-1.0, 1.0),
@@ -37,5 +41,8 @@ void main() {
     vec4 clipPos = scene.proj * mat4(mat3(scene.view)) * vec4(pos, 1.0);
     
     outPos = pos;
+    // directions, only the camera rotation moves the sky
+    outClipPos = scene.viewProj * vec4(pos, 0.0);
+    outPrevClipPos = scene.prevViewProj * vec4(pos, 0.0);
     gl_Position = clipPos.xyww;
 }
\ No newline at end of file
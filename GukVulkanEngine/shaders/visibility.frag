@@ -0,0 +1,10 @@
+#version 450
+
+layout(location = 0) flat in uint inDraw;
+
+// draw and triangle of the pixel, cleared to ~0 where nothing was drawn
+layout(location = 0) out uvec2 outVisibility;
+
+void main() {
+    outVisibility = uvec2(inDraw, gl_PrimitiveID);
+}
@@ -0,0 +1,25 @@
+#version 450
+
+// Visibility buffer pass, position only. The index of the draw in the draw buffer comes in as the
+// first instance, material_resolve.comp refetches the rest of the vertex from there.
+
+layout(location = 0) in vec3 inPosition;
+
+layout(push_constant) uniform ModelPushConstants
+{
+    mat4 model;
+} modelPc;
+
+layout(set = 0, binding = 0) uniform SceneUniform{
+	mat4 view;
+	mat4 proj;
+} scene;
+
+layout(location = 0) flat out uint outDraw;
+
+void main() {
+	outDraw = gl_InstanceIndex;
+
+	vec3 position = vec3(modelPc.model * vec4(inPosition, 1.0));
+	gl_Position = scene.proj * scene.view * vec4(position, 1.0);
+}